@@ -0,0 +1,128 @@
+#!/usr/bin/env python3
+
+# Runs the benchmarks of the packaged x86 and x86_64 testrunners and prints
+# both results side by side. Build both architectures first:
+#
+#   python ../configure.py --targets x86,x86_64 && ambuild
+#   python ../compare_archs.py --package package
+
+import argparse
+import csv
+import os
+import subprocess
+import sys
+import tempfile
+
+ARCHS = ['x86', 'x86_64']
+
+def find_binary(package, arch):
+  name = 'testrunner.exe' if os.name == 'nt' else 'testrunner'
+  return os.path.join(package, arch, name)
+
+def run_benchmarks(binary, report, args):
+  command = [
+    binary,
+    '--bench',
+    '--bench_report=' + report,
+    '--bench_scale=' + str(args.bench_scale),
+    '--gtest_filter=' + args.filter,
+  ]
+  output = None if args.verbose else subprocess.DEVNULL
+  return subprocess.run(command, stdout=output).returncode
+
+def read_report(path):
+  metrics = {}
+  with open(path, newline='') as report:
+    for row in csv.DictReader(report):
+      metrics[(row['test'], row['metric'])] = (float(row['value']), row['unit'])
+  return metrics
+
+def compare(results):
+  keys = []
+  for arch in ARCHS:
+    for key in results[arch]:
+      if key not in keys:
+        keys.append(key)
+
+  rows = []
+  for test, metric in keys:
+    values = [results[arch].get((test, metric)) for arch in ARCHS]
+    unit = next(value[1] for value in values if value)
+    x86, x86_64 = [value[0] if value else None for value in values]
+    ratio = None
+    if x86 is not None and x86_64:
+      ratio = x86 / x86_64
+    rows.append((test, metric, x86, x86_64, unit, ratio))
+  return rows
+
+def format_value(value, digits=3):
+  return '-' if value is None else '{:.{}f}'.format(value, digits)
+
+def print_table(rows):
+  header = ('test', 'metric', 'x86', 'x86_64', 'unit', 'x86/x86_64')
+  lines = [header] + [(
+    test,
+    metric,
+    format_value(x86),
+    format_value(x86_64),
+    unit,
+    format_value(ratio, 2),
+  ) for test, metric, x86, x86_64, unit, ratio in rows]
+
+  widths = [max(len(line[i]) for line in lines) for i in range(len(header))]
+  for line in lines:
+    print('  '.join(cell.ljust(width) for cell, width in zip(line, widths)).rstrip())
+
+def write_csv(path, rows):
+  with open(path, 'w', newline='') as output:
+    writer = csv.writer(output)
+    writer.writerow(['test', 'metric', 'x86', 'x86_64', 'unit', 'x86_over_x86_64'])
+    for test, metric, x86, x86_64, unit, ratio in rows:
+      writer.writerow([
+        test,
+        metric,
+        '' if x86 is None else x86,
+        '' if x86_64 is None else x86_64,
+        unit,
+        '' if ratio is None else ratio,
+      ])
+
+def main():
+  parser = argparse.ArgumentParser(
+    description='Compares the benchmarks of the x86 and x86_64 testrunners'
+  )
+  parser.add_argument('--package', default=os.path.join('build', 'package'),
+                      help='Folder with the packaged x86 and x86_64 binaries')
+  parser.add_argument('--filter', default='*AbiHookBenchmark*',
+                      help='gtest filter selecting the benchmarks to compare')
+  parser.add_argument('--bench_scale', type=float, default=1.0,
+                      help='Passed on to both testrunners')
+  parser.add_argument('--output', default=None,
+                      help='Also write the comparison to this CSV file')
+  parser.add_argument('--verbose', action='store_true',
+                      help='Show the output of the testrunners')
+  args = parser.parse_args()
+
+  results = {}
+  failed = False
+  with tempfile.TemporaryDirectory() as folder:
+    for arch in ARCHS:
+      binary = find_binary(args.package, arch)
+      if not os.path.isfile(binary):
+        sys.stderr.write('No {} testrunner at {}\n'.format(arch, binary))
+        return 1
+
+      report = os.path.join(folder, arch + '.csv')
+      if run_benchmarks(binary, report, args) != 0:
+        sys.stderr.write('{} benchmarks failed\n'.format(arch))
+        failed = True
+      results[arch] = read_report(report) if os.path.isfile(report) else {}
+
+  rows = compare(results)
+  print_table(rows)
+  if args.output:
+    write_csv(args.output, rows)
+  return 1 if failed else 0
+
+if __name__ == '__main__':
+  sys.exit(main())
@@ -0,0 +1,252 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <khook.hpp>
+#include <string>
+
+#include "bench.hpp"
+#include "hooks.hpp"
+#include "main.hpp"
+
+// Hooked call cost for signatures that the x86 and x86_64 ABIs pass and
+// return differently: stack against register arguments, 64-bit values split
+// over two registers, x87 against SSE floating point and structures returned
+// through a hidden pointer. Member hooks are __thiscall on 32-bit MSVC.
+class AbiHookBenchmark: public ::testing::TestWithParam<HookKind> {
+  protected:
+    // Too large to be returned in registers by any of the ABIs.
+    struct Wide {
+        std::int32_t a;
+        std::int32_t b;
+        std::int32_t c;
+        std::int32_t d;
+        std::int32_t e;
+    };
+
+    class HookedClass {
+      public:
+        NOINLINE static void Void() {
+            s_voidCalls++;
+        }
+
+        NOINLINE static int OneInt(int a) {
+            return a + 1;
+        }
+
+        NOINLINE static int SixInts(int a, int b, int c, int d, int e, int f) {
+            return a + b * 2 + c * 3 + d * 4 + e * 5 + f * 6;
+        }
+
+        NOINLINE static std::int64_t Int64(std::int64_t a, std::int64_t b) {
+            return (a << 32) + b;
+        }
+
+        NOINLINE static double Double(double a, double b) {
+            return a * 0.5 + b;
+        }
+
+        NOINLINE static Wide Struct(int a) {
+            return {a, a + 1, a + 2, a + 3, a + 4};
+        }
+    };
+
+    class VirtualHookedClass {
+      public:
+        virtual void Void() {
+            s_voidCalls++;
+        }
+
+        virtual int OneInt(int a) {
+            return a + 1;
+        }
+
+        virtual int SixInts(int a, int b, int c, int d, int e, int f) {
+            return a + b * 2 + c * 3 + d * 4 + e * 5 + f * 6;
+        }
+
+        virtual std::int64_t Int64(std::int64_t a, std::int64_t b) {
+            return (a << 32) + b;
+        }
+
+        virtual double Double(double a, double b) {
+            return a * 0.5 + b;
+        }
+
+        virtual Wide Struct(int a) {
+            return {a, a + 1, a + 2, a + 3, a + 4};
+        }
+    };
+
+    void SetUp() override {
+        target = new VirtualHookedClass();
+    }
+
+    void TearDown() override {
+        if (target) {
+            delete target;
+            target = nullptr;
+        }
+    }
+
+    template<typename Ret, typename... Args>
+    static HookHandle InstallStatic(Ret (*function)(Args...)) {
+        using Hook = NoopStaticHookTemplate<Ret, Args...>;
+        return HookHandle::SetupHook(
+            (void*)function,
+            nullptr,
+            (void*)&Hook::OnRemoved,
+            (void*)&Hook::PrePostNoop,
+            (void*)&Hook::PrePostNoop,
+            (void*)&Hook::MakeReturn,
+            (void*)&Hook::CallOriginal,
+            false
+        );
+    }
+
+    template<typename Ret, typename... Args>
+    HookHandle InstallVirtual(Ret (VirtualHookedClass::*method)(Args...)) {
+        using Hook = NoopMemberHookTemplate<Ret, Args...>;
+        return HookHandle::SetupVirtualHook(
+            *(void***)(target),
+            KHook::GetVtableIndex(method),
+            nullptr,
+            KHook::ExtractMFP(&Hook::OnRemoved),
+            KHook::ExtractMFP(&Hook::PrePostNoop),
+            KHook::ExtractMFP(&Hook::PrePostNoop),
+            KHook::ExtractMFP(&Hook::MakeReturn),
+            KHook::ExtractMFP(&Hook::CallOriginal),
+            false
+        );
+    }
+
+    // Reports the direct and the hooked cost of a call and the difference,
+    // `call` returns whether the result matched the original one.
+    template<typename Install, typename Call>
+    void Measure(const char* shape, Install install, Call call) {
+        std::size_t iterations = BenchIterations(200000);
+        std::uint64_t badCalls = 0;
+        auto checked = [&](std::size_t i) {
+            badCalls += call((int)(i & 0xFFFF)) ? 0 : 1;
+        };
+
+        PreciseMeasurement direct = MeasurePrecise(iterations, checked);
+        HookHandle hook = install();
+        ASSERT_TRUE(hook.Valid()) << shape << " hook setup should succeed";
+        PreciseMeasurement hooked = MeasurePrecise(iterations, checked);
+        hook.Remove();
+
+        std::string name(shape);
+        ReportPrecise((name + ".direct").c_str(), direct);
+        ReportPrecise((name + ".hooked").c_str(), hooked);
+        ReportMetric((name + ".tax").c_str(), hooked.ns - direct.ns, "ns");
+        EXPECT_EQ(badCalls, 0u)
+            << shape << " calls should return the original value";
+    }
+
+    static inline std::uint64_t s_voidCalls = 0;
+
+    ScopedCallbackLogging m_quiet {false};
+    VirtualHookedClass* target = nullptr;
+};
+
+TEST_P(AbiHookBenchmark, ArgumentsAndReturnValues) {
+    BENCHMARK_ONLY();
+
+    bool isStatic = GetParam() == HookKind::Static;
+    ReportMetric("pointer_bits", (double)(sizeof(void*) * 8), "bits");
+
+    Measure(
+        "void_no_args",
+        [&]() {
+            return isStatic ? InstallStatic(&HookedClass::Void)
+                            : InstallVirtual(&VirtualHookedClass::Void);
+        },
+        [&](int i) {
+            std::uint64_t before = s_voidCalls;
+            if (isStatic) {
+                HookedClass::Void();
+            } else {
+                target->Void();
+            }
+            return s_voidCalls == before + 1;
+        }
+    );
+
+    Measure(
+        "int_one_arg",
+        [&]() {
+            return isStatic ? InstallStatic(&HookedClass::OneInt)
+                            : InstallVirtual(&VirtualHookedClass::OneInt);
+        },
+        [&](int i) {
+            int result = isStatic ? HookedClass::OneInt(i) : target->OneInt(i);
+            return result == i + 1;
+        }
+    );
+
+    // More than Windows x64 passes in registers, all on the stack on x86.
+    Measure(
+        "int_six_args",
+        [&]() {
+            return isStatic ? InstallStatic(&HookedClass::SixInts)
+                            : InstallVirtual(&VirtualHookedClass::SixInts);
+        },
+        [&](int i) {
+            int result = isStatic
+                ? HookedClass::SixInts(i, i + 1, i + 2, i + 3, i + 4, i + 5)
+                : target->SixInts(i, i + 1, i + 2, i + 3, i + 4, i + 5);
+            return result == 21 * i + 70;
+        }
+    );
+
+    // Returned in edx:eax on x86.
+    Measure(
+        "int64_two_args",
+        [&]() {
+            return isStatic ? InstallStatic(&HookedClass::Int64)
+                            : InstallVirtual(&VirtualHookedClass::Int64);
+        },
+        [&](int i) {
+            std::int64_t result = isStatic ? HookedClass::Int64(i, 7)
+                                           : target->Int64(i, 7);
+            return result == ((std::int64_t)i << 32) + 7;
+        }
+    );
+
+    // Returned on the x87 stack on x86, in xmm0 on x86_64.
+    Measure(
+        "double_two_args",
+        [&]() {
+            return isStatic ? InstallStatic(&HookedClass::Double)
+                            : InstallVirtual(&VirtualHookedClass::Double);
+        },
+        [&](int i) {
+            double result = isStatic ? HookedClass::Double(i, 0.25)
+                                     : target->Double(i, 0.25);
+            return result == i * 0.5 + 0.25;
+        }
+    );
+
+    // Returned through a hidden pointer everywhere.
+    Measure(
+        "struct_return",
+        [&]() {
+            return isStatic ? InstallStatic(&HookedClass::Struct)
+                            : InstallVirtual(&VirtualHookedClass::Struct);
+        },
+        [&](int i) {
+            Wide result = isStatic ? HookedClass::Struct(i) : target->Struct(i);
+            return result.a == i && result.b == i + 1 && result.c == i + 2
+                && result.d == i + 3 && result.e == i + 4;
+        }
+    );
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Hooks,
+    AbiHookBenchmark,
+    ::testing::Values(HookKind::Static, HookKind::Virtual),
+    [](const ::testing::TestParamInfo<HookKind>& info) {
+        return std::string(HookKindName(info.param));
+    }
+);
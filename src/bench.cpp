@@ -0,0 +1,357 @@
+#include "bench.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+
+#if defined(_WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+#elif defined(__linux__)
+    #include <pthread.h>
+    #include <sched.h>
+#endif
+
+#if defined(_MSC_VER)
+volatile char g_benchSink;
+#endif
+
+static FILE* s_benchReport = nullptr;
+
+std::size_t BenchIterations(std::size_t iterations) {
+    double scaled = (double)iterations * g_options.benchScale;
+    return scaled < 1.0 ? 1 : (std::size_t)scaled;
+}
+
+std::int64_t BenchDurationNs(double milliseconds) {
+    return (std::int64_t)(milliseconds * g_options.benchScale * 1e6);
+}
+
+unsigned int BenchThreads() {
+    if (g_options.benchThreads > 0) {
+        return (unsigned int)g_options.benchThreads;
+    }
+    unsigned int hardware = std::thread::hardware_concurrency();
+    return hardware > 2 ? hardware - 1 : 2;
+}
+
+static constexpr std::size_t kHistogramSubBuckets = 16;
+static constexpr std::size_t kHistogramBuckets = 61 * kHistogramSubBuckets;
+
+LatencyHistogram::LatencyHistogram() : m_buckets(kHistogramBuckets, 0) {}
+
+std::size_t LatencyHistogram::BucketOf(std::uint64_t value) {
+    if (value < kHistogramSubBuckets) {
+        return (std::size_t)value;
+    }
+    int msb = 0;
+    for (int step = 32; step > 0; step /= 2) {
+        if (value >> (msb + step)) {
+            msb += step;
+        }
+    }
+    std::size_t sub = (std::size_t)(value >> (msb - 4)) & 15;
+    return (std::size_t)(msb - 3) * kHistogramSubBuckets + sub;
+}
+
+std::uint64_t LatencyHistogram::BucketLimit(std::size_t bucket) {
+    if (bucket < kHistogramSubBuckets) {
+        return bucket;
+    }
+    int msb = (int)(bucket / kHistogramSubBuckets) + 3;
+    std::uint64_t sub = bucket % kHistogramSubBuckets;
+    std::uint64_t width = (std::uint64_t)1 << (msb - 4);
+    return (kHistogramSubBuckets + sub) * width + width - 1;
+}
+
+void LatencyHistogram::Record(std::int64_t ns) {
+    if (ns < 0) {
+        ns = 0;
+    }
+    m_buckets[BucketOf((std::uint64_t)ns)]++;
+    m_count++;
+    m_total += (double)ns;
+    if (ns > m_max) {
+        m_max = ns;
+    }
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other) {
+    for (std::size_t i = 0; i < m_buckets.size(); i++) {
+        m_buckets[i] += other.m_buckets[i];
+    }
+    m_count += other.m_count;
+    m_total += other.m_total;
+    if (other.m_max > m_max) {
+        m_max = other.m_max;
+    }
+}
+
+std::uint64_t LatencyHistogram::CountAbove(std::int64_t ns) const {
+    std::uint64_t count = 0;
+    for (std::size_t i = 0; i < m_buckets.size(); i++) {
+        if ((std::int64_t)BucketLimit(i) > ns) {
+            count += m_buckets[i];
+        }
+    }
+    return count;
+}
+
+double LatencyHistogram::Percentile(double percentile) const {
+    std::uint64_t rank =
+        (std::uint64_t)std::ceil(percentile / 100.0 * (double)m_count);
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < m_buckets.size(); i++) {
+        seen += m_buckets[i];
+        if (seen >= rank && seen > 0) {
+            return (double)std::min<std::int64_t>(BucketLimit(i), m_max);
+        }
+    }
+    return (double)m_max;
+}
+
+LatencySummary LatencyHistogram::Summarize() const {
+    LatencySummary summary;
+    if (m_count == 0) {
+        return summary;
+    }
+    summary.samples = (std::size_t)m_count;
+    summary.mean = m_total / (double)m_count;
+    summary.p50 = Percentile(50.0);
+    summary.p99 = Percentile(99.0);
+    summary.p999 = Percentile(99.9);
+    summary.max = (double)m_max;
+    return summary;
+}
+
+static double Percentile(
+    const std::vector<std::int64_t>& sorted,
+    double percentile
+) {
+    std::size_t index =
+        (std::size_t)std::ceil(percentile / 100.0 * (double)sorted.size());
+    index = index == 0 ? 0 : index - 1;
+    return (double)sorted[std::min(index, sorted.size() - 1)];
+}
+
+LatencySummary SummarizeLatencies(std::vector<std::int64_t>& samples) {
+    LatencySummary summary;
+    if (samples.empty()) {
+        return summary;
+    }
+    std::sort(samples.begin(), samples.end());
+
+    double total = 0.0;
+    for (std::int64_t sample : samples) {
+        total += (double)sample;
+    }
+    summary.samples = samples.size();
+    summary.mean = total / (double)samples.size();
+    summary.p50 = Percentile(samples, 50.0);
+    summary.p99 = Percentile(samples, 99.0);
+    summary.p999 = Percentile(samples, 99.9);
+    summary.max = (double)samples.back();
+    return summary;
+}
+
+void OpenBenchReport() {
+    if (s_benchReport || g_options.benchReport.empty()) {
+        return;
+    }
+    s_benchReport = fopen(g_options.benchReport.c_str(), "w");
+    if (s_benchReport) {
+        fprintf(s_benchReport, "test,metric,value,unit\n");
+        fflush(s_benchReport);
+    } else {
+        fprintf(
+            stderr,
+            "Failed to open benchmark report \"%s\"\n",
+            g_options.benchReport.c_str()
+        );
+    }
+}
+
+void ReportMetric(const char* metric, double value, const char* unit) {
+    const ::testing::TestInfo* info =
+        ::testing::UnitTest::GetInstance()->current_test_info();
+    std::string test = "<none>";
+    if (info) {
+        test = std::string(info->test_suite_name()) + "." + info->name();
+    }
+
+    printf("[ BENCH    ] %s %s = %.3f %s\n", test.c_str(), metric, value, unit);
+    fflush(stdout);
+
+    if (s_benchReport) {
+        fprintf(
+            s_benchReport,
+            "%s,%s,%.6f,%s\n",
+            test.c_str(),
+            metric,
+            value,
+            unit
+        );
+        fflush(s_benchReport);
+    }
+}
+
+void ReportLatencies(const char* metric, const LatencySummary& summary) {
+    std::string name(metric);
+    ReportMetric((name + ".mean").c_str(), summary.mean, "ns");
+    ReportMetric((name + ".p50").c_str(), summary.p50, "ns");
+    ReportMetric((name + ".p99").c_str(), summary.p99, "ns");
+    ReportMetric((name + ".p999").c_str(), summary.p999, "ns");
+    ReportMetric((name + ".max").c_str(), summary.max, "ns");
+}
+
+#pragma region PreciseTiming
+
+static constexpr std::size_t kBootstrapResamples = 1000;
+static constexpr std::uint32_t kBootstrapSeed = 0x6b686f6f;
+
+static double s_nsPerTick = 0.0;
+
+double BenchNsPerTick() {
+    if (s_nsPerTick > 0.0) {
+        return s_nsPerTick;
+    }
+#if BENCH_HAS_TSC
+    std::int64_t startNs = GetWallTimeNs();
+    std::uint64_t startTicks = BenchTicksBegin();
+    while (GetWallTimeNs() - startNs < 20000000) {
+    }
+    std::uint64_t ticks = BenchTicksEnd() - startTicks;
+    s_nsPerTick = (double)(GetWallTimeNs() - startNs) / (double)ticks;
+#else
+    s_nsPerTick = 1.0;
+#endif
+    return s_nsPerTick;
+}
+
+static int CurrentCpu() {
+#if defined(_WIN32)
+    return (int)GetCurrentProcessorNumber();
+#elif defined(__linux__)
+    return sched_getcpu();
+#else
+    return -1;
+#endif
+}
+
+ScopedCpuPin::ScopedCpuPin() : ScopedCpuPin(CurrentCpu()) {}
+
+ScopedCpuPin::ScopedCpuPin(int cpu) {
+    if (cpu < 0) {
+        return;
+    }
+#if defined(_WIN32)
+    if (cpu >= (int)sizeof(DWORD_PTR) * 8) {
+        return;
+    }
+    DWORD_PTR mask = (DWORD_PTR)1 << cpu;
+    DWORD_PTR previous = SetThreadAffinityMask(GetCurrentThread(), mask);
+    m_previous[0] = previous;
+    m_pinned = previous != 0;
+#elif defined(__linux__)
+    static_assert(sizeof(cpu_set_t) <= sizeof(m_previous), "cpu_set_t");
+    cpu_set_t previous;
+    if (cpu >= CPU_SETSIZE
+        || pthread_getaffinity_np(pthread_self(), sizeof(previous), &previous)
+            != 0) {
+        return;
+    }
+    memcpy(m_previous, &previous, sizeof(previous));
+
+    cpu_set_t only;
+    CPU_ZERO(&only);
+    CPU_SET(cpu, &only);
+    m_pinned = pthread_setaffinity_np(pthread_self(), sizeof(only), &only) == 0;
+#endif
+}
+
+ScopedCpuPin::~ScopedCpuPin() {
+    if (!m_pinned) {
+        return;
+    }
+#if defined(_WIN32)
+    SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)m_previous[0]);
+#elif defined(__linux__)
+    cpu_set_t previous;
+    memcpy(&previous, m_previous, sizeof(previous));
+    pthread_setaffinity_np(pthread_self(), sizeof(previous), &previous);
+#endif
+}
+
+std::size_t BenchTrials(std::size_t iterations) {
+    std::size_t trials = (std::size_t)std::max(g_options.benchTrials, 1);
+    return std::max<std::size_t>(std::min(trials, iterations), 1);
+}
+
+// Sorts the values.
+static double MedianOf(std::vector<double>& values) {
+    std::sort(values.begin(), values.end());
+    std::size_t middle = values.size() / 2;
+    if (values.size() % 2 == 0) {
+        return (values[middle - 1] + values[middle]) / 2.0;
+    }
+    return values[middle];
+}
+
+PreciseMeasurement
+SummarizeTrials(std::vector<double>& trialNs, double loopOverheadNs) {
+    PreciseMeasurement measurement;
+    measurement.loopOverheadNs = loopOverheadNs;
+    measurement.trials = trialNs.size();
+    if (trialNs.empty()) {
+        return measurement;
+    }
+
+    for (double& trial : trialNs) {
+        trial -= loopOverheadNs;
+    }
+    double median = MedianOf(trialNs);
+    std::vector<double> deviations;
+    for (double trial : trialNs) {
+        deviations.push_back(std::fabs(trial - median));
+    }
+    // Scaled to estimate the standard deviation of normal noise.
+    double limit = 3.0 * 1.4826 * MedianOf(deviations);
+
+    std::vector<double> kept;
+    for (double trial : trialNs) {
+        if (std::fabs(trial - median) <= limit) {
+            kept.push_back(trial);
+        }
+    }
+    measurement.rejected = trialNs.size() - kept.size();
+    measurement.ns = MedianOf(kept);
+
+    std::mt19937 random(kBootstrapSeed);
+    std::uniform_int_distribution<std::size_t> pick(0, kept.size() - 1);
+    std::vector<double> resample(kept.size());
+    std::vector<double> medians;
+    for (std::size_t r = 0; r < kBootstrapResamples; r++) {
+        for (double& value : resample) {
+            value = kept[pick(random)];
+        }
+        medians.push_back(MedianOf(resample));
+    }
+    std::sort(medians.begin(), medians.end());
+    measurement.ciLow = medians[kBootstrapResamples * 25 / 1000];
+    measurement.ciHigh = medians[kBootstrapResamples * 975 / 1000 - 1];
+    return measurement;
+}
+
+void ReportPrecise(const char* metric, const PreciseMeasurement& measurement) {
+    std::string name(metric);
+    ReportMetric(metric, measurement.ns, "ns");
+    ReportMetric((name + ".ci_low").c_str(), measurement.ciLow, "ns");
+    ReportMetric((name + ".ci_high").c_str(), measurement.ciHigh, "ns");
+}
+
+#pragma endregion
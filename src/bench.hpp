@@ -0,0 +1,249 @@
+#pragma once
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "options.hpp"
+#include "resources.hpp"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    #include <intrin.h>
+    #define BENCH_HAS_TSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+    #define BENCH_HAS_TSC 1
+#else
+    #define BENCH_HAS_TSC 0
+#endif
+
+// Benchmarks are regular tests that are skipped unless the runner was started
+// with --bench, so the default test run stays within the CI timeout.
+#define BENCHMARK_ONLY() \
+    do { \
+        if (!g_options.bench) { \
+            GTEST_SKIP() << "Benchmarks are disabled, run with --bench"; \
+        } \
+        SetTestResourceBudget(ResourceBudget::Unlimited()); \
+    } while (0)
+
+#if defined(_MSC_VER)
+extern volatile char g_benchSink;
+
+template<typename T>
+inline void DoNotOptimize(const T& value) {
+    g_benchSink = *reinterpret_cast<const volatile char*>(&value);
+}
+#else
+template<typename T>
+inline void DoNotOptimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+#endif
+
+struct LatencySummary {
+    std::size_t samples = 0;
+    double mean = 0.0;
+    double p50 = 0.0;
+    double p99 = 0.0;
+    double p999 = 0.0;
+    double max = 0.0;
+};
+
+// Log-linear histogram for latencies that are recorded too often to keep
+// every sample, values are bucketed with a relative error of at most 1/16.
+class LatencyHistogram {
+  public:
+    LatencyHistogram();
+
+    void Record(std::int64_t ns);
+    void Merge(const LatencyHistogram& other);
+    std::uint64_t CountAbove(std::int64_t ns) const;
+    LatencySummary Summarize() const;
+
+    std::uint64_t Count() const {
+        return m_count;
+    }
+
+  private:
+    static std::size_t BucketOf(std::uint64_t value);
+    static std::uint64_t BucketLimit(std::size_t bucket);
+    double Percentile(double percentile) const;
+
+    std::vector<std::uint64_t> m_buckets;
+    std::uint64_t m_count = 0;
+    double m_total = 0.0;
+    std::int64_t m_max = 0;
+};
+
+// Scales a default iteration count by --bench_scale, never returning zero.
+std::size_t BenchIterations(std::size_t iterations);
+
+// Scales a default run duration by --bench_scale.
+std::int64_t BenchDurationNs(double milliseconds);
+
+// Number of worker threads a benchmark should use, --bench_threads or one
+// less than the number of hardware threads.
+unsigned int BenchThreads();
+
+// Sorts the samples in place.
+LatencySummary SummarizeLatencies(std::vector<std::int64_t>& samples);
+
+// Opened up front so that forked children append to the same file.
+void OpenBenchReport();
+
+// Prints a metric of the running benchmark and appends it to --bench_report.
+void ReportMetric(const char* metric, double value, const char* unit);
+void ReportLatencies(const char* metric, const LatencySummary& summary);
+
+#pragma region PreciseTiming
+
+// Time stamp counter reads that instructions can't be reordered across,
+// lfence before and after the start and rdtscp followed by lfence at the
+// end. The wall clock in nanoseconds where there is no usable counter.
+inline std::uint64_t BenchTicksBegin() {
+#if BENCH_HAS_TSC && defined(_MSC_VER)
+    _mm_lfence();
+    std::uint64_t ticks = __rdtsc();
+    _mm_lfence();
+    return ticks;
+#elif BENCH_HAS_TSC
+    std::uint32_t low;
+    std::uint32_t high;
+    asm volatile("lfence\n\trdtsc\n\tlfence"
+                 : "=a"(low), "=d"(high)
+                 :
+                 : "memory");
+    return ((std::uint64_t)high << 32) | low;
+#else
+    return (std::uint64_t)GetWallTimeNs();
+#endif
+}
+
+inline std::uint64_t BenchTicksEnd() {
+#if BENCH_HAS_TSC && defined(_MSC_VER)
+    unsigned int aux;
+    std::uint64_t ticks = __rdtscp(&aux);
+    _mm_lfence();
+    return ticks;
+#elif BENCH_HAS_TSC
+    std::uint32_t low;
+    std::uint32_t high;
+    asm volatile("rdtscp\n\tlfence"
+                 : "=a"(low), "=d"(high)
+                 :
+                 : "ecx", "memory");
+    return ((std::uint64_t)high << 32) | low;
+#else
+    return (std::uint64_t)GetWallTimeNs();
+#endif
+}
+
+// Calibrated against the wall clock on first use, which has to happen before
+// any worker thread of a benchmark reads the counter.
+double BenchNsPerTick();
+
+// Nanoseconds since a BenchTicksBegin() reading, for single calls whose
+// latencies go into a LatencyHistogram.
+inline std::int64_t BenchElapsedNs(std::uint64_t startTicks) {
+    std::uint64_t ticks = BenchTicksEnd() - startTicks;
+    return (std::int64_t)((double)ticks * BenchNsPerTick() + 0.5);
+}
+
+// Pins the calling thread to the CPU it is running on, or to the given one,
+// and restores its previous affinity when it goes out of scope. Does nothing
+// where thread affinity isn't supported.
+class ScopedCpuPin {
+  public:
+    ScopedCpuPin();
+    explicit ScopedCpuPin(int cpu);
+    ~ScopedCpuPin();
+
+    ScopedCpuPin(const ScopedCpuPin&) = delete;
+    ScopedCpuPin& operator=(const ScopedCpuPin&) = delete;
+
+    bool Pinned() const {
+        return m_pinned;
+    }
+
+  private:
+    bool m_pinned = false;
+    std::uint64_t m_previous[16] = {};
+};
+
+// Per-operation cost from repeated trials, with the calibrated cost of the
+// measuring loop itself already subtracted.
+struct PreciseMeasurement {
+    // Median of the trials that weren't rejected.
+    double ns = 0.0;
+    // 95% bootstrap confidence interval of that median.
+    double ciLow = 0.0;
+    double ciHigh = 0.0;
+    double loopOverheadNs = 0.0;
+    std::size_t trials = 0;
+    std::size_t rejected = 0;
+};
+
+// Number of timed trials, --bench_trials, but never more than iterations.
+std::size_t BenchTrials(std::size_t iterations);
+
+// Rejects trials further than 3 scaled median absolute deviations from the
+// median and bootstraps the median of the rest. Reorders the trials.
+PreciseMeasurement
+SummarizeTrials(std::vector<double>& trialNs, double loopOverheadNs);
+
+template<typename Fn>
+inline double TimeTrialNs(std::size_t begin, std::size_t end, Fn& fn) {
+    std::uint64_t start = BenchTicksBegin();
+    for (std::size_t i = begin; i < end; i++) {
+        fn(i);
+    }
+    std::uint64_t stop = BenchTicksEnd();
+    return (double)(stop - start) * BenchNsPerTick() / (double)(end - begin);
+}
+
+// Calls fn(i) exactly once for every i below iterations, split into an
+// untimed warm-up share and --bench_trials timed ones, on a pinned thread.
+template<typename Fn>
+inline PreciseMeasurement MeasurePrecise(std::size_t iterations, Fn&& fn) {
+    ScopedCpuPin pin;
+    std::size_t trials = BenchTrials(iterations);
+    std::size_t shares = iterations > trials ? trials + 1 : trials;
+    auto bound = [&](std::size_t share) {
+        return iterations * share / shares;
+    };
+
+    auto empty = [](std::size_t i) {
+        DoNotOptimize(i);
+    };
+    std::vector<double> overhead;
+    for (std::size_t t = 0; t < trials; t++) {
+        overhead.push_back(TimeTrialNs(0, bound(1), empty));
+    }
+    std::sort(overhead.begin(), overhead.end());
+    double loopOverheadNs = overhead[overhead.size() / 2];
+
+    std::size_t first = shares - trials;
+    if (first > 0) {
+        for (std::size_t i = 0; i < bound(1); i++) {
+            fn(i);
+        }
+    }
+    std::vector<double> trialNs;
+    for (std::size_t share = first; share < shares; share++) {
+        trialNs.push_back(TimeTrialNs(bound(share), bound(share + 1), fn));
+    }
+    return SummarizeTrials(trialNs, loopOverheadNs);
+}
+
+template<typename Fn>
+inline double MeasureNsPerOp(std::size_t iterations, Fn&& fn) {
+    return MeasurePrecise(iterations, fn).ns;
+}
+
+// Reports the median as `metric` and the interval as .ci_low and .ci_high.
+void ReportPrecise(const char* metric, const PreciseMeasurement& measurement);
+
+#pragma endregion
@@ -0,0 +1,217 @@
+#include <gtest/gtest.h>
+
+#include <khook.hpp>
+#include <string>
+
+#include "bench.hpp"
+#include "builder.hpp"
+#include "hooks.hpp"
+#include "main.hpp"
+
+class HookBuilderTest: public ::testing::TestWithParam<HookKind> {
+  protected:
+    class TestObject {
+      public:
+        int m_testValue;
+    };
+
+    class HookedClass {
+      public:
+        NOINLINE static int SetObjectValue(TestObject* obj, int value) {
+            obj->m_testValue = value;
+            return value;
+        }
+    };
+
+    class VirtualHookedClass {
+      public:
+        virtual int SetObjectValue(TestObject* obj, int value) {
+            obj->m_testValue = value;
+            return value;
+        }
+    };
+
+    using SetObjectValueNoopHook =
+        NoopStaticHookTemplate<int, TestObject*, int>;
+    using VirtualSetObjectValueNoopHook =
+        NoopMemberHookTemplate<int, TestObject*, int>;
+
+    static void CountPre(TestObject* obj, int value) {
+        s_preCalls++;
+    }
+
+    static void CountPost(TestObject* obj, int value) {
+        s_postCalls++;
+    }
+
+    static void
+    CountPreMember(VirtualHookedClass* self, TestObject* obj, int value) {
+        s_preCalls += self == s_target ? 1 : 0;
+    }
+
+    static void
+    CountPostMember(VirtualHookedClass* self, TestObject* obj, int value) {
+        s_postCalls += self == s_target ? 1 : 0;
+    }
+
+    static HookResult<int> OverridePre(TestObject* obj, int value) {
+        return {KHook::Action::Override, value * 2};
+    }
+
+    static HookResult<int>
+    OverridePreMember(VirtualHookedClass* self, TestObject* obj, int value) {
+        return {KHook::Action::Override, value * 2};
+    }
+
+    void SetUp() override {
+        s_target = new VirtualHookedClass();
+        s_preCalls = 0;
+        s_postCalls = 0;
+    }
+
+    void TearDown() override {
+        delete s_target;
+        s_target = nullptr;
+    }
+
+    bool IsStatic() const {
+        return GetParam() == HookKind::Static;
+    }
+
+    HookHandle MakeCountingHook() {
+        if (IsStatic()) {
+            return MakeHook<
+                &HookedClass::SetObjectValue,
+                &CountPre,
+                &CountPost>();
+        }
+        return MakeHook<
+            &VirtualHookedClass::SetObjectValue,
+            &CountPreMember,
+            &CountPostMember>(s_target);
+    }
+
+    HookHandle MakeOverrideHook() {
+        if (IsStatic()) {
+            return MakeHook<&HookedClass::SetObjectValue, &OverridePre>();
+        }
+        return MakeHook<
+            &VirtualHookedClass::SetObjectValue,
+            &OverridePreMember>(s_target);
+    }
+
+    HookHandle MakeEmptyHook() {
+        if (IsStatic()) {
+            return MakeHook<&HookedClass::SetObjectValue>();
+        }
+        return MakeHook<&VirtualHookedClass::SetObjectValue>(s_target);
+    }
+
+    HookHandle MakeNoopTemplateHook() {
+        if (IsStatic()) {
+            return HookHandle::SetupHook(
+                (void*)&HookedClass::SetObjectValue,
+                nullptr,
+                (void*)&SetObjectValueNoopHook::OnRemoved,
+                (void*)&SetObjectValueNoopHook::PrePostNoop,
+                (void*)&SetObjectValueNoopHook::PrePostNoop,
+                (void*)&SetObjectValueNoopHook::MakeReturn,
+                (void*)&SetObjectValueNoopHook::CallOriginal,
+                false
+            );
+        }
+        return HookHandle::SetupVirtualHook(
+            *(void***)(s_target),
+            KHook::GetVtableIndex(&VirtualHookedClass::SetObjectValue),
+            nullptr,
+            KHook::ExtractMFP(&VirtualSetObjectValueNoopHook::OnRemoved),
+            KHook::ExtractMFP(&VirtualSetObjectValueNoopHook::PrePostNoop),
+            KHook::ExtractMFP(&VirtualSetObjectValueNoopHook::PrePostNoop),
+            KHook::ExtractMFP(&VirtualSetObjectValueNoopHook::MakeReturn),
+            KHook::ExtractMFP(&VirtualSetObjectValueNoopHook::CallOriginal),
+            false
+        );
+    }
+
+    int Call(TestObject* obj, int value) {
+        if (IsStatic()) {
+            return HookedClass::SetObjectValue(obj, value);
+        }
+        return s_target->SetObjectValue(obj, value);
+    }
+
+    static inline VirtualHookedClass* s_target = nullptr;
+    static inline int s_preCalls = 0;
+    static inline int s_postCalls = 0;
+
+    ScopedCallbackLogging m_quiet {false};
+};
+
+TEST_P(HookBuilderTest, ObserversSeeEveryCall) {
+    HookHandle hook = MakeCountingHook();
+    ASSERT_TRUE(hook.Valid()) << "Hook setup should succeed";
+
+    const int calls = 5;
+    for (int i = 0; i < calls; i++) {
+        TestObject obj {};
+        EXPECT_EQ(Call(&obj, i + 1), i + 1)
+            << "Observed call should return the original value";
+        EXPECT_EQ(obj.m_testValue, i + 1) << "Original should still run";
+    }
+    EXPECT_EQ(s_preCalls, calls) << "Pre callback should run once per call";
+    EXPECT_EQ(s_postCalls, calls) << "Post callback should run once per call";
+
+    hook.Remove();
+    TestObject obj {};
+    Call(&obj, 1);
+    EXPECT_EQ(s_preCalls, calls) << "Callbacks should stop after removal";
+}
+
+TEST_P(HookBuilderTest, PreOverridesReturnValue) {
+    HookHandle hook = MakeOverrideHook();
+    ASSERT_TRUE(hook.Valid()) << "Hook setup should succeed";
+
+    TestObject obj {};
+    EXPECT_EQ(Call(&obj, 21), 42) << "Override should replace the result";
+    EXPECT_EQ(obj.m_testValue, 21) << "Override should still call original";
+
+    hook.Remove();
+    EXPECT_EQ(Call(&obj, 21), 21)
+        << "Method should return the original value after hook removal";
+}
+
+TEST_P(HookBuilderTest, BenchmarkAgainstNoopTemplates) {
+    BENCHMARK_ONLY();
+
+    std::size_t iterations = BenchIterations(1000000);
+    std::uint64_t badCalls = 0;
+    auto call = [&](std::size_t i) {
+        TestObject obj {};
+        int value = (int)(i & 0xFFFF);
+        badCalls += Call(&obj, value) == value ? 0 : 1;
+    };
+
+    ReportPrecise("direct", MeasurePrecise(iterations, call));
+
+    // Both make the same KHook calls per call, what sets them apart is the
+    // Noop templates' logging and trace checks.
+
+    auto measure = [&](const char* name, HookHandle hook) {
+        ASSERT_TRUE(hook.Valid()) << name << " hook setup should succeed";
+        ReportPrecise(name, MeasurePrecise(iterations, call));
+    };
+    measure("noop_template_with_log_checks", MakeNoopTemplateHook());
+    measure("builder_without_log_checks", MakeEmptyHook());
+    measure("builder_counting_observers", MakeCountingHook());
+
+    EXPECT_EQ(badCalls, 0u) << "Hooked calls should return the original value";
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Hooks,
+    HookBuilderTest,
+    ::testing::Values(HookKind::Static, HookKind::Virtual),
+    [](const ::testing::TestParamInfo<HookKind>& info) {
+        return std::string(HookKindName(info.param));
+    }
+);
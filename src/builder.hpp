@@ -0,0 +1,248 @@
+#pragma once
+
+#include <khook.hpp>
+#include <type_traits>
+
+#include "hooks.hpp"
+#include "main.hpp"
+
+// What a pre or post callback passed to MakeHook decided. Callbacks that
+// return void only observe the call, the same as returning Ignore.
+template<typename Ret>
+struct HookResult {
+    KHook::Action action = KHook::Action::Ignore;
+    Ret value {};
+};
+
+template<>
+struct HookResult<void> {
+    KHook::Action action = KHook::Action::Ignore;
+};
+
+#pragma region BuiltCallbacks
+
+inline void SaveIgnoreResult(bool original) {
+    KHook::SaveReturnValue(
+        KHook::Action::Ignore,
+        nullptr,
+        0,
+        nullptr,
+        nullptr,
+        original
+    );
+}
+
+// Runs a pre or post callback, or nothing if it is nullptr, and hands its
+// decision to KHook. An ignored result makes the same value-less
+// SaveReturnValue call as PrePostNoop.
+template<typename Ret, auto Callback, typename... Args>
+inline Ret RunBuiltCallback(Args... args) {
+    if constexpr (std::is_null_pointer<decltype(Callback)>::value) {
+        SaveIgnoreResult(false);
+        if constexpr (!std::is_void<Ret>::value) {
+            return Ret();
+        }
+    } else {
+        using Result = decltype(Callback(args...));
+        static_assert(
+            std::is_void<Result>::value
+                || std::is_same<Result, HookResult<Ret>>::value,
+            "Hook callbacks return void or the HookResult of the target"
+        );
+
+        if constexpr (std::is_void<Result>::value) {
+            Callback(args...);
+            SaveIgnoreResult(false);
+            if constexpr (!std::is_void<Ret>::value) {
+                return Ret();
+            }
+        } else if constexpr (std::is_void<Ret>::value) {
+            Result result = Callback(args...);
+            KHook::SaveReturnValue(
+                result.action,
+                nullptr,
+                0,
+                nullptr,
+                nullptr,
+                false
+            );
+        } else {
+            Result result = Callback(args...);
+            if (result.action == KHook::Action::Ignore) {
+                SaveIgnoreResult(false);
+            } else {
+                KHook::SaveReturnValue(
+                    result.action,
+                    &result.value,
+                    sizeof(Ret),
+                    (void*)KHook::init_operator<Ret>,
+                    (void*)KHook::deinit_operator<Ret>,
+                    false
+                );
+            }
+            return result.value;
+        }
+    }
+}
+
+// The caller gets what MakeReturn returns, the original's value reaches it only
+// through KHook, and another hook on the same target may have overridden it.
+// So even when neither callback can return a HookResult, the value is saved,
+// read back and destroyed exactly as the Noop templates do.
+template<typename Ret, typename Original, typename... Args>
+inline Ret CallBuiltOriginal(Original original, Args... args) {
+    if constexpr (std::is_void<Ret>::value) {
+        original(args...);
+        SaveIgnoreResult(true);
+    } else {
+        Ret result = original(args...);
+        KHook::SaveReturnValue(
+            KHook::Action::Ignore,
+            &result,
+            sizeof(Ret),
+            (void*)KHook::init_operator<Ret>,
+            (void*)KHook::deinit_operator<Ret>,
+            true
+        );
+        return result;
+    }
+}
+
+template<typename Ret>
+inline Ret MakeBuiltReturn() {
+    if constexpr (std::is_void<Ret>::value) {
+        KHook::DestroyReturnValue();
+    } else {
+        Ret result = *((Ret*)KHook::GetCurrentValuePtr(true));
+        KHook::DestroyReturnValue();
+        return result;
+    }
+}
+
+#pragma endregion
+
+#pragma region BuiltHook
+
+// The callbacks MakeHook hands to KHook, specialized on the type of the
+// target. They make exactly the KHook calls the Noop templates make, the
+// builder cannot cut any of them, only the logging and tracing are gone.
+template<auto Target, auto Pre, auto Post, typename = decltype(Target)>
+class BuiltHook;
+
+template<auto Target, auto Pre, auto Post, typename Ret, typename... Args>
+class BuiltHook<Target, Pre, Post, Ret (*)(Args...)> {
+  public:
+    static HookHandle Setup() {
+        return HookHandle::SetupHook(
+            (void*)Target,
+            nullptr,
+            (void*)&OnRemoved,
+            (void*)&PreCallback,
+            (void*)&PostCallback,
+            (void*)&MakeReturn,
+            (void*)&CallOriginal,
+            false
+        );
+    }
+
+  private:
+    static NOINLINE Ret PreCallback(Args... args) {
+        return RunBuiltCallback<Ret, Pre>(args...);
+    }
+
+    static NOINLINE Ret PostCallback(Args... args) {
+        return RunBuiltCallback<Ret, Post>(args...);
+    }
+
+    static NOINLINE Ret CallOriginal(Args... args) {
+        return CallBuiltOriginal<Ret>(
+            reinterpret_cast<Ret (*)(Args...)>(KHook::GetOriginalFunction()),
+            args...
+        );
+    }
+
+    static NOINLINE Ret MakeReturn(Args... args) {
+        return MakeBuiltReturn<Ret>();
+    }
+
+    static NOINLINE void OnRemoved(int hookId) {
+        g_hookRegistry.NotifyRemoved(hookId);
+    }
+};
+
+// Callbacks of member hooks get the hooked object as their first argument.
+template<
+    auto Target,
+    auto Pre,
+    auto Post,
+    typename Class,
+    typename Ret,
+    typename... Args>
+class BuiltHook<Target, Pre, Post, Ret (Class::*)(Args...)> {
+  public:
+    static HookHandle Setup(Class* instance) {
+        return HookHandle::SetupVirtualHook(
+            *(void***)(instance),
+            KHook::GetVtableIndex(Target),
+            nullptr,
+            KHook::ExtractMFP(&Thunk::OnRemoved),
+            KHook::ExtractMFP(&Thunk::PreCallback),
+            KHook::ExtractMFP(&Thunk::PostCallback),
+            KHook::ExtractMFP(&Thunk::MakeReturn),
+            KHook::ExtractMFP(&Thunk::CallOriginal),
+            false
+        );
+    }
+
+  private:
+    // KHook calls these with the hooked object as `this`.
+    class Thunk {
+      public:
+        NOINLINE Ret PreCallback(Args... args) {
+            return RunBuiltCallback<Ret, Pre>(Self(), args...);
+        }
+
+        NOINLINE Ret PostCallback(Args... args) {
+            return RunBuiltCallback<Ret, Post>(Self(), args...);
+        }
+
+        NOINLINE Ret CallOriginal(Args... args) {
+            auto original = reinterpret_cast<Ret(__thiscall*)(void*, Args...)>(
+                KHook::GetOriginalFunction()
+            );
+            return CallBuiltOriginal<Ret>(original, (void*)this, args...);
+        }
+
+        NOINLINE Ret MakeReturn(Args... args) {
+            return MakeBuiltReturn<Ret>();
+        }
+
+        NOINLINE void OnRemoved(int hookId) {
+            g_hookRegistry.NotifyRemoved(hookId);
+        }
+
+      private:
+        Class* Self() {
+            return reinterpret_cast<Class*>(this);
+        }
+    };
+};
+
+// Hooks a static function, or a virtual function on the vtable of
+// `instance`, with callbacks generated from the target's signature:
+//
+//   MakeHook<&HookedClass::SetObjectValue, &Pre>();
+//   MakeHook<&VirtualHookedClass::SetObjectValue, &Pre, &Post>(instance);
+//
+// Callbacks take the target's arguments, preceded by the object for member
+// targets, and return void or a HookResult. A nullptr callback does nothing.
+template<
+    auto Target,
+    auto Pre = nullptr,
+    auto Post = nullptr,
+    typename... Instance>
+inline HookHandle MakeHook(Instance*... instance) {
+    return BuiltHook<Target, Pre, Post>::Setup(instance...);
+}
+
+#pragma endregion
@@ -0,0 +1,211 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <khook.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.hpp"
+#include "main.hpp"
+
+class HookChurnBenchmark: public ::testing::TestWithParam<HookKind> {
+  protected:
+    class TestObject {
+      public:
+        int m_testValue;
+    };
+
+    class HookedClass {
+      public:
+        NOINLINE static int SetObjectValue(TestObject* obj, int value) {
+            obj->m_testValue = value;
+            return value;
+        }
+    };
+
+    class VirtualHookedClass {
+      public:
+        virtual int SetObjectValue(TestObject* obj, int value) {
+            obj->m_testValue = value;
+            return value;
+        }
+    };
+
+    using SetObjectValueNoopHook = NoopStaticHookTemplate<int, TestObject*, int>;
+    using VirtualSetObjectValueNoopHook =
+        NoopMemberHookTemplate<int, TestObject*, int>;
+
+    struct CallerResult {
+        LatencyHistogram latencies;
+        std::uint64_t errors = 0;
+    };
+
+  protected:
+    void SetUp() override {
+        target = new VirtualHookedClass();
+    }
+
+    void TearDown() override {
+        if (target) {
+            delete target;
+            target = nullptr;
+        }
+    }
+
+    int Install() {
+        if (GetParam() == HookKind::Static) {
+            return KHook::SetupHook(
+                (void*)&HookedClass::SetObjectValue,
+                nullptr,
+                (void*)&SetObjectValueNoopHook::OnRemoved,
+                (void*)&SetObjectValueNoopHook::PrePostNoop,
+                (void*)&SetObjectValueNoopHook::PrePostNoop,
+                (void*)&SetObjectValueNoopHook::MakeReturn,
+                (void*)&SetObjectValueNoopHook::CallOriginal,
+                false
+            );
+        }
+        return KHook::SetupVirtualHook(
+            *(void***)(target),
+            KHook::GetVtableIndex(&VirtualHookedClass::SetObjectValue),
+            nullptr,
+            KHook::ExtractMFP(&VirtualSetObjectValueNoopHook::OnRemoved),
+            KHook::ExtractMFP(&VirtualSetObjectValueNoopHook::PrePostNoop),
+            KHook::ExtractMFP(&VirtualSetObjectValueNoopHook::PrePostNoop),
+            KHook::ExtractMFP(&VirtualSetObjectValueNoopHook::MakeReturn),
+            KHook::ExtractMFP(&VirtualSetObjectValueNoopHook::CallOriginal),
+            false
+        );
+    }
+
+    int Call(TestObject* obj, int value) {
+        if (GetParam() == HookKind::Static) {
+            return HookedClass::SetObjectValue(obj, value);
+        }
+        return target->SetObjectValue(obj, value);
+    }
+
+    ScopedCallbackLogging m_quiet {false};
+    VirtualHookedClass* target = nullptr;
+};
+
+TEST_P(HookChurnBenchmark, CallerLatencyUnderChurn) {
+    BENCHMARK_ONLY();
+
+    int baseHookId = Install();
+    ASSERT_NE(baseHookId, KHook::INVALID_HOOK) << "Hook setup should succeed";
+
+    unsigned int threads = BenchThreads();
+    unsigned int cpus = std::max(1u, std::thread::hardware_concurrency());
+    ReportMetric("caller_threads", threads, "threads");
+    BenchNsPerTick();
+
+    for (int rate : g_options.churnRates) {
+        std::atomic<bool> running {true};
+        std::vector<CallerResult> results(threads);
+        std::vector<std::thread> callers;
+
+        for (unsigned int t = 0; t < threads; t++) {
+            callers.emplace_back([&, t]() {
+                ScopedCpuPin pin((int)(t % cpus));
+                TestObject obj {};
+                CallerResult& result = results[t];
+                int value = 0;
+                while (running.load(std::memory_order_relaxed)) {
+                    value = (value + 1) & 0xFFFF;
+                    std::uint64_t start = BenchTicksBegin();
+                    int returned = Call(&obj, value);
+                    result.latencies.Record(BenchElapsedNs(start));
+                    if (returned != value || obj.m_testValue != value) {
+                        result.errors++;
+                    }
+                }
+            });
+        }
+
+        LatencyHistogram install;
+        LatencyHistogram remove;
+        std::uint64_t failedInstalls = 0;
+        std::int64_t end = GetWallTimeNs() + BenchDurationNs(1000);
+
+        if (rate > 0) {
+            std::int64_t period = 1000000000 / rate;
+            std::int64_t next = GetWallTimeNs();
+            while (GetWallTimeNs() < end) {
+                std::int64_t start = GetWallTimeNs();
+                int hookId = Install();
+                install.Record(GetWallTimeNs() - start);
+
+                if (hookId == KHook::INVALID_HOOK) {
+                    failedInstalls++;
+                } else {
+                    start = GetWallTimeNs();
+                    KHook::RemoveHook(hookId, false);
+                    remove.Record(GetWallTimeNs() - start);
+                }
+
+                next += period;
+                std::int64_t wait = next - GetWallTimeNs();
+                if (wait > 0) {
+                    std::this_thread::sleep_for(std::chrono::nanoseconds(wait));
+                }
+            }
+        } else {
+            std::this_thread::sleep_for(
+                std::chrono::nanoseconds(end - GetWallTimeNs())
+            );
+        }
+
+        running = false;
+        for (std::thread& caller : callers) {
+            caller.join();
+        }
+
+        LatencyHistogram calls;
+        std::uint64_t errors = 0;
+        for (const CallerResult& result : results) {
+            calls.Merge(result.latencies);
+            errors += result.errors;
+        }
+
+        std::string name = "churn_" + std::to_string(rate);
+        ReportLatencies((name + ".call").c_str(), calls.Summarize());
+        ReportMetric(
+            (name + ".stalls_over_10us").c_str(),
+            (double)calls.CountAbove(10000),
+            "calls"
+        );
+        ReportMetric(
+            (name + ".stalls_over_1ms").c_str(),
+            (double)calls.CountAbove(1000000),
+            "calls"
+        );
+        if (rate > 0) {
+            ReportMetric(
+                (name + ".churn_cycles").c_str(),
+                (double)install.Count(),
+                "cycles"
+            );
+            ReportLatencies((name + ".install").c_str(), install.Summarize());
+            ReportLatencies((name + ".remove").c_str(), remove.Summarize());
+        }
+
+        EXPECT_EQ(errors, 0u)
+            << "Hooked calls should return the original value during churn";
+        EXPECT_EQ(failedInstalls, 0u) << "Hook setup should succeed";
+    }
+
+    KHook::RemoveHook(baseHookId, false);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Hooks,
+    HookChurnBenchmark,
+    ::testing::Values(HookKind::Static, HookKind::Virtual),
+    [](const ::testing::TestParamInfo<HookKind>& info) {
+        return std::string(HookKindName(info.param));
+    }
+);
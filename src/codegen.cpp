@@ -0,0 +1,243 @@
+#include "codegen.hpp"
+
+#include <cstring>
+#include <initializer_list>
+
+#include "resources.hpp"
+
+#if defined(_WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <sys/mman.h>
+#endif
+
+// Every copy keeps a frame pointer prologue so that it is long enough to be
+// patched with any jump KHook may want to use.
+static std::size_t EmitSetObjectValue(std::uint8_t* code, std::uint32_t index) {
+    std::size_t length = 0;
+    auto emit = [&](std::initializer_list<std::uint8_t> bytes) {
+        for (std::uint8_t byte : bytes) {
+            code[length++] = byte;
+        }
+    };
+    auto emitImm32 = [&](std::uint32_t value) {
+        memcpy(code + length, &value, sizeof(value));
+        length += sizeof(value);
+    };
+
+#if defined(__x86_64__) || defined(_M_X64)
+    emit({0x55});             // push rbp
+    emit({0x48, 0x89, 0xE5}); // mov rbp, rsp
+    #if defined(_WIN32)
+    emit({0x89, 0x11});       // mov [rcx], edx
+    emit({0xC7, 0x41, 0x04}); // mov dword [rcx+4], imm32
+    emitImm32(index);
+    emit({0x89, 0xD0});       // mov eax, edx
+    #else
+    emit({0x89, 0x37});       // mov [rdi], esi
+    emit({0xC7, 0x47, 0x04}); // mov dword [rdi+4], imm32
+    emitImm32(index);
+    emit({0x89, 0xF0});       // mov eax, esi
+    #endif
+    emit({0x5D});             // pop rbp
+    emit({0xC3});             // ret
+#else
+    emit({0x55});             // push ebp
+    emit({0x89, 0xE5});       // mov ebp, esp
+    emit({0x8B, 0x45, 0x08}); // mov eax, [ebp+8]
+    emit({0x8B, 0x4D, 0x0C}); // mov ecx, [ebp+12]
+    emit({0x89, 0x08});       // mov [eax], ecx
+    emit({0xC7, 0x40, 0x04}); // mov dword [eax+4], imm32
+    emitImm32(index);
+    emit({0x89, 0xC8});       // mov eax, ecx
+    emit({0x5D});             // pop ebp
+    emit({0xC3});             // ret
+#endif
+
+    while (length < CodeBuffer::kFunctionStride) {
+        code[length++] = 0xCC; // int3
+    }
+    return length;
+}
+
+CodeBuffer::CodeBuffer(std::size_t functions, const void* hint) :
+    m_count(functions) {
+    if (!Map(functions * kFunctionStride, hint)) {
+        return;
+    }
+
+    Emit();
+}
+
+CodeBuffer::CodeBuffer(
+    std::size_t functions,
+    std::size_t stride,
+    bool hugePages
+) :
+    m_count(functions),
+    m_stride(stride) {
+    std::size_t bytes = functions * stride;
+    bool mapped = hugePages ? MapHugePages(bytes) : Map(bytes, nullptr);
+    if (!mapped) {
+        return;
+    }
+
+    memset(m_memory, 0xCC, m_size);
+    Emit();
+}
+
+void CodeBuffer::Emit() {
+    std::uint8_t* code = static_cast<std::uint8_t*>(m_memory);
+    for (std::size_t i = 0; i < m_count; i++) {
+        EmitSetObjectValue(code + i * m_stride, (std::uint32_t)i);
+    }
+    Seal();
+}
+
+CodeBuffer::CodeBuffer(const std::vector<std::uint8_t>& code, const void* hint) {
+    if (!Map(code.size(), hint)) {
+        return;
+    }
+    memcpy(m_memory, code.data(), code.size());
+    Seal();
+}
+
+bool CodeBuffer::Map(std::size_t bytes, const void* hint) {
+    std::size_t pageSize = GetPageSize();
+    m_size = (bytes + pageSize - 1) / pageSize * pageSize;
+    if (m_size == 0) {
+        return false;
+    }
+
+#if defined(_WIN32)
+    m_memory = VirtualAlloc(
+        const_cast<void*>(hint),
+        m_size,
+        MEM_RESERVE | MEM_COMMIT,
+        PAGE_READWRITE
+    );
+    if (!m_memory && hint) {
+        m_memory = VirtualAlloc(
+            nullptr,
+            m_size,
+            MEM_RESERVE | MEM_COMMIT,
+            PAGE_READWRITE
+        );
+    }
+#else
+    m_memory = mmap(
+        const_cast<void*>(hint),
+        m_size,
+        PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS,
+        -1,
+        0
+    );
+    if (m_memory == MAP_FAILED) {
+        m_memory = nullptr;
+    }
+#endif
+    return m_memory != nullptr;
+}
+
+// Transparent huge pages only back anonymous memory that is aligned to them,
+// so this maps a huge page more than needed and trims both ends. Windows
+// large pages need a privilege tests don't have, the mapping stays small.
+bool CodeBuffer::MapHugePages(std::size_t bytes) {
+#if defined(__linux__)
+    m_size = (bytes + kHugePageSize - 1) / kHugePageSize * kHugePageSize;
+    if (m_size == 0) {
+        return false;
+    }
+
+    std::size_t reserved = m_size + kHugePageSize;
+    void* memory = mmap(
+        nullptr,
+        reserved,
+        PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS,
+        -1,
+        0
+    );
+    if (memory == MAP_FAILED) {
+        return false;
+    }
+
+    std::uintptr_t start = (std::uintptr_t)memory;
+    std::uintptr_t aligned =
+        (start + kHugePageSize - 1) & ~(std::uintptr_t)(kHugePageSize - 1);
+    if (aligned > start) {
+        munmap(memory, aligned - start);
+    }
+    std::size_t tail = reserved - (aligned - start) - m_size;
+    if (tail > 0) {
+        munmap((void*)(aligned + m_size), tail);
+    }
+
+    m_memory = (void*)aligned;
+    m_hugePages = madvise(m_memory, m_size, MADV_HUGEPAGE) == 0;
+    return true;
+#else
+    return Map(bytes, nullptr);
+#endif
+}
+
+void CodeBuffer::Seal() {
+#if defined(_WIN32)
+    DWORD oldProtect;
+    VirtualProtect(m_memory, m_size, PAGE_EXECUTE_READ, &oldProtect);
+    FlushInstructionCache(GetCurrentProcess(), m_memory, m_size);
+#else
+    mprotect(m_memory, m_size, PROT_READ | PROT_EXEC);
+#endif
+}
+
+CodeBuffer::~CodeBuffer() {
+    if (!m_memory) {
+        return;
+    }
+#if defined(_WIN32)
+    VirtualFree(m_memory, 0, MEM_RELEASE);
+#else
+    munmap(m_memory, m_size);
+#endif
+}
+
+std::uint64_t CodeBuffer::DistanceFrom(const void* address) const {
+    std::uintptr_t a = (std::uintptr_t)m_memory;
+    std::uintptr_t b = (std::uintptr_t)address;
+    return a > b ? a - b : b - a;
+}
+
+std::unique_ptr<CodeBuffer> AllocateCodeBufferAwayFrom(
+    std::size_t functions,
+    const void* from,
+    std::uint64_t distance
+) {
+    if (sizeof(void*) < 8) {
+        return nullptr;
+    }
+
+    std::uint64_t origin = (std::uint64_t)(std::uintptr_t)from;
+    std::uint64_t step = (std::uint64_t)1 << 32;
+    for (std::uint64_t offset = distance + step; offset < 64 * step;
+         offset += step) {
+        for (int direction : {1, -1}) {
+            if (direction < 0 && offset > origin) {
+                continue;
+            }
+            std::uint64_t hint = direction > 0 ? origin + offset : origin - offset;
+            hint &= ~(std::uint64_t)0xFFFF;
+
+            std::unique_ptr<CodeBuffer> buffer(
+                new CodeBuffer(functions, (const void*)(std::uintptr_t)hint)
+            );
+            if (buffer->Valid() && buffer->DistanceFrom(from) > distance) {
+                return buffer;
+            }
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "targets.hpp"
+
+// Emits copies of a small SetObjectValue-shaped function into freshly mapped
+// executable memory, for tests that need more static targets than the
+// compiled-in generated ones. Every copy stores its index in m_lastTarget.
+class CodeBuffer {
+  public:
+    static constexpr std::size_t kFunctionStride = 32;
+    static constexpr std::size_t kHugePageSize = 2 * 1024 * 1024;
+
+    // The hint is only a preference, check Base() for where the code landed.
+    explicit CodeBuffer(std::size_t functions, const void* hint = nullptr);
+
+    // Spreads the copies `stride` bytes apart, a multiple of kFunctionStride,
+    // with int3 in between. With hugePages the mapping is aligned to a huge
+    // page and advised to use them, HugePages() tells whether that worked.
+    CodeBuffer(std::size_t functions, std::size_t stride, bool hugePages);
+
+    // Maps a copy of hand-assembled code instead, Count() is zero.
+    explicit CodeBuffer(
+        const std::vector<std::uint8_t>& code,
+        const void* hint = nullptr
+    );
+    ~CodeBuffer();
+
+    CodeBuffer(const CodeBuffer&) = delete;
+    CodeBuffer& operator=(const CodeBuffer&) = delete;
+
+    bool Valid() const {
+        return m_memory != nullptr;
+    }
+
+    std::size_t Count() const {
+        return m_count;
+    }
+
+    std::size_t Size() const {
+        return m_size;
+    }
+
+    std::size_t Stride() const {
+        return m_stride;
+    }
+
+    bool HugePages() const {
+        return m_hugePages;
+    }
+
+    void* Base() const {
+        return m_memory;
+    }
+
+    GeneratedFunction Function(std::size_t index) const {
+        return reinterpret_cast<GeneratedFunction>(
+            static_cast<std::uint8_t*>(m_memory) + index * m_stride
+        );
+    }
+
+    void* At(std::size_t offset) const {
+        return static_cast<std::uint8_t*>(m_memory) + offset;
+    }
+
+    std::uint64_t DistanceFrom(const void* address) const;
+
+  private:
+    bool Map(std::size_t bytes, const void* hint);
+    bool MapHugePages(std::size_t bytes);
+    void Emit();
+    void Seal();
+
+    void* m_memory = nullptr;
+    std::size_t m_size = 0;
+    std::size_t m_count = 0;
+    std::size_t m_stride = kFunctionStride;
+    bool m_hugePages = false;
+};
+
+// Looks for free address space at least `distance` bytes away from `from`,
+// like a JIT that ends up far from the binary it was loaded by. Returns null
+// if nothing could be mapped that far away, which is always the case on x86.
+std::unique_ptr<CodeBuffer> AllocateCodeBufferAwayFrom(
+    std::size_t functions,
+    const void* from,
+    std::uint64_t distance
+);
@@ -0,0 +1,279 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <array>
+#include <khook.hpp>
+#include <memory>
+#include <vector>
+
+#include "bench.hpp"
+#include "main.hpp"
+#include "options.hpp"
+#include "targets.hpp"
+
+// Built as its own binary: the first half of the table is hooked by a global
+// constructor, before main and before anything else in the process touched
+// KHook, the way a plugin hooks everything while it is being loaded. Only the
+// registration itself runs without --bench, every test is a benchmark.
+
+#pragma region ColdHookTable
+
+enum class ColdCallbacks {
+    Noop,
+    Counting
+};
+
+struct ColdHookEntry {
+    HookKind kind = HookKind::Static;
+    // Generated function of a static hook, vtable slot of a virtual one.
+    std::size_t target = 0;
+    ColdCallbacks callbacks = ColdCallbacks::Noop;
+};
+
+constexpr std::size_t kColdTargets = 1024;
+
+// Static and virtual hooks take turns, every hook gets a target of its own so
+// that the first call through each of them goes through a cold trampoline.
+template<std::size_t Count>
+constexpr std::array<ColdHookEntry, Count> MakeColdHookTable() {
+    std::array<ColdHookEntry, Count> table {};
+    for (std::size_t i = 0; i < Count; i++) {
+        table[i].kind = (i & 1) ? HookKind::Virtual : HookKind::Static;
+        table[i].target = i / 2;
+        table[i].callbacks =
+            (i % 4) < 2 ? ColdCallbacks::Counting : ColdCallbacks::Noop;
+    }
+    return table;
+}
+
+static constexpr std::array<ColdHookEntry, 2 * kColdTargets> kColdHooks =
+    MakeColdHookTable<2 * kColdTargets>();
+
+static_assert(kColdTargets <= kGeneratedTargetCount, "Targets must be distinct");
+
+#pragma endregion
+
+#pragma region ColdRegistration
+
+struct ColdRegistration {
+    bool done = false;
+    std::int64_t totalNs = 0;
+    std::vector<std::int64_t> installNs;
+    std::size_t failed = 0;
+};
+
+static std::unique_ptr<GeneratedInstance> s_coldInstance;
+// Constant initialized, so every slot reads as not installed before the
+// registration below runs during dynamic initialization.
+template<std::size_t Count>
+constexpr std::array<int, Count> MakeInvalidHookIds() {
+    std::array<int, Count> ids {};
+    for (std::size_t i = 0; i < Count; i++) {
+        ids[i] = KHook::INVALID_HOOK;
+    }
+    return ids;
+}
+
+static std::array<int, kColdHooks.size()> s_coldHookIds =
+    MakeInvalidHookIds<kColdHooks.size()>();
+
+static int InstallColdHook(const ColdHookEntry& entry) {
+    bool counting = entry.callbacks == ColdCallbacks::Counting;
+    if (entry.kind == HookKind::Static) {
+        return KHook::SetupHook(
+            (void*)GetGeneratedFunction(entry.target),
+            nullptr,
+            (void*)&GeneratedStaticHook::OnRemoved,
+            counting ? (void*)&GeneratedCountingHook::Pre
+                     : (void*)&GeneratedStaticHook::PrePostNoop,
+            (void*)&GeneratedStaticHook::PrePostNoop,
+            (void*)&GeneratedStaticHook::MakeReturn,
+            (void*)&GeneratedStaticHook::CallOriginal,
+            false
+        );
+    }
+    return KHook::SetupVirtualHook(
+        s_coldInstance->Vtable(),
+        (int)entry.target,
+        nullptr,
+        KHook::ExtractMFP(&GeneratedMemberHook::OnRemoved),
+        counting ? KHook::ExtractMFP(&GeneratedCountingHook::PreMember)
+                 : KHook::ExtractMFP(&GeneratedMemberHook::PrePostNoop),
+        KHook::ExtractMFP(&GeneratedMemberHook::PrePostNoop),
+        KHook::ExtractMFP(&GeneratedMemberHook::MakeReturn),
+        KHook::ExtractMFP(&GeneratedMemberHook::CallOriginal),
+        false
+    );
+}
+
+static ColdRegistration RegisterColdHooks(std::size_t first, std::size_t last) {
+    ColdRegistration registration;
+    registration.installNs.reserve(last - first);
+
+    std::int64_t start = GetWallTimeNs();
+    if (!s_coldInstance) {
+        s_coldInstance.reset(new GeneratedInstance(kColdTargets));
+    }
+    for (std::size_t i = first; i < last; i++) {
+        std::int64_t installStart = GetWallTimeNs();
+        s_coldHookIds[i] = InstallColdHook(kColdHooks[i]);
+        registration.installNs.push_back(GetWallTimeNs() - installStart);
+        registration.failed += s_coldHookIds[i] == KHook::INVALID_HOOK ? 1 : 0;
+    }
+    registration.totalNs = GetWallTimeNs() - start;
+    registration.done = true;
+    return registration;
+}
+
+// The table is installed with raw KHook calls, going through the registry
+// would put its mutex into every install time. Idempotent, so the fixture and
+// main can both call it.
+static void RemoveColdHooks() {
+    for (int& hookId : s_coldHookIds) {
+        if (hookId != KHook::INVALID_HOOK) {
+            KHook::RemoveHook(hookId, false);
+            hookId = KHook::INVALID_HOOK;
+        }
+    }
+}
+
+static int CallColdTarget(const ColdHookEntry& entry, int value, bool* ok) {
+    GeneratedObject obj {};
+    int result;
+    if (entry.kind == HookKind::Static) {
+        result = GetGeneratedFunction(entry.target)(&obj, value);
+    } else {
+        result = s_coldInstance->Call(entry.target, &obj, value);
+    }
+    *ok = result == value && obj.m_testValue == value;
+    return result;
+}
+
+// Same translation unit, so s_beforeMain is initialized after everything the
+// registration above uses.
+static ColdRegistration s_afterMain;
+static ColdRegistration s_beforeMain =
+    RegisterColdHooks(0, kColdHooks.size() / 2);
+
+#pragma endregion
+
+class ColdStartBenchmark: public ::testing::Test {
+  protected:
+    static void TearDownTestSuite() {
+        RemoveColdHooks();
+    }
+
+    static void EnsureRegisteredAfterMain() {
+        if (!s_afterMain.done) {
+            s_afterMain =
+                RegisterColdHooks(kColdHooks.size() / 2, kColdHooks.size());
+        }
+    }
+
+    static void ReportRegistration(const ColdRegistration& registration) {
+        std::vector<std::int64_t> installs = registration.installNs;
+        ReportMetric("hooks", (double)installs.size(), "hooks");
+        ReportMetric("total", (double)registration.totalNs / 1e6, "ms");
+        ReportLatencies("install", SummarizeLatencies(installs));
+    }
+
+    ScopedCallbackLogging m_quiet {false};
+};
+
+TEST_F(ColdStartBenchmark, RegistrationBeforeMain) {
+    BENCHMARK_ONLY();
+
+    ASSERT_TRUE(s_beforeMain.done) << "Hooks should be registered before main";
+    ASSERT_FALSE(s_beforeMain.installNs.empty());
+    ReportRegistration(s_beforeMain);
+
+    // The very first install pays for KHook's own setup, later installs show
+    // what a regular one costs.
+    std::vector<std::int64_t> later(
+        s_beforeMain.installNs.begin() + 1,
+        s_beforeMain.installNs.end()
+    );
+    LatencySummary regular = SummarizeLatencies(later);
+    double first = (double)s_beforeMain.installNs.front();
+    ReportMetric("first_install", first, "ns");
+    ReportMetric("khook_first_use", std::max(first - regular.p50, 0.0), "ns");
+
+    EXPECT_EQ(s_beforeMain.failed, 0u) << "Hook setup should succeed";
+}
+
+TEST_F(ColdStartBenchmark, RegistrationAfterMain) {
+    BENCHMARK_ONLY();
+
+    EnsureRegisteredAfterMain();
+    ReportRegistration(s_afterMain);
+    ReportMetric(
+        "total_with_before_main",
+        (double)(s_beforeMain.totalNs + s_afterMain.totalNs) / 1e6,
+        "ms"
+    );
+
+    EXPECT_EQ(s_afterMain.failed, 0u) << "Hook setup should succeed";
+}
+
+TEST_F(ColdStartBenchmark, FirstHookedCall) {
+    BENCHMARK_ONLY();
+
+    EnsureRegisteredAfterMain();
+    ASSERT_EQ(s_beforeMain.failed + s_afterMain.failed, 0u)
+        << "Every hook of the table should be installed";
+
+    std::size_t counting = 0;
+    for (const ColdHookEntry& entry : kColdHooks) {
+        counting += entry.callbacks == ColdCallbacks::Counting ? 1 : 0;
+    }
+    std::uint64_t countedBefore = GeneratedCountingHook::s_calls.load();
+
+    // Every target is called exactly twice, the first call runs through a
+    // trampoline that no one has executed yet.
+    std::vector<std::int64_t> cold(kColdHooks.size());
+    std::vector<std::int64_t> warm(kColdHooks.size());
+    std::uint64_t badCalls = 0;
+    for (std::vector<std::int64_t>* samples : {&cold, &warm}) {
+        for (std::size_t i = 0; i < kColdHooks.size(); i++) {
+            bool ok = false;
+            std::int64_t start = GetWallTimeNs();
+            DoNotOptimize(CallColdTarget(kColdHooks[i], (int)i + 1, &ok));
+            (*samples)[i] = GetWallTimeNs() - start;
+            badCalls += ok ? 0 : 1;
+        }
+    }
+
+    ReportMetric("first_call_in_process", (double)cold.front(), "ns");
+    LatencySummary coldSummary = SummarizeLatencies(cold);
+    LatencySummary warmSummary = SummarizeLatencies(warm);
+    ReportLatencies("cold_call", coldSummary);
+    ReportLatencies("warm_call", warmSummary);
+    ReportMetric("cold_penalty.p50", coldSummary.p50 - warmSummary.p50, "ns");
+
+    EXPECT_EQ(badCalls, 0u) << "Hooked calls should keep the original value";
+    EXPECT_EQ(GeneratedCountingHook::s_calls.load() - countedBefore, 2 * counting)
+        << "Counting hooks should run on their first call already";
+
+    std::int64_t start = GetWallTimeNs();
+    RemoveColdHooks();
+    ReportMetric("remove_all", (double)(GetWallTimeNs() - start) / 1e6, "ms");
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    if (!ParseTestRunnerOptions(argc, argv)) {
+        return 1;
+    }
+
+    OpenBenchReport();
+
+    int result = RUN_ALL_TESTS();
+
+    // The suite is not set up when filtered out, the hooks registered before
+    // main are still there then.
+    RemoveColdHooks();
+    s_coldInstance.reset();
+    KHook::Shutdown();
+
+    return result;
+}
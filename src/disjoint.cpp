@@ -0,0 +1,211 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <khook.hpp>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.hpp"
+#include "hooks.hpp"
+#include "main.hpp"
+#include "resources.hpp"
+#include "targets.hpp"
+
+// Every thread calls its own hooked function, or its own hooked slot of the
+// vtable, so nothing is shared between the threads but KHook itself. Any
+// drop in per-thread throughput as threads are added is KHook state that
+// bounces between cores.
+class DisjointTargetScalingBenchmark:
+    public ::testing::TestWithParam<HookKind> {
+  protected:
+    struct alignas(64) WorkerResult {
+        std::int64_t elapsedNs = 0;
+        std::uint64_t badCalls = 0;
+        std::uint64_t dataCacheMisses = 0;
+        std::uint64_t hitm = 0;
+    };
+
+    struct RunCost {
+        // Mean over the threads, in million calls per second.
+        double perThread = 0.0;
+        double dataCacheMissesPerCall = 0.0;
+        double hitmPerCall = 0.0;
+        std::uint64_t badCalls = 0;
+    };
+
+    void SetUp() override {
+        instance.reset(new GeneratedInstance(BenchThreads()));
+    }
+
+    void TearDown() override {
+        m_hooks.clear();
+        instance.reset();
+    }
+
+    HookHandle Install(std::size_t target) {
+        if (GetParam() == HookKind::Static) {
+            return HookHandle::SetupHook(
+                (void*)GetGeneratedFunction(target),
+                nullptr,
+                (void*)&GeneratedStaticHook::OnRemoved,
+                (void*)&GeneratedStaticHook::PrePostNoop,
+                (void*)&GeneratedStaticHook::PrePostNoop,
+                (void*)&GeneratedStaticHook::MakeReturn,
+                (void*)&GeneratedStaticHook::CallOriginal,
+                false
+            );
+        }
+        return HookHandle::SetupVirtualHook(
+            instance->Vtable(),
+            (int)target,
+            nullptr,
+            KHook::ExtractMFP(&GeneratedMemberHook::OnRemoved),
+            KHook::ExtractMFP(&GeneratedMemberHook::PrePostNoop),
+            KHook::ExtractMFP(&GeneratedMemberHook::PrePostNoop),
+            KHook::ExtractMFP(&GeneratedMemberHook::MakeReturn),
+            KHook::ExtractMFP(&GeneratedMemberHook::CallOriginal),
+            false
+        );
+    }
+
+    int Call(std::size_t target, GeneratedObject* obj, int value) {
+        if (GetParam() == HookKind::Static) {
+            return GetGeneratedFunction(target)(obj, value);
+        }
+        return instance->Call(target, obj, value);
+    }
+
+    RunCost Run(std::size_t threads, std::size_t calls) {
+        unsigned int cpus = std::max(1u, std::thread::hardware_concurrency());
+        std::vector<WorkerResult> results(threads);
+        std::atomic<std::size_t> ready {0};
+        std::atomic<bool> go {false};
+
+        std::vector<std::thread> workers;
+        for (std::size_t t = 0; t < threads; t++) {
+            workers.emplace_back([&, t]() {
+                ScopedCpuPin pin((int)(t % cpus));
+                PerfCounter dataCache(PerfCounter::Event::DataCacheMisses);
+                PerfCounter hitm(g_options.perfHitmEvent);
+                WorkerResult& result = results[t];
+                GeneratedObject obj {};
+
+                ready++;
+                while (!go.load(std::memory_order_acquire)) {
+                }
+
+                dataCache.Start();
+                hitm.Start();
+                std::int64_t start = GetWallTimeNs();
+                for (std::size_t i = 0; i < calls; i++) {
+                    int value = (int)(i & 0xFFFF);
+                    int returned = Call(t, &obj, value);
+                    result.badCalls += returned == value
+                            && obj.m_lastTarget == (int)instance->TargetOf(t)
+                        ? 0
+                        : 1;
+                }
+                result.elapsedNs = GetWallTimeNs() - start;
+                result.hitm = hitm.Stop();
+                result.dataCacheMisses = dataCache.Stop();
+            });
+        }
+        while (ready.load() < threads) {
+            std::this_thread::yield();
+        }
+        go = true;
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+
+        RunCost cost;
+        double totalCalls = (double)(calls * threads);
+        for (const WorkerResult& result : results) {
+            cost.perThread += (double)calls * 1e3 / (double)result.elapsedNs;
+            cost.dataCacheMissesPerCall +=
+                (double)result.dataCacheMisses / totalCalls;
+            cost.hitmPerCall += (double)result.hitm / totalCalls;
+            cost.badCalls += result.badCalls;
+        }
+        cost.perThread /= (double)threads;
+        return cost;
+    }
+
+    ScopedCallbackLogging m_quiet {false};
+    std::unique_ptr<GeneratedInstance> instance;
+    std::vector<HookHandle> m_hooks;
+};
+
+TEST_P(DisjointTargetScalingBenchmark, PerThreadThroughput) {
+    BENCHMARK_ONLY();
+
+    std::size_t maxThreads = BenchThreads();
+    std::size_t calls = BenchIterations(2000000);
+    PerfCounter dataCacheProbe(PerfCounter::Event::DataCacheMisses);
+    PerfCounter hitmProbe(g_options.perfHitmEvent);
+    ReportMetric(
+        "perf_counters",
+        dataCacheProbe.Valid() ? 1.0 : 0.0,
+        "available"
+    );
+
+    std::vector<std::size_t> counts;
+    for (std::size_t threads = 1; threads < maxThreads; threads *= 2) {
+        counts.push_back(threads);
+    }
+    counts.push_back(maxThreads);
+
+    double singleThread = 0.0;
+    std::uint64_t badCalls = 0;
+    for (std::size_t threads : counts) {
+        RunCost unhooked = Run(threads, calls);
+        for (std::size_t t = 0; t < threads; t++) {
+            m_hooks.push_back(Install(t));
+            ASSERT_TRUE(m_hooks.back().Valid()) << "Hook setup should succeed";
+        }
+        RunCost hooked = Run(threads, calls);
+        m_hooks.clear();
+        badCalls += unhooked.badCalls + hooked.badCalls;
+        if (threads == 1) {
+            singleThread = hooked.perThread;
+        }
+
+        std::string prefix = "threads_" + std::to_string(threads);
+        auto report = [&](const char* metric, double value, const char* unit) {
+            ReportMetric((prefix + "." + metric).c_str(), value, unit);
+        };
+        report("unhooked_per_thread", unhooked.perThread, "Mcalls/s");
+        report("hooked_per_thread", hooked.perThread, "Mcalls/s");
+        report("hooked_relative", hooked.perThread / unhooked.perThread, "x");
+        // Stays at one without contention, hooked_relative tells KHook's
+        // share apart from what the hardware loses with more busy cores.
+        report("hooked_scaling", hooked.perThread / singleThread, "x");
+        if (dataCacheProbe.Valid()) {
+            report(
+                "unhooked_l1d_misses",
+                unhooked.dataCacheMissesPerCall,
+                "/call"
+            );
+            report("hooked_l1d_misses", hooked.dataCacheMissesPerCall, "/call");
+        }
+        if (hitmProbe.Valid()) {
+            report("unhooked_hitm", unhooked.hitmPerCall, "/call");
+            report("hooked_hitm", hooked.hitmPerCall, "/call");
+        }
+    }
+
+    EXPECT_EQ(badCalls, 0u)
+        << "Every thread should reach its own target and get its value back";
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Hooks,
+    DisjointTargetScalingBenchmark,
+    ::testing::Values(HookKind::Static, HookKind::Virtual),
+    [](const ::testing::TestParamInfo<HookKind>& info) {
+        return std::string(HookKindName(info.param));
+    }
+);
@@ -0,0 +1,354 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <khook.hpp>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "hooks.hpp"
+#include "main.hpp"
+
+class HookExceptionTest: public ::testing::TestWithParam<HookKind> {
+  protected:
+    class TestObject {
+      public:
+        int m_testValue;
+    };
+
+    class HookError: public std::runtime_error {
+      public:
+        explicit HookError(int value) :
+            std::runtime_error("HookError"),
+            m_value(value) {}
+
+        int m_value;
+    };
+
+    // Counts the return values KHook holds on our behalf, anything still
+    // alive once a call has unwound is leaked per-call state.
+    class SavedValue {
+      public:
+        static void Init(int* assignee, int* value) {
+            *assignee = *value;
+            s_live++;
+        }
+
+        static void Deinit(int* assignee) {
+            s_live--;
+        }
+
+        static inline std::atomic<int> s_live {0};
+    };
+
+    class HookedClass {
+      public:
+        NOINLINE static int SetObjectValue(TestObject* obj, int value) {
+            LogCallback("HookedClass::SetObjectValue()");
+            if (value < 0) {
+                throw HookError(value);
+            }
+            obj->m_testValue = value;
+            return value;
+        }
+    };
+
+    class VirtualHookedClass {
+      public:
+        virtual int SetObjectValue(TestObject* obj, int value) {
+            LogCallback("VirtualHookedClass::SetObjectValue()");
+            if (value < 0) {
+                throw HookError(value);
+            }
+            obj->m_testValue = value;
+            return value;
+        }
+    };
+
+    using SetObjectValueNoopHook = NoopStaticHookTemplate<int, TestObject*, int>;
+    using VirtualSetObjectValueNoopHook =
+        NoopMemberHookTemplate<int, TestObject*, int>;
+
+    class FakeClass {
+      public:
+        NOINLINE static int SaveDoubledValue(TestObject* obj, int value) {
+            LogCallback("SaveDoubledValue()");
+            int result = value * 2;
+            KHook::SaveReturnValue(
+                KHook::Action::Override,
+                &result,
+                sizeof(int),
+                (void*)&SavedValue::Init,
+                (void*)&SavedValue::Deinit,
+                false
+            );
+            return result;
+        }
+
+        NOINLINE static int ThrowHookError(TestObject* obj, int value) {
+            LogCallback("ThrowHookError()");
+            throw HookError(value);
+        }
+    };
+
+    class VirtualFakeClass {
+      public:
+        NOINLINE int SaveDoubledValue(TestObject* obj, int value) {
+            return FakeClass::SaveDoubledValue(obj, value);
+        }
+
+        NOINLINE int ThrowHookError(TestObject* obj, int value) {
+            return FakeClass::ThrowHookError(obj, value);
+        }
+    };
+
+    enum class Callback {
+        Noop,
+        SaveDoubled,
+        Throw
+    };
+
+  protected:
+    void SetUp() override {
+        target = new VirtualHookedClass();
+        obj = new TestObject();
+        obj->m_testValue = 0;
+        SavedValue::s_live = 0;
+    }
+
+    void TearDown() override {
+        m_hooks.clear();
+
+        if (obj) {
+            delete obj;
+            obj = nullptr;
+        }
+        if (target) {
+            delete target;
+            target = nullptr;
+        }
+    }
+
+    static void* StaticCallback(Callback callback) {
+        switch (callback) {
+            case Callback::SaveDoubled:
+                return (void*)&FakeClass::SaveDoubledValue;
+            case Callback::Throw:
+                return (void*)&FakeClass::ThrowHookError;
+            default:
+                return (void*)&SetObjectValueNoopHook::PrePostNoop;
+        }
+    }
+
+    static void* MemberCallback(Callback callback) {
+        switch (callback) {
+            case Callback::SaveDoubled:
+                return KHook::ExtractMFP(&VirtualFakeClass::SaveDoubledValue);
+            case Callback::Throw:
+                return KHook::ExtractMFP(&VirtualFakeClass::ThrowHookError);
+            default:
+                return KHook::ExtractMFP(
+                    &VirtualSetObjectValueNoopHook::PrePostNoop
+                );
+        }
+    }
+
+    int Install(Callback pre, Callback post) {
+        HookHandle hook;
+        if (GetParam() == HookKind::Static) {
+            hook = HookHandle::SetupHook(
+                (void*)&HookedClass::SetObjectValue,
+                nullptr,
+                (void*)&SetObjectValueNoopHook::OnRemoved,
+                StaticCallback(pre),
+                StaticCallback(post),
+                (void*)&SetObjectValueNoopHook::MakeReturn,
+                (void*)&SetObjectValueNoopHook::CallOriginal,
+                false
+            );
+        } else {
+            hook = HookHandle::SetupVirtualHook(
+                *(void***)(target),
+                KHook::GetVtableIndex(&VirtualHookedClass::SetObjectValue),
+                nullptr,
+                KHook::ExtractMFP(&VirtualSetObjectValueNoopHook::OnRemoved),
+                MemberCallback(pre),
+                MemberCallback(post),
+                KHook::ExtractMFP(&VirtualSetObjectValueNoopHook::MakeReturn),
+                KHook::ExtractMFP(&VirtualSetObjectValueNoopHook::CallOriginal),
+                false
+            );
+        }
+        int hookId = hook.Id();
+        if (hook.Valid()) {
+            m_hooks.push_back(std::move(hook));
+        }
+        return hookId;
+    }
+
+    void RemoveAll() {
+        m_hooks.clear();
+    }
+
+    int Call(int value) {
+        if (GetParam() == HookKind::Static) {
+            return HookedClass::SetObjectValue(obj, value);
+        }
+        return target->SetObjectValue(obj, value);
+    }
+
+    // Throws through the hooked function and reports the value carried by the
+    // exception, or zero if nothing was thrown.
+    int CallExpectingThrow(int value) {
+        try {
+            Call(value);
+        } catch (const HookError& e) {
+            return e.m_value;
+        }
+        return 0;
+    }
+
+    ScopedCallbackLogging m_quiet {false};
+    std::vector<HookHandle> m_hooks;
+    VirtualHookedClass* target = nullptr;
+    TestObject* obj = nullptr;
+};
+
+TEST_P(HookExceptionTest, OriginalThrowsThroughHook) {
+    ASSERT_NE(Install(Callback::SaveDoubled, Callback::Noop), KHook::INVALID_HOOK)
+        << "Hook setup should succeed";
+
+    EXPECT_EQ(CallExpectingThrow(-1), -1)
+        << "Exception thrown by the original should reach the caller";
+    EXPECT_EQ(SavedValue::s_live, 0)
+        << "Saved return value should be destroyed when the call unwinds";
+
+    EXPECT_EQ(Call(21), 42)
+        << "Hook should keep working after an exception went through it";
+    EXPECT_EQ(obj->m_testValue, 21) << "Original should still be called";
+    EXPECT_EQ(SavedValue::s_live, 0)
+        << "Saved return value should be destroyed after the call";
+}
+
+TEST_P(HookExceptionTest, OriginalThrowsThroughStackedHooks) {
+    for (int i = 0; i < 3; i++) {
+        ASSERT_NE(
+            Install(Callback::SaveDoubled, Callback::Noop),
+            KHook::INVALID_HOOK
+        ) << "Hook setup should succeed";
+    }
+
+    EXPECT_EQ(CallExpectingThrow(-7), -7)
+        << "Exception thrown by the original should reach the caller";
+    EXPECT_EQ(SavedValue::s_live, 0)
+        << "Saved return values of every hook should be destroyed";
+
+    EXPECT_EQ(Call(5), 10)
+        << "Hooks should keep working after an exception went through them";
+    EXPECT_EQ(SavedValue::s_live, 0)
+        << "Saved return values should be destroyed after the call";
+}
+
+TEST_P(HookExceptionTest, PreCallbackThrows) {
+    ASSERT_NE(Install(Callback::Throw, Callback::Noop), KHook::INVALID_HOOK)
+        << "Hook setup should succeed";
+    ASSERT_NE(Install(Callback::SaveDoubled, Callback::Noop), KHook::INVALID_HOOK)
+        << "Hook setup should succeed";
+
+    obj->m_testValue = 0x9600;
+
+    EXPECT_EQ(CallExpectingThrow(3), 3)
+        << "Exception thrown by the pre callback should reach the caller";
+    EXPECT_EQ(obj->m_testValue, 0x9600)
+        << "Original should not be called when a pre callback throws";
+    EXPECT_EQ(SavedValue::s_live, 0)
+        << "Values saved by earlier pre callbacks should be destroyed";
+
+    RemoveAll();
+    ASSERT_NE(Install(Callback::SaveDoubled, Callback::Noop), KHook::INVALID_HOOK)
+        << "Hook setup should succeed";
+
+    EXPECT_EQ(Call(4), 8) << "Call state should not leak into the next call";
+    EXPECT_EQ(SavedValue::s_live, 0)
+        << "Saved return value should be destroyed after the call";
+}
+
+TEST_P(HookExceptionTest, PostCallbackThrows) {
+    ASSERT_NE(Install(Callback::SaveDoubled, Callback::Throw), KHook::INVALID_HOOK)
+        << "Hook setup should succeed";
+
+    EXPECT_EQ(CallExpectingThrow(9), 9)
+        << "Exception thrown by the post callback should reach the caller";
+    EXPECT_EQ(obj->m_testValue, 9)
+        << "Original should be called before the post callback throws";
+    EXPECT_EQ(SavedValue::s_live, 0)
+        << "Saved return values should be destroyed when the call unwinds";
+
+    RemoveAll();
+    ASSERT_NE(Install(Callback::SaveDoubled, Callback::Noop), KHook::INVALID_HOOK)
+        << "Hook setup should succeed";
+
+    EXPECT_EQ(Call(4), 8) << "Call state should not leak into the next call";
+    EXPECT_EQ(SavedValue::s_live, 0)
+        << "Saved return value should be destroyed after the call";
+}
+
+TEST_P(HookExceptionTest, RepeatedThrowsLeaveNoState) {
+    for (int i = 0; i < 2; i++) {
+        ASSERT_NE(
+            Install(Callback::SaveDoubled, Callback::Noop),
+            KHook::INVALID_HOOK
+        ) << "Hook setup should succeed";
+    }
+
+    for (int i = 1; i <= 1000; i++) {
+        ASSERT_EQ(CallExpectingThrow(-i), -i)
+            << "Exception should reach the caller on iteration " << i;
+        ASSERT_EQ(Call(i), i * 2)
+            << "Hooked call after a throw should return the overridden value";
+    }
+
+    EXPECT_EQ(SavedValue::s_live, 0)
+        << "No saved return value should outlive its call";
+}
+
+TEST_P(HookExceptionTest, BenchmarkUnwindCost) {
+    BENCHMARK_ONLY();
+
+    std::size_t iterations = BenchIterations(20000);
+    auto throwOnce = [&](std::size_t) {
+        DoNotOptimize(CallExpectingThrow(-1));
+    };
+
+    double unhooked = MeasureNsPerOp(iterations, throwOnce);
+    ReportMetric("unhooked_throw", unhooked, "ns");
+
+    int depth = 0;
+    for (int targetDepth : {1, 2, 4, 8}) {
+        while (depth < targetDepth) {
+            ASSERT_NE(
+                Install(Callback::SaveDoubled, Callback::Noop),
+                KHook::INVALID_HOOK
+            ) << "Hook setup should succeed";
+            depth++;
+        }
+
+        double hooked = MeasureNsPerOp(iterations, throwOnce);
+        std::string name = "depth_" + std::to_string(depth);
+        ReportMetric((name + ".hooked_throw").c_str(), hooked, "ns");
+        ReportMetric((name + ".slowdown").c_str(), hooked / unhooked, "x");
+
+        EXPECT_EQ(SavedValue::s_live, 0)
+            << "No saved return value should outlive its call";
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Hooks,
+    HookExceptionTest,
+    ::testing::Values(HookKind::Static, HookKind::Virtual),
+    [](const ::testing::TestParamInfo<HookKind>& info) {
+        return std::string(HookKindName(info.param));
+    }
+);
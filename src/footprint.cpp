@@ -0,0 +1,200 @@
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <khook.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "codegen.hpp"
+#include "main.hpp"
+#include "resources.hpp"
+#include "targets.hpp"
+
+class HookFootprintBenchmark: public ::testing::TestWithParam<HookKind> {
+  protected:
+    static int Install(
+        HookKind kind,
+        CodeBuffer* code,
+        GeneratedInstance* instance,
+        std::size_t index
+    ) {
+        if (kind == HookKind::Static) {
+            return KHook::SetupHook(
+                (void*)code->Function(index),
+                nullptr,
+                (void*)&GeneratedStaticHook::OnRemoved,
+                (void*)&GeneratedStaticHook::PrePostNoop,
+                (void*)&GeneratedStaticHook::PrePostNoop,
+                (void*)&GeneratedStaticHook::MakeReturn,
+                (void*)&GeneratedStaticHook::CallOriginal,
+                false
+            );
+        }
+        return KHook::SetupVirtualHook(
+            instance->Vtable(),
+            (int)index,
+            nullptr,
+            KHook::ExtractMFP(&GeneratedMemberHook::OnRemoved),
+            KHook::ExtractMFP(&GeneratedMemberHook::PrePostNoop),
+            KHook::ExtractMFP(&GeneratedMemberHook::PrePostNoop),
+            KHook::ExtractMFP(&GeneratedMemberHook::MakeReturn),
+            KHook::ExtractMFP(&GeneratedMemberHook::CallOriginal),
+            false
+        );
+    }
+
+    static void ReportDelta(
+        const std::string& name,
+        const char* metric,
+        std::int64_t delta,
+        std::size_t hooks
+    ) {
+        ReportMetric((name + "." + metric).c_str(), (double)delta, "bytes");
+        ReportMetric(
+            (name + "." + metric + "_per_hook").c_str(),
+            (double)delta / (double)hooks,
+            "bytes"
+        );
+    }
+
+    // Runs in a child process, installs hooks on `count` fresh targets and
+    // reports how the mappings of the process change. Returns false if a hook
+    // couldn't be installed or doesn't behave.
+    static bool MeasureFootprint(HookKind kind, std::size_t count) {
+        ScopedCallbackLogging quiet(false);
+
+        std::unique_ptr<CodeBuffer> code;
+        std::unique_ptr<GeneratedInstance> instance;
+        if (kind == HookKind::Static) {
+            code.reset(new CodeBuffer(count));
+            if (!code->Valid()) {
+                return false;
+            }
+        } else {
+            instance.reset(new GeneratedInstance(count));
+        }
+
+        std::vector<int> hookIds;
+        hookIds.reserve(count);
+
+        MappingStats before = ReadMappingStats();
+        std::int64_t rssBefore = GetCurrentRssKb();
+        std::int64_t start = GetWallTimeNs();
+
+        for (std::size_t i = 0; i < count; i++) {
+            int hookId = Install(kind, code.get(), instance.get(), i);
+            if (hookId == KHook::INVALID_HOOK) {
+                return false;
+            }
+            hookIds.push_back(hookId);
+        }
+
+        double installNs = (double)(GetWallTimeNs() - start) / (double)count;
+        MappingStats installed = ReadMappingStats();
+        std::int64_t rssInstalled = GetCurrentRssKb();
+
+        bool behaves = true;
+        for (std::size_t i : {(std::size_t)0, count / 2, count - 1}) {
+            GeneratedObject obj {};
+            int value = (int)i + 1;
+            int result = 0;
+            std::size_t expected = i;
+            if (kind == HookKind::Static) {
+                result = code->Function(i)(&obj, value);
+            } else {
+                result = instance->Call(i, &obj, value);
+                expected = instance->TargetOf(i);
+            }
+            behaves = behaves && result == value && obj.m_testValue == value
+                && obj.m_lastTarget == (int)expected;
+        }
+
+        for (int hookId : hookIds) {
+            KHook::RemoveHook(hookId, false);
+        }
+        MappingStats removed = ReadMappingStats();
+
+        KHook::Shutdown();
+        MappingStats shutdown = ReadMappingStats();
+
+        std::string name = "hooks_" + std::to_string(count);
+        double pageSize = (double)GetPageSize();
+        std::int64_t execBytes = installed.execBytes - before.execBytes;
+
+        ReportMetric((name + ".install").c_str(), installNs, "ns/hook");
+        ReportDelta(name, "exec", execBytes, count);
+        ReportMetric(
+            (name + ".exec_pages_per_hook").c_str(),
+            (double)execBytes / pageSize / (double)count,
+            "pages"
+        );
+        ReportDelta(name, "anon", installed.anonBytes - before.anonBytes, count);
+        ReportDelta(
+            name,
+            "anon_exec",
+            installed.anonExecBytes - before.anonExecBytes,
+            count
+        );
+        ReportMetric(
+            (name + ".mappings_added").c_str(),
+            (double)(installed.mappings - before.mappings),
+            "mappings"
+        );
+        ReportMetric(
+            (name + ".rss_per_hook").c_str(),
+            (double)(rssInstalled - rssBefore) * 1024.0 / (double)count,
+            "bytes"
+        );
+        ReportMetric(
+            (name + ".exec_retained_after_remove").c_str(),
+            (double)(removed.execBytes - before.execBytes),
+            "bytes"
+        );
+        ReportMetric(
+            (name + ".anon_retained_after_remove").c_str(),
+            (double)(removed.anonBytes - before.anonBytes),
+            "bytes"
+        );
+        ReportMetric(
+            (name + ".exec_retained_after_shutdown").c_str(),
+            (double)(shutdown.execBytes - before.execBytes),
+            "bytes"
+        );
+        ReportMetric(
+            (name + ".anon_retained_after_shutdown").c_str(),
+            (double)(shutdown.anonBytes - before.anonBytes),
+            "bytes"
+        );
+
+        return behaves;
+    }
+};
+
+TEST_P(HookFootprintBenchmark, ExecutableMemoryPerHook) {
+    BENCHMARK_ONLY();
+
+    HookKind kind = GetParam();
+    for (std::size_t count : {1000, 10000, 100000}) {
+        std::size_t scaled = BenchIterations(count);
+
+        // Each size gets a process of its own, so every run starts from an
+        // untouched KHook and KHook::Shutdown doesn't affect later tests.
+        EXPECT_EXIT(
+            exit(MeasureFootprint(kind, scaled) ? 0 : 1),
+            ::testing::ExitedWithCode(0),
+            ""
+        ) << "Every hook should install and behave with " << scaled
+          << " targets";
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Hooks,
+    HookFootprintBenchmark,
+    ::testing::Values(HookKind::Static, HookKind::Virtual),
+    [](const ::testing::TestParamInfo<HookKind>& info) {
+        return std::string(HookKindName(info.param));
+    }
+);
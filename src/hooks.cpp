@@ -0,0 +1,257 @@
+#include "hooks.hpp"
+
+#include "resources.hpp"
+
+HookRegistry g_hookRegistry;
+
+#pragma region HookRegistry
+
+void HookRegistry::Register(int hookId, const void* target, std::int64_t costNs) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // KHook may hand out the id of a hook that is fully gone again.
+    auto existing = m_hooks.find(hookId);
+    if (existing != m_hooks.end()) {
+        Forget(existing);
+    }
+
+    HookRecord& record = m_hooks[hookId];
+    record.hookId = hookId;
+    record.target = target;
+    record.installedNs = GetWallTimeNs();
+    record.installCostNs = costNs;
+    record.chainPosition = m_liveByTarget[target]++;
+
+    m_stats.installs++;
+    m_stats.totalInstallNs += costNs;
+    if (costNs > m_stats.maxInstallNs) {
+        m_stats.maxInstallNs = costNs;
+    }
+}
+
+void HookRegistry::RegisterFailure(std::int64_t costNs) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stats.failedInstalls++;
+    m_stats.totalInstallNs += costNs;
+}
+
+bool HookRegistry::BeginRemove(int hookId) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_hooks.find(hookId);
+    if (it == m_hooks.end() || it->second.removeRequested) {
+        return false;
+    }
+
+    it->second.removeRequested = true;
+    m_liveByTarget[it->second.target]--;
+    m_stats.removals++;
+    return true;
+}
+
+void HookRegistry::NotifyRemoved(int hookId) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_hooks.find(hookId);
+    if (it == m_hooks.end()) {
+        m_stats.unknownRemovedCalls++;
+        return;
+    }
+
+    // Also covers hooks removed by one of their own callbacks, whose handle
+    // must not remove them a second time.
+    m_stats.removedCalls++;
+    Forget(it);
+}
+
+void HookRegistry::Forget(std::unordered_map<int, HookRecord>::iterator it) {
+    if (!it->second.removeRequested) {
+        m_liveByTarget[it->second.target]--;
+    }
+    m_hooks.erase(it);
+}
+
+bool HookRegistry::IsLive(int hookId) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_hooks.find(hookId);
+    return it != m_hooks.end() && !it->second.removeRequested;
+}
+
+bool HookRegistry::Find(int hookId, HookRecord* record) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_hooks.find(hookId);
+    if (it == m_hooks.end()) {
+        return false;
+    }
+    *record = it->second;
+    return true;
+}
+
+std::size_t HookRegistry::LiveCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::size_t live = 0;
+    for (const auto& entry : m_hooks) {
+        live += entry.second.removeRequested ? 0 : 1;
+    }
+    return live;
+}
+
+std::size_t HookRegistry::LiveCount(const void* target) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_liveByTarget.find(target);
+    return it == m_liveByTarget.end() ? 0 : it->second;
+}
+
+std::size_t HookRegistry::PendingRemovals() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::size_t pending = 0;
+    for (const auto& entry : m_hooks) {
+        pending += entry.second.removeRequested ? 1 : 0;
+    }
+    return pending;
+}
+
+std::vector<HookRecord> HookRegistry::Snapshot() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<HookRecord> records;
+    records.reserve(m_hooks.size());
+    for (const auto& entry : m_hooks) {
+        records.push_back(entry.second);
+    }
+    return records;
+}
+
+std::size_t HookRegistry::DropPending() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::size_t pending = 0;
+    for (auto it = m_hooks.begin(); it != m_hooks.end();) {
+        if (it->second.removeRequested) {
+            it = m_hooks.erase(it);
+            pending++;
+        } else {
+            ++it;
+        }
+    }
+    return pending;
+}
+
+HookRegistryStats HookRegistry::Stats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+std::size_t HookRegistry::RemoveAll() {
+    std::vector<int> live;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const auto& entry : m_hooks) {
+            if (!entry.second.removeRequested) {
+                live.push_back(entry.first);
+            }
+        }
+    }
+
+    // KHook calls OnRemoved from inside RemoveHook, so the lock can't be held.
+    for (int hookId : live) {
+        if (BeginRemove(hookId)) {
+            KHook::RemoveHook(hookId, false);
+        }
+    }
+    return live.size();
+}
+
+#pragma endregion
+
+#pragma region HookHandle
+
+HookHandle HookHandle::SetupHook(
+    void* function,
+    void* context,
+    void* removed,
+    void* pre,
+    void* post,
+    void* makeReturn,
+    void* callOriginal,
+    bool async
+) {
+    std::int64_t start = GetWallTimeNs();
+    int hookId = KHook::SetupHook(
+        function,
+        context,
+        removed,
+        pre,
+        post,
+        makeReturn,
+        callOriginal,
+        async
+    );
+    std::int64_t cost = GetWallTimeNs() - start;
+
+    if (hookId == KHook::INVALID_HOOK) {
+        g_hookRegistry.RegisterFailure(cost);
+    } else {
+        g_hookRegistry.Register(hookId, function, cost);
+    }
+    return HookHandle(hookId);
+}
+
+HookHandle HookHandle::SetupVirtualHook(
+    void** vtable,
+    int index,
+    void* context,
+    void* removed,
+    void* pre,
+    void* post,
+    void* makeReturn,
+    void* callOriginal,
+    bool async
+) {
+    std::int64_t start = GetWallTimeNs();
+    int hookId = KHook::SetupVirtualHook(
+        vtable,
+        index,
+        context,
+        removed,
+        pre,
+        post,
+        makeReturn,
+        callOriginal,
+        async
+    );
+    std::int64_t cost = GetWallTimeNs() - start;
+
+    if (hookId == KHook::INVALID_HOOK) {
+        g_hookRegistry.RegisterFailure(cost);
+    } else {
+        g_hookRegistry.Register(hookId, &vtable[index], cost);
+    }
+    return HookHandle(hookId);
+}
+
+void HookHandle::Remove(bool async) {
+    if (m_hookId == KHook::INVALID_HOOK) {
+        return;
+    }
+    int hookId = m_hookId;
+    m_hookId = KHook::INVALID_HOOK;
+    RemoveById(hookId, async);
+}
+
+bool HookHandle::RemoveById(int hookId, bool async) {
+    if (!g_hookRegistry.BeginRemove(hookId)) {
+        return false;
+    }
+    KHook::RemoveHook(hookId, async);
+    return true;
+}
+
+#pragma endregion
+
+void HookLeakListener::OnTestEnd(const ::testing::TestInfo& info) {
+    std::size_t leaked = g_hookRegistry.RemoveAll();
+    // Hooks with their own OnRemoved callbacks never report back, don't let
+    // them pile up.
+    g_hookRegistry.DropPending();
+    if (leaked > 0) {
+        ADD_FAILURE() << info.test_suite_name() << "." << info.name()
+                      << " left " << leaked << " hooks installed";
+    }
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <khook.hpp>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+struct HookRecord {
+    int hookId = KHook::INVALID_HOOK;
+    // The hooked function, or the vtable slot of a virtual hook.
+    const void* target = nullptr;
+    std::int64_t installedNs = 0;
+    std::int64_t installCostNs = 0;
+    // Number of hooks that were live on the target when this one went in.
+    std::size_t chainPosition = 0;
+    bool removeRequested = false;
+};
+
+struct HookRegistryStats {
+    std::uint64_t installs = 0;
+    std::uint64_t failedInstalls = 0;
+    std::uint64_t removals = 0;
+    std::uint64_t removedCalls = 0;
+    std::uint64_t unknownRemovedCalls = 0;
+    std::int64_t totalInstallNs = 0;
+    std::int64_t maxInstallNs = 0;
+};
+
+// Every hook installed through a HookHandle that KHook hasn't reported through
+// OnRemoved yet. The Noop templates report their OnRemoved calls here, hooks
+// with other callbacks have to call NotifyRemoved themselves or stay pending
+// once their removal was requested.
+class HookRegistry {
+  public:
+    void Register(int hookId, const void* target, std::int64_t costNs);
+    void RegisterFailure(std::int64_t costNs);
+
+    // Returns false if the hook is gone already, in which case it must not be
+    // passed to KHook::RemoveHook again.
+    bool BeginRemove(int hookId);
+    void NotifyRemoved(int hookId);
+
+    bool IsLive(int hookId) const;
+    bool Find(int hookId, HookRecord* record) const;
+    std::size_t LiveCount() const;
+    std::size_t LiveCount(const void* target) const;
+    // Hooks whose removal was requested but not reported through OnRemoved.
+    std::size_t PendingRemovals() const;
+    std::size_t DropPending();
+    std::vector<HookRecord> Snapshot() const;
+    HookRegistryStats Stats() const;
+
+    // Removes every hook that is still live and returns how many there were.
+    std::size_t RemoveAll();
+
+  private:
+    void Forget(std::unordered_map<int, HookRecord>::iterator it);
+
+    mutable std::mutex m_mutex;
+    std::unordered_map<int, HookRecord> m_hooks;
+    std::unordered_map<const void*, std::size_t> m_liveByTarget;
+    HookRegistryStats m_stats;
+};
+
+extern HookRegistry g_hookRegistry;
+
+// Owns an installed hook and removes it when destroyed, so that a failed
+// assertion can't leak the hook into the tests that run after it.
+class HookHandle {
+  public:
+    HookHandle() = default;
+    ~HookHandle() {
+        Remove();
+    }
+
+    HookHandle(HookHandle&& other) noexcept : m_hookId(other.m_hookId) {
+        other.m_hookId = KHook::INVALID_HOOK;
+    }
+
+    HookHandle& operator=(HookHandle&& other) noexcept {
+        if (this != &other) {
+            Remove();
+            m_hookId = other.m_hookId;
+            other.m_hookId = KHook::INVALID_HOOK;
+        }
+        return *this;
+    }
+
+    HookHandle(const HookHandle&) = delete;
+    HookHandle& operator=(const HookHandle&) = delete;
+
+    static HookHandle SetupHook(
+        void* function,
+        void* context,
+        void* removed,
+        void* pre,
+        void* post,
+        void* makeReturn,
+        void* callOriginal,
+        bool async
+    );
+
+    static HookHandle SetupVirtualHook(
+        void** vtable,
+        int index,
+        void* context,
+        void* removed,
+        void* pre,
+        void* post,
+        void* makeReturn,
+        void* callOriginal,
+        bool async
+    );
+
+    bool Valid() const {
+        return m_hookId != KHook::INVALID_HOOK;
+    }
+
+    explicit operator bool() const {
+        return Valid();
+    }
+
+    int Id() const {
+        return m_hookId;
+    }
+
+    void Remove(bool async = false);
+
+    // For callbacks that remove their own hook, or a sibling, without access
+    // to its handle. The handle then won't remove the hook a second time.
+    static bool RemoveById(int hookId, bool async = false);
+
+  private:
+    explicit HookHandle(int hookId) : m_hookId(hookId) {}
+
+    int m_hookId = KHook::INVALID_HOOK;
+};
+
+// Fails a test that leaves hooks behind and removes them before the next one.
+class HookLeakListener: public ::testing::EmptyTestEventListener {
+  public:
+    void OnTestEnd(const ::testing::TestInfo& info) override;
+};
@@ -0,0 +1,186 @@
+#include <gtest/gtest.h>
+
+#include <khook.hpp>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "codegen.hpp"
+#include "hooks.hpp"
+#include "main.hpp"
+#include "resources.hpp"
+#include "targets.hpp"
+
+// Hooked targets scattered over many code pages, like the hooked functions
+// of a large binary, instead of a handful of neighbours that always stay in
+// the instruction cache.
+class SpreadCodeHookTest: public ::testing::Test {
+  protected:
+    struct CallCost {
+        PreciseMeasurement timing;
+        // Per call, zero when the counters aren't available.
+        double icacheMisses = 0.0;
+        double itlbMisses = 0.0;
+        std::uint64_t badCalls = 0;
+    };
+
+    // One function per page, and not at the same page offset every time so
+    // that they don't all compete for a single instruction cache set.
+    static std::size_t SpreadStride() {
+        return GetPageSize() + 2 * CodeBuffer::kFunctionStride;
+    }
+
+    void InstallAll(const CodeBuffer& code, void* pre) {
+        for (std::size_t i = 0; i < code.Count(); i++) {
+            m_hooks.push_back(HookHandle::SetupHook(
+                (void*)code.Function(i),
+                nullptr,
+                (void*)&GeneratedStaticHook::OnRemoved,
+                pre,
+                (void*)&GeneratedStaticHook::PrePostNoop,
+                (void*)&GeneratedStaticHook::MakeReturn,
+                (void*)&GeneratedStaticHook::CallOriginal,
+                false
+            ));
+        }
+    }
+
+    bool AllValid() const {
+        for (const HookHandle& hook : m_hooks) {
+            if (!hook.Valid()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static CallCost
+    Measure(const CodeBuffer& code, const std::vector<std::uint32_t>& order) {
+        CallCost cost;
+        GeneratedObject obj {};
+        // Every function once, so the first run doesn't pay for page faults.
+        for (std::size_t i = 0; i < code.Count(); i++) {
+            DoNotOptimize(code.Function(i)(&obj, (int)i));
+        }
+
+        PerfCounter icache(PerfCounter::Event::InstructionCacheMisses);
+        PerfCounter itlb(PerfCounter::Event::InstructionTlbMisses);
+        icache.Start();
+        itlb.Start();
+        cost.timing = MeasurePrecise(order.size(), [&](std::size_t i) {
+            std::uint32_t target = order[i];
+            int value = (int)(i & 0xFFFF);
+            int result = code.Function(target)(&obj, value);
+            cost.badCalls += result == value
+                    && obj.m_lastTarget == (int)target
+                ? 0
+                : 1;
+        });
+        // Every call in the order ran once, warm-up share included.
+        double calls = (double)order.size();
+        cost.itlbMisses = (double)itlb.Stop() / calls;
+        cost.icacheMisses = (double)icache.Stop() / calls;
+        return cost;
+    }
+
+    ScopedCallbackLogging m_quiet {false};
+    std::vector<HookHandle> m_hooks;
+};
+
+TEST_F(SpreadCodeHookTest, HookSpreadFunctions) {
+    for (bool hugePages : {false, true}) {
+        CodeBuffer code(64, SpreadStride(), hugePages);
+        ASSERT_TRUE(code.Valid()) << "Should map the spread out functions";
+        if (code.HugePages()) {
+            std::uintptr_t base = (std::uintptr_t)code.Base();
+            EXPECT_EQ(base % CodeBuffer::kHugePageSize, 0u)
+                << "Huge page mappings should be aligned to a huge page";
+        }
+
+        GeneratedCountingHook::s_calls = 0;
+        InstallAll(code, (void*)&GeneratedCountingHook::Pre);
+        ASSERT_TRUE(AllValid()) << "Hook setup on every page should succeed";
+
+        for (std::size_t i = 0; i < code.Count(); i++) {
+            GeneratedObject obj {};
+            ASSERT_EQ(code.Function(i)(&obj, (int)i + 1), (int)i + 1)
+                << "Spread function " << i
+                << " should return the original value";
+            ASSERT_EQ(obj.m_lastTarget, (int)i)
+                << "Hook should call the original spread function " << i;
+        }
+        EXPECT_EQ(GeneratedCountingHook::s_calls, code.Count())
+            << "Pre callback should run once per call";
+
+        // Hooks have to go before the code they patched is unmapped.
+        m_hooks.clear();
+    }
+}
+
+TEST_F(SpreadCodeHookTest, BenchmarkInstructionCachePressure) {
+    BENCHMARK_ONLY();
+
+    std::size_t functions = BenchIterations(4096);
+    std::size_t calls = BenchIterations(1000000);
+    ReportMetric("functions", (double)functions, "functions");
+
+    // Calls in random order, the same for every layout and for hooked and
+    // unhooked runs.
+    std::mt19937 random(20241019);
+    std::uniform_int_distribution<std::uint32_t> pick(
+        0,
+        (std::uint32_t)functions - 1
+    );
+    std::vector<std::uint32_t> order(calls);
+    for (std::uint32_t& target : order) {
+        target = pick(random);
+    }
+
+    PerfCounter probe(PerfCounter::Event::InstructionCacheMisses);
+    ReportMetric("perf_counters", probe.Valid() ? 1.0 : 0.0, "available");
+
+    struct Layout {
+        const char* name;
+        std::size_t stride;
+        bool hugePages;
+    };
+    const Layout layouts[] = {
+        {"packed", CodeBuffer::kFunctionStride, false},
+        {"spread", SpreadStride(), false},
+        {"spread_huge", SpreadStride(), true},
+    };
+
+    std::uint64_t badCalls = 0;
+    for (const Layout& layout : layouts) {
+        CodeBuffer code(functions, layout.stride, layout.hugePages);
+        ASSERT_TRUE(code.Valid()) << layout.name << " code should be mapped";
+
+        CallCost unhooked = Measure(code, order);
+        InstallAll(code, (void*)&GeneratedStaticHook::PrePostNoop);
+        ASSERT_TRUE(AllValid()) << layout.name << " hook setup should succeed";
+        CallCost hooked = Measure(code, order);
+        m_hooks.clear();
+        badCalls += unhooked.badCalls + hooked.badCalls;
+
+        std::string prefix(layout.name);
+        auto report = [&](const char* metric, double value, const char* unit) {
+            ReportMetric((prefix + "." + metric).c_str(), value, unit);
+        };
+        report("code_pages", (double)(code.Size() / GetPageSize()), "pages");
+        report("huge_pages", code.HugePages() ? 1.0 : 0.0, "advised");
+        ReportPrecise((prefix + ".unhooked_call").c_str(), unhooked.timing);
+        ReportPrecise((prefix + ".hooked_call").c_str(), hooked.timing);
+        report("hook_overhead", hooked.timing.ns - unhooked.timing.ns, "ns");
+        if (probe.Valid()) {
+            report("unhooked_icache_misses", unhooked.icacheMisses, "/call");
+            report("hooked_icache_misses", hooked.icacheMisses, "/call");
+            report("unhooked_itlb_misses", unhooked.itlbMisses, "/call");
+            report("hooked_itlb_misses", hooked.itlbMisses, "/call");
+        }
+    }
+
+    EXPECT_EQ(badCalls, 0u)
+        << "Every call should reach its own function and return its value";
+}
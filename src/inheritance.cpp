@@ -0,0 +1,298 @@
+#include <gtest/gtest.h>
+
+#include <khook.hpp>
+#include <memory>
+#include <string>
+
+#include "bench.hpp"
+#include "hooks.hpp"
+#include "main.hpp"
+
+// Virtual hooks on methods that are reached through another vtable than the
+// one of the most derived class: secondary bases, whose slots may hold
+// this-adjusting thunks, and virtual bases, whose slots hold thunks that
+// read the adjustment from the vtable. Callbacks see `this` exactly as the
+// caller passed it, the original must still see its own.
+class MultipleInheritanceHookTest: public ::testing::Test {
+  protected:
+    enum class VirtualPath {
+        PrimaryBase,
+        SecondaryBase,
+        SecondaryThunk,
+        VirtualBaseThunk
+    };
+
+    static constexpr VirtualPath kPaths[] = {
+        VirtualPath::PrimaryBase,
+        VirtualPath::SecondaryBase,
+        VirtualPath::SecondaryThunk,
+        VirtualPath::VirtualBaseThunk
+    };
+
+    static const char* PathName(VirtualPath path) {
+        switch (path) {
+            case VirtualPath::PrimaryBase:
+                return "primary_base";
+            case VirtualPath::SecondaryBase:
+                return "secondary_base";
+            case VirtualPath::SecondaryThunk:
+                return "secondary_thunk";
+            default:
+                return "virtual_base_thunk";
+        }
+    }
+
+    // Every method returns -1 if it was called with the wrong `this`.
+    class Primary {
+      public:
+        virtual int PrimaryValue(int value) {
+            return -1;
+        }
+
+        int m_primary = 1;
+    };
+
+    class Secondary {
+      public:
+        Secondary() : m_secondarySelf(this) {}
+
+        virtual int SecondaryValue(int value) {
+            return -1;
+        }
+
+        virtual int Inherited(int value) {
+            return this == m_secondarySelf ? value + 3 : -1;
+        }
+
+        Secondary* m_secondarySelf;
+    };
+
+    class Derived: public Primary, public Secondary {
+      public:
+        Derived() : m_self(this) {}
+
+        int PrimaryValue(int value) override {
+            return this == m_self ? value + 1 : -1;
+        }
+
+        // Reached from the Secondary vtable through a this-adjusting thunk.
+        int SecondaryValue(int value) override {
+            return this == m_self ? value + 2 : -1;
+        }
+
+        Derived* m_self;
+    };
+
+    class VirtualBase {
+      public:
+        virtual int BaseValue(int value) {
+            return -1;
+        }
+
+        int m_base = 4;
+    };
+
+    // Primary keeps the virtual base away from offset zero.
+    class VirtualDerived: public Primary, public virtual VirtualBase {
+      public:
+        VirtualDerived() : m_self(this) {}
+
+        int BaseValue(int value) override {
+            return this == m_self ? value + 4 : -1;
+        }
+
+        VirtualDerived* m_self;
+    };
+
+    using ValueNoopHook = NoopMemberHookTemplate<int, int>;
+
+    class ThisRecordingHook {
+      public:
+        NOINLINE int Pre(int value) {
+            s_seenThis = this;
+            s_preCalls++;
+            KHook::SaveReturnValue(
+                KHook::Action::Ignore,
+                nullptr,
+                0,
+                nullptr,
+                nullptr,
+                false
+            );
+            return 0;
+        }
+
+        static inline const void* s_seenThis = nullptr;
+        static inline int s_preCalls = 0;
+    };
+
+    void SetUp() override {
+        derived.reset(new Derived());
+        virtualDerived.reset(new VirtualDerived());
+        primary = derived.get();
+        secondary = derived.get();
+        virtualBase = virtualDerived.get();
+        ThisRecordingHook::s_seenThis = nullptr;
+        ThisRecordingHook::s_preCalls = 0;
+    }
+
+    void TearDown() override {
+        derived.reset();
+        virtualDerived.reset();
+    }
+
+    // The pointer the caller passes as `this` on the given path.
+    const void* CallerThis(VirtualPath path) const {
+        switch (path) {
+            case VirtualPath::PrimaryBase:
+                return primary;
+            case VirtualPath::SecondaryBase:
+            case VirtualPath::SecondaryThunk:
+                return secondary;
+            default:
+                return virtualBase;
+        }
+    }
+
+    int VtableIndex(VirtualPath path) const {
+        switch (path) {
+            case VirtualPath::PrimaryBase:
+                return KHook::GetVtableIndex(&Primary::PrimaryValue);
+            case VirtualPath::SecondaryBase:
+                return KHook::GetVtableIndex(&Secondary::Inherited);
+            case VirtualPath::SecondaryThunk:
+                return KHook::GetVtableIndex(&Secondary::SecondaryValue);
+            default:
+                return KHook::GetVtableIndex(&VirtualBase::BaseValue);
+        }
+    }
+
+    static int Expected(VirtualPath path, int value) {
+        switch (path) {
+            case VirtualPath::PrimaryBase:
+                return value + 1;
+            case VirtualPath::SecondaryBase:
+                return value + 3;
+            case VirtualPath::SecondaryThunk:
+                return value + 2;
+            default:
+                return value + 4;
+        }
+    }
+
+    NOINLINE int Call(VirtualPath path, int value) {
+        switch (path) {
+            case VirtualPath::PrimaryBase:
+                return primary->PrimaryValue(value);
+            case VirtualPath::SecondaryBase:
+                return secondary->Inherited(value);
+            case VirtualPath::SecondaryThunk:
+                return secondary->SecondaryValue(value);
+            default:
+                return virtualBase->BaseValue(value);
+        }
+    }
+
+    HookHandle Install(VirtualPath path, void* pre) {
+        return HookHandle::SetupVirtualHook(
+            *(void***)(CallerThis(path)),
+            VtableIndex(path),
+            nullptr,
+            KHook::ExtractMFP(&ValueNoopHook::OnRemoved),
+            pre,
+            KHook::ExtractMFP(&ValueNoopHook::PrePostNoop),
+            KHook::ExtractMFP(&ValueNoopHook::MakeReturn),
+            KHook::ExtractMFP(&ValueNoopHook::CallOriginal),
+            false
+        );
+    }
+
+    ScopedCallbackLogging m_quiet {false};
+    std::unique_ptr<Derived> derived;
+    std::unique_ptr<VirtualDerived> virtualDerived;
+    Primary* primary = nullptr;
+    Secondary* secondary = nullptr;
+    VirtualBase* virtualBase = nullptr;
+};
+
+TEST_F(MultipleInheritanceHookTest, CallbacksSeeCallerThis) {
+    ASSERT_NE(CallerThis(VirtualPath::SecondaryThunk), (void*)derived.get())
+        << "Secondary base should live at an offset in the derived object";
+    ASSERT_NE(CallerThis(VirtualPath::VirtualBaseThunk), virtualDerived.get())
+        << "Virtual base should live at an offset in the derived object";
+
+    for (VirtualPath path : kPaths) {
+        SCOPED_TRACE(PathName(path));
+        ASSERT_EQ(Call(path, 10), Expected(path, 10))
+            << "Unhooked call should reach the final overrider";
+
+        HookHandle hook =
+            Install(path, KHook::ExtractMFP(&ThisRecordingHook::Pre));
+        ASSERT_TRUE(hook.Valid()) << "Hook setup should succeed";
+
+        ThisRecordingHook::s_seenThis = nullptr;
+        ThisRecordingHook::s_preCalls = 0;
+        EXPECT_EQ(Call(path, 20), Expected(path, 20))
+            << "Original should still get the adjusted this";
+        EXPECT_EQ(ThisRecordingHook::s_preCalls, 1)
+            << "Pre callback should run once";
+        EXPECT_EQ(ThisRecordingHook::s_seenThis, CallerThis(path))
+            << "Callback should see the pointer the caller passed";
+
+        // The other paths go through other slots or other vtables.
+        for (VirtualPath other : kPaths) {
+            if (other != path) {
+                EXPECT_EQ(Call(other, 30), Expected(other, 30));
+            }
+        }
+        EXPECT_EQ(ThisRecordingHook::s_preCalls, 1)
+            << "Only the hooked path should reach the callback";
+
+        hook.Remove();
+        EXPECT_EQ(Call(path, 40), Expected(path, 40))
+            << "Method should behave after hook removal";
+        EXPECT_EQ(ThisRecordingHook::s_preCalls, 1)
+            << "Pre callback should not run after hook removal";
+    }
+}
+
+TEST_F(MultipleInheritanceHookTest, BenchmarkThunkPaths) {
+    BENCHMARK_ONLY();
+
+    std::size_t iterations = BenchIterations(1000000);
+    std::uint64_t badCalls = 0;
+    double primaryTax = 0.0;
+    for (VirtualPath path : kPaths) {
+        auto call = [&](std::size_t i) {
+            int value = (int)(i & 0xFFFF);
+            badCalls += Call(path, value) == Expected(path, value) ? 0 : 1;
+        };
+
+        PreciseMeasurement direct = MeasurePrecise(iterations, call);
+        HookHandle hook = Install(
+            path,
+            KHook::ExtractMFP(&ValueNoopHook::PrePostNoop)
+        );
+        ASSERT_TRUE(hook.Valid()) << "Hook setup should succeed";
+        PreciseMeasurement hooked = MeasurePrecise(iterations, call);
+        hook.Remove();
+
+        double tax = hooked.ns - direct.ns;
+        if (path == VirtualPath::PrimaryBase) {
+            primaryTax = tax;
+        }
+
+        std::string name(PathName(path));
+        ReportPrecise((name + ".direct").c_str(), direct);
+        ReportPrecise((name + ".hooked").c_str(), hooked);
+        ReportMetric((name + ".tax").c_str(), tax, "ns");
+        ReportMetric(
+            (name + ".tax_over_primary").c_str(),
+            tax - primaryTax,
+            "ns"
+        );
+    }
+
+    EXPECT_EQ(badCalls, 0u)
+        << "Calls should reach the final overrider with the right this";
+}
@@ -0,0 +1,199 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <khook.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "codegen.hpp"
+#include "hooks.hpp"
+#include "main.hpp"
+#include "targets.hpp"
+
+class FarJitHookTest: public ::testing::Test {
+  protected:
+    static constexpr std::uint64_t kFarDistance = (std::uint64_t)1 << 31;
+
+    void SetUp() override {
+#if !defined(__linux__)
+        GTEST_SKIP() << "Far executable buffers are only set up on Linux";
+#endif
+        if (sizeof(void*) < 8) {
+            GTEST_SKIP() << "Every address is within reach of a rel32 on x86";
+        }
+
+        code = AllocateCodeBufferAwayFrom(
+            BenchIterations(1024),
+            (const void*)&GetGeneratedFunction,
+            kFarDistance
+        );
+        ASSERT_TRUE(code) << "Should map code more than 2GB from the binary";
+        GeneratedCountingHook::s_calls = 0;
+    }
+
+    void TearDown() override {
+        m_hooks.clear();
+        RemoveRaw();
+        code.reset();
+    }
+
+    int Install(GeneratedFunction function, void* pre) {
+        HookHandle hook = HookHandle::SetupHook(
+            (void*)function,
+            nullptr,
+            (void*)&GeneratedStaticHook::OnRemoved,
+            pre,
+            (void*)&GeneratedStaticHook::PrePostNoop,
+            (void*)&GeneratedStaticHook::MakeReturn,
+            (void*)&GeneratedStaticHook::CallOriginal,
+            false
+        );
+        int hookId = hook.Id();
+        if (hook.Valid()) {
+            m_hooks.push_back(std::move(hook));
+        }
+        return hookId;
+    }
+
+    void RemoveAll() {
+        m_hooks.clear();
+    }
+
+    // Straight to KHook, a HookHandle would add the registry's lock and
+    // bookkeeping to the measured install and remove times.
+    int InstallRaw(GeneratedFunction function) {
+        int hookId = KHook::SetupHook(
+            (void*)function,
+            nullptr,
+            (void*)&GeneratedStaticHook::OnRemoved,
+            (void*)&GeneratedStaticHook::PrePostNoop,
+            (void*)&GeneratedStaticHook::PrePostNoop,
+            (void*)&GeneratedStaticHook::MakeReturn,
+            (void*)&GeneratedStaticHook::CallOriginal,
+            false
+        );
+        if (hookId != KHook::INVALID_HOOK) {
+            m_rawHookIds.push_back(hookId);
+        }
+        return hookId;
+    }
+
+    void RemoveRaw() {
+        for (int hookId : m_rawHookIds) {
+            KHook::RemoveHook(hookId, false);
+        }
+        m_rawHookIds.clear();
+    }
+
+    ScopedCallbackLogging m_quiet {false};
+    std::unique_ptr<CodeBuffer> code;
+    std::vector<HookHandle> m_hooks;
+    std::vector<int> m_rawHookIds;
+};
+
+TEST_F(FarJitHookTest, HookFarFunctions) {
+    std::size_t count = code->Count();
+    for (std::size_t i = 0; i < count; i++) {
+        ASSERT_NE(
+            Install(code->Function(i), (void*)&GeneratedCountingHook::Pre),
+            KHook::INVALID_HOOK
+        ) << "Hook setup on far function " << i << " should succeed";
+    }
+
+    for (std::size_t i = 0; i < count; i++) {
+        GeneratedObject obj {};
+        int result = code->Function(i)(&obj, (int)i + 1);
+        ASSERT_EQ(result, (int)i + 1) << "Far function " << i
+                                      << " should return the original value";
+        ASSERT_EQ(obj.m_lastTarget, (int)i)
+            << "Hook should call the original far function " << i;
+    }
+    EXPECT_EQ(GeneratedCountingHook::s_calls, count)
+        << "Pre callback should run once per call";
+
+    RemoveAll();
+    GeneratedCountingHook::s_calls = 0;
+
+    for (std::size_t i = 0; i < count; i++) {
+        GeneratedObject obj {};
+        ASSERT_EQ(code->Function(i)(&obj, 7), 7)
+            << "Far function should behave after hook removal";
+    }
+    EXPECT_EQ(GeneratedCountingHook::s_calls, 0u)
+        << "Pre callback should not run after hook removal";
+
+    // The buffer is unmapped while KHook may still hold trampolines for it,
+    // which must not matter once every hook on it was removed.
+    code.reset();
+
+    code = AllocateCodeBufferAwayFrom(
+        16,
+        (const void*)&GetGeneratedFunction,
+        kFarDistance
+    );
+    ASSERT_TRUE(code) << "Should map code more than 2GB from the binary";
+    ASSERT_NE(
+        Install(code->Function(0), (void*)&GeneratedCountingHook::Pre),
+        KHook::INVALID_HOOK
+    ) << "Hook setup in a remapped buffer should succeed";
+
+    GeneratedObject obj {};
+    EXPECT_EQ(code->Function(0)(&obj, 9), 9)
+        << "Hooked function in a remapped buffer should behave";
+    EXPECT_EQ(GeneratedCountingHook::s_calls, 1u)
+        << "Hook in a remapped buffer should run";
+}
+
+TEST_F(FarJitHookTest, BenchmarkFarVersusNear) {
+    BENCHMARK_ONLY();
+
+    std::size_t count = std::min(code->Count(), kGeneratedTargetCount);
+    std::size_t calls = BenchIterations(1000000);
+    ReportMetric(
+        "far_distance",
+        (double)code->DistanceFrom((const void*)&GetGeneratedFunction) / 1e9,
+        "GB"
+    );
+
+    for (bool far : {false, true}) {
+        const char* name = far ? "far" : "near";
+        auto target = [&](std::size_t i) {
+            return far ? code->Function(i) : GetGeneratedFunction(i);
+        };
+
+        double unhooked = MeasureNsPerOp(calls, [&](std::size_t i) {
+            GeneratedObject obj {};
+            DoNotOptimize(target(i % count)(&obj, (int)i));
+        });
+
+        m_rawHookIds.reserve(count);
+        std::int64_t start = GetWallTimeNs();
+        for (std::size_t i = 0; i < count; i++) {
+            ASSERT_NE(InstallRaw(target(i)), KHook::INVALID_HOOK)
+                << "Hook setup should succeed";
+        }
+        double install = (double)(GetWallTimeNs() - start) / (double)count;
+
+        double hooked = MeasureNsPerOp(calls, [&](std::size_t i) {
+            GeneratedObject obj {};
+            DoNotOptimize(target(i % count)(&obj, (int)i));
+        });
+
+        start = GetWallTimeNs();
+        RemoveRaw();
+        double remove = (double)(GetWallTimeNs() - start) / (double)count;
+
+        std::string prefix(name);
+        ReportMetric((prefix + ".install").c_str(), install, "ns/hook");
+        ReportMetric((prefix + ".remove").c_str(), remove, "ns/hook");
+        ReportMetric((prefix + ".unhooked_call").c_str(), unhooked, "ns");
+        ReportMetric((prefix + ".hooked_call").c_str(), hooked, "ns");
+        ReportMetric(
+            (prefix + ".hook_overhead").c_str(),
+            hooked - unhooked,
+            "ns"
+        );
+    }
+}
@@ -4,11 +4,35 @@
 
 #include <khook.hpp>
 
+#include "bench.hpp"
+#include "hooks.hpp"
+#include "options.hpp"
+#include "resources.hpp"
+
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
+    if (!ParseTestRunnerOptions(argc, argv)) {
+        return 1;
+    }
+
+    OpenBenchReport();
+
+    ResourceBudget budget;
+    budget.wallMs = g_options.budgetWallMs;
+    budget.cpuMs = g_options.budgetCpuMs;
+    budget.peakRssKb = g_options.budgetPeakRssKb;
+    budget.allocations = g_options.budgetAllocations;
+
+    ::testing::TestEventListeners& listeners =
+        ::testing::UnitTest::GetInstance()->listeners();
+    listeners.Append(
+        new ResourceListener(budget, g_options.resourceReport.c_str())
+    );
+    listeners.Append(new HookLeakListener());
+
     int result = RUN_ALL_TESTS();
 
     KHook::Shutdown();
 
     return result;
-}
\ No newline at end of file
+}
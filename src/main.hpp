@@ -1,9 +1,13 @@
 #pragma once
 
+#include <atomic>
 #include <iostream>
 #include <khook.hpp>
 #include <type_traits>
 
+#include "hooks.hpp"
+#include "trace.hpp"
+
 #if defined(_MSC_VER)
     #define NOINLINE __declspec(noinline)
 #elif defined(__GNUC__) || defined(__clang__)
@@ -13,6 +17,65 @@
     #define NOINLINE
 #endif
 
+enum class HookKind {
+    Static,
+    Virtual
+};
+
+inline const char* HookKindName(HookKind kind) {
+    return kind == HookKind::Static ? "Static" : "Virtual";
+}
+
+#pragma region CallbackLogging
+
+// Benchmarks turn the callback logging off so that console output doesn't
+// dominate the measured cost of a hooked call.
+inline std::atomic<bool> g_callbackLogging {true};
+
+template<typename... Parts>
+inline void LogCallback(Parts&&... parts) {
+    if (g_callbackLogging.load(std::memory_order_relaxed)) {
+        (std::cout << ... << parts) << std::endl;
+    }
+}
+
+class ScopedCallbackLogging {
+  public:
+    explicit ScopedCallbackLogging(bool enabled) :
+        m_previous(g_callbackLogging.exchange(enabled)) {}
+
+    ~ScopedCallbackLogging() {
+        g_callbackLogging.store(m_previous);
+    }
+
+  private:
+    bool m_previous;
+};
+
+#pragma endregion
+
+#pragma region CallbackTracing
+
+// Once the trace sink is open the Noop templates also record every callback
+// into it, which keeps up with far more calls than the text log.
+inline void TraceCallback(TracePhase phase) {
+    if (g_traceSink.IsOpen()) {
+        g_traceSink.Record(
+            phase,
+            KHook::GetOriginalFunction(),
+            KHook::INVALID_HOOK
+        );
+    }
+}
+
+inline void TraceRemoved(int hookId) {
+    if (g_traceSink.IsOpen()) {
+        g_traceSink.Record(TracePhase::Removed, nullptr, hookId);
+    }
+}
+
+#pragma endregion
+
 #pragma region StaticHookTemplate
 
 template<typename Ret, typename... Args>
@@ -26,7 +89,8 @@ class NoopStaticHookTemplate {
 
 template<typename Ret, typename... Args>
 NOINLINE Ret NoopStaticHookTemplate<Ret, Args...>::PrePostNoop(Args... args) {
-    std::cout << "PrePostNoop()" << std::endl;
+    LogCallback("PrePostNoop()");
+    TraceCallback(TracePhase::Callback);
     KHook::SaveReturnValue(
         KHook::Action::Ignore,
         nullptr,
@@ -44,7 +108,8 @@ NOINLINE Ret NoopStaticHookTemplate<Ret, Args...>::PrePostNoop(Args... args) {
 
 template<typename Ret, typename... Args>
 NOINLINE Ret NoopStaticHookTemplate<Ret, Args...>::CallOriginal(Args... args) {
-    std::cout << "CallOriginal()" << std::endl;
+    LogCallback("CallOriginal()");
+    TraceCallback(TracePhase::CallOriginal);
     auto original =
         reinterpret_cast<Ret (*)(Args...)>(KHook::GetOriginalFunction());
     if constexpr (std::is_same<Ret, void>::value) {
@@ -74,7 +139,8 @@ NOINLINE Ret NoopStaticHookTemplate<Ret, Args...>::CallOriginal(Args... args) {
 
 template<typename Ret, typename... Args>
 NOINLINE Ret NoopStaticHookTemplate<Ret, Args...>::MakeReturn(Args... args) {
-    std::cout << "MakeReturn()" << std::endl;
+    LogCallback("MakeReturn()");
+    TraceCallback(TracePhase::MakeReturn);
     if constexpr (std::is_same<Ret, void>::value) {
         KHook::DestroyReturnValue();
         return;
@@ -87,7 +153,9 @@ NOINLINE Ret NoopStaticHookTemplate<Ret, Args...>::MakeReturn(Args... args) {
 
 template<typename Ret, typename... Args>
 NOINLINE void NoopStaticHookTemplate<Ret, Args...>::OnRemoved(int hookId) {
-    std::cout << "OnRemoved(" << std::dec << hookId << ")" << std::endl;
+    LogCallback("OnRemoved(", std::dec, hookId, ")");
+    TraceRemoved(hookId);
+    g_hookRegistry.NotifyRemoved(hookId);
 }
 
 #pragma endregion
@@ -105,7 +173,8 @@ class NoopMemberHookTemplate {
 
 template<typename Ret, typename... Args>
 NOINLINE Ret NoopMemberHookTemplate<Ret, Args...>::PrePostNoop(Args... args) {
-    std::cout << "PrePostNoop()" << std::endl;
+    LogCallback("PrePostNoop()");
+    TraceCallback(TracePhase::Callback);
     KHook::SaveReturnValue(
         KHook::Action::Ignore,
         nullptr,
@@ -123,7 +192,8 @@ NOINLINE Ret NoopMemberHookTemplate<Ret, Args...>::PrePostNoop(Args... args) {
 
 template<typename Ret, typename... Args>
 NOINLINE Ret NoopMemberHookTemplate<Ret, Args...>::CallOriginal(Args... args) {
-    std::cout << "CallOriginal()" << std::endl;
+    LogCallback("CallOriginal()");
+    TraceCallback(TracePhase::CallOriginal);
     auto original = reinterpret_cast<Ret(__thiscall*)(void*, Args...)>(
         KHook::GetOriginalFunction()
     );
@@ -154,7 +224,8 @@ NOINLINE Ret NoopMemberHookTemplate<Ret, Args...>::CallOriginal(Args... args) {
 
 template<typename Ret, typename... Args>
 NOINLINE Ret NoopMemberHookTemplate<Ret, Args...>::MakeReturn(Args... args) {
-    std::cout << "MakeReturn()" << std::endl;
+    LogCallback("MakeReturn()");
+    TraceCallback(TracePhase::MakeReturn);
     if constexpr (std::is_same<Ret, void>::value) {
         KHook::DestroyReturnValue();
         return;
@@ -167,7 +238,9 @@ NOINLINE Ret NoopMemberHookTemplate<Ret, Args...>::MakeReturn(Args... args) {
 
 template<typename Ret, typename... Args>
 NOINLINE void NoopMemberHookTemplate<Ret, Args...>::OnRemoved(int hookId) {
-    std::cout << "OnRemoved(" << std::dec << hookId << ")" << std::endl;
+    LogCallback("OnRemoved(", std::dec, hookId, ")");
+    TraceRemoved(hookId);
+    g_hookRegistry.NotifyRemoved(hookId);
 }
 
 #pragma endregion
\ No newline at end of file
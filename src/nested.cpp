@@ -0,0 +1,306 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <khook.hpp>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.hpp"
+#include "codegen.hpp"
+#include "hooks.hpp"
+#include "main.hpp"
+#include "targets.hpp"
+
+#pragma region LazyHooks
+
+// Every worker thread calls its own trigger target. When armed, the trigger's
+// pre callback hooks the next lazy target of the thread, alternating between
+// static and virtual ones, the way an event system hooks on first use.
+struct LazyWorker {
+    std::size_t first = 0;
+    std::size_t next = 0;
+    bool armed = false;
+    int lastHookId = KHook::INVALID_HOOK;
+    std::int64_t installNs = 0;
+    std::uint64_t lazyCalls = 0;
+    std::vector<int> hookIds;
+};
+
+static thread_local LazyWorker* t_lazyWorker = nullptr;
+static CodeBuffer* s_lazyCode = nullptr;
+static GeneratedInstance* s_lazyInstance = nullptr;
+
+class LazyHook {
+  public:
+    NOINLINE static int Pre(GeneratedObject* obj, int value) {
+        t_lazyWorker->lazyCalls++;
+        KHook::SaveReturnValue(
+            KHook::Action::Ignore,
+            nullptr,
+            0,
+            nullptr,
+            nullptr,
+            false
+        );
+        return 0;
+    }
+
+    NOINLINE int PreMember(GeneratedObject* obj, int value) {
+        return Pre(obj, value);
+    }
+
+    static bool IsVirtual(std::size_t index) {
+        return index & 1;
+    }
+
+    static int Install(std::size_t index) {
+        if (IsVirtual(index)) {
+            return KHook::SetupVirtualHook(
+                s_lazyInstance->Vtable(),
+                (int)index,
+                nullptr,
+                KHook::ExtractMFP(&GeneratedMemberHook::OnRemoved),
+                KHook::ExtractMFP(&LazyHook::PreMember),
+                KHook::ExtractMFP(&GeneratedMemberHook::PrePostNoop),
+                KHook::ExtractMFP(&GeneratedMemberHook::MakeReturn),
+                KHook::ExtractMFP(&GeneratedMemberHook::CallOriginal),
+                false
+            );
+        }
+        return KHook::SetupHook(
+            (void*)s_lazyCode->Function(index),
+            nullptr,
+            (void*)&GeneratedStaticHook::OnRemoved,
+            (void*)&LazyHook::Pre,
+            (void*)&GeneratedStaticHook::PrePostNoop,
+            (void*)&GeneratedStaticHook::MakeReturn,
+            (void*)&GeneratedStaticHook::CallOriginal,
+            false
+        );
+    }
+
+    static int Call(std::size_t index, int value) {
+        GeneratedObject obj {};
+        if (IsVirtual(index)) {
+            return s_lazyInstance->Call(index, &obj, value);
+        }
+        return s_lazyCode->Function(index)(&obj, value);
+    }
+};
+
+class TriggerHook {
+  public:
+    NOINLINE static int Pre(GeneratedObject* obj, int value) {
+        LazyWorker* worker = t_lazyWorker;
+        if (worker->armed) {
+            std::int64_t start = GetWallTimeNs();
+            int hookId = LazyHook::Install(worker->next);
+            worker->installNs = GetWallTimeNs() - start;
+            worker->lastHookId = hookId;
+            if (hookId != KHook::INVALID_HOOK) {
+                worker->hookIds.push_back(hookId);
+            }
+        }
+        KHook::SaveReturnValue(
+            KHook::Action::Ignore,
+            nullptr,
+            0,
+            nullptr,
+            nullptr,
+            false
+        );
+        return 0;
+    }
+
+    NOINLINE int PreMember(GeneratedObject* obj, int value) {
+        return Pre(obj, value);
+    }
+};
+
+#pragma endregion
+
+class NestedInstallBenchmark: public ::testing::TestWithParam<HookKind> {
+  protected:
+    struct WorkerResult {
+        LatencyHistogram plainCall;
+        LatencyHistogram installingCall;
+        LatencyHistogram install;
+        std::uint64_t badCalls = 0;
+        std::uint64_t failedInstalls = 0;
+        std::uint64_t missedHooks = 0;
+    };
+
+    void TearDown() override {
+        m_triggers.clear();
+        for (int hookId : m_lazyHookIds) {
+            KHook::RemoveHook(hookId, false);
+        }
+        m_lazyHookIds.clear();
+        s_lazyCode = nullptr;
+        s_lazyInstance = nullptr;
+    }
+
+    HookHandle InstallTrigger(std::size_t index) {
+        if (GetParam() == HookKind::Static) {
+            return HookHandle::SetupHook(
+                (void*)GetGeneratedFunction(index),
+                nullptr,
+                (void*)&GeneratedStaticHook::OnRemoved,
+                (void*)&TriggerHook::Pre,
+                (void*)&GeneratedStaticHook::PrePostNoop,
+                (void*)&GeneratedStaticHook::MakeReturn,
+                (void*)&GeneratedStaticHook::CallOriginal,
+                false
+            );
+        }
+        return HookHandle::SetupVirtualHook(
+            triggers->Vtable(),
+            (int)index,
+            nullptr,
+            KHook::ExtractMFP(&GeneratedMemberHook::OnRemoved),
+            KHook::ExtractMFP(&TriggerHook::PreMember),
+            KHook::ExtractMFP(&GeneratedMemberHook::PrePostNoop),
+            KHook::ExtractMFP(&GeneratedMemberHook::MakeReturn),
+            KHook::ExtractMFP(&GeneratedMemberHook::CallOriginal),
+            false
+        );
+    }
+
+    int CallTrigger(std::size_t index, int value) {
+        GeneratedObject obj {};
+        if (GetParam() == HookKind::Static) {
+            return GetGeneratedFunction(index)(&obj, value);
+        }
+        return triggers->Call(index, &obj, value);
+    }
+
+    void RunWorker(
+        std::size_t index,
+        std::size_t installs,
+        LazyWorker& worker,
+        WorkerResult& result
+    ) {
+        t_lazyWorker = &worker;
+        worker.first = worker.next = index * installs;
+
+        // Same calls without installing anything, as the baseline.
+        for (std::size_t i = 0; i < installs; i++) {
+            std::uint64_t start = BenchTicksBegin();
+            int value = (int)(i & 0xFFFF);
+            bool ok = CallTrigger(index, value) == value;
+            result.plainCall.Record(BenchElapsedNs(start));
+            result.badCalls += ok ? 0 : 1;
+        }
+
+        worker.armed = true;
+        for (std::size_t i = 0; i < installs; i++) {
+            std::uint64_t start = BenchTicksBegin();
+            int value = (int)(i & 0xFFFF);
+            bool ok = CallTrigger(index, value) == value;
+            result.installingCall.Record(BenchElapsedNs(start));
+
+            if (worker.lastHookId == KHook::INVALID_HOOK) {
+                result.failedInstalls++;
+            } else {
+                result.install.Record(worker.installNs);
+
+                // The new hook has to be live for the very next call.
+                std::uint64_t before = worker.lazyCalls;
+                ok = ok && LazyHook::Call(worker.next, value) == value;
+                result.missedHooks += worker.lazyCalls == before + 1 ? 0 : 1;
+            }
+            result.badCalls += ok ? 0 : 1;
+            worker.lastHookId = KHook::INVALID_HOOK;
+            worker.next++;
+        }
+        worker.armed = false;
+        t_lazyWorker = nullptr;
+    }
+
+    ScopedCallbackLogging m_quiet {false};
+    std::unique_ptr<GeneratedInstance> triggers;
+    std::unique_ptr<CodeBuffer> lazyCode;
+    std::unique_ptr<GeneratedInstance> lazyInstance;
+    std::vector<HookHandle> m_triggers;
+    // Raw ids, the triggers install these with KHook::SetupHook directly so
+    // that the timed install is KHook's alone.
+    std::vector<int> m_lazyHookIds;
+};
+
+TEST_P(NestedInstallBenchmark, InstallFromInsideCallbacks) {
+    BENCHMARK_ONLY();
+
+    std::size_t threads =
+        std::min<std::size_t>(BenchThreads(), kGeneratedTargetCount);
+    std::size_t installs = BenchIterations(2000);
+    ReportMetric("threads", (double)threads, "threads");
+
+    triggers.reset(new GeneratedInstance(threads));
+    lazyCode.reset(new CodeBuffer(threads * installs));
+    ASSERT_TRUE(lazyCode->Valid()) << "Should map the lazy static targets";
+    lazyInstance.reset(new GeneratedInstance(threads * installs));
+    s_lazyCode = lazyCode.get();
+    s_lazyInstance = lazyInstance.get();
+
+    for (std::size_t t = 0; t < threads; t++) {
+        m_triggers.push_back(InstallTrigger(t));
+        ASSERT_TRUE(m_triggers.back().Valid()) << "Hook setup should succeed";
+    }
+
+    std::vector<LazyWorker> workers(threads);
+    std::vector<WorkerResult> results(threads);
+    std::vector<std::thread> running;
+    unsigned int cpus = std::max(1u, std::thread::hardware_concurrency());
+    BenchNsPerTick();
+    for (std::size_t t = 0; t < threads; t++) {
+        running.emplace_back([&, t]() {
+            ScopedCpuPin pin((int)(t % cpus));
+            RunWorker(t, installs, workers[t], results[t]);
+        });
+    }
+    for (std::thread& thread : running) {
+        thread.join();
+    }
+
+    WorkerResult total;
+    for (std::size_t t = 0; t < threads; t++) {
+        total.plainCall.Merge(results[t].plainCall);
+        total.installingCall.Merge(results[t].installingCall);
+        total.install.Merge(results[t].install);
+        total.badCalls += results[t].badCalls;
+        total.failedInstalls += results[t].failedInstalls;
+        total.missedHooks += results[t].missedHooks;
+        m_lazyHookIds.insert(
+            m_lazyHookIds.end(),
+            workers[t].hookIds.begin(),
+            workers[t].hookIds.end()
+        );
+    }
+
+    LatencySummary plain = total.plainCall.Summarize();
+    LatencySummary installing = total.installingCall.Summarize();
+    ReportMetric("nested_installs", (double)total.install.Count(), "hooks");
+    ReportLatencies("plain_call", plain);
+    ReportLatencies("installing_call", installing);
+    ReportLatencies("nested_install", total.install.Summarize());
+    ReportMetric("added_latency.p50", installing.p50 - plain.p50, "ns");
+    ReportMetric("added_latency.p99", installing.p99 - plain.p99, "ns");
+
+    EXPECT_EQ(total.badCalls, 0u)
+        << "Calls should keep the original value while hooks are installed";
+    EXPECT_EQ(total.failedInstalls, 0u)
+        << "Hook setup from inside a callback should succeed";
+    EXPECT_EQ(total.missedHooks, 0u)
+        << "Hooks installed inside a call should run on the next call";
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Hooks,
+    NestedInstallBenchmark,
+    ::testing::Values(HookKind::Static, HookKind::Virtual),
+    [](const ::testing::TestParamInfo<HookKind>& info) {
+        return std::string(HookKindName(info.param));
+    }
+);
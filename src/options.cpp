@@ -0,0 +1,70 @@
+#include "options.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+TestRunnerOptions g_options;
+
+static bool ParseOption(const char* arg, const char* name, const char** value) {
+    size_t length = strlen(name);
+    if (strncmp(arg, name, length) != 0 || arg[length] != '=') {
+        return false;
+    }
+    *value = arg + length + 1;
+    return true;
+}
+
+static std::vector<int> ParseIntList(const char* value) {
+    std::vector<int> list;
+    while (*value) {
+        char* end = nullptr;
+        list.push_back((int)strtol(value, &end, 10));
+        if (end == value) {
+            break;
+        }
+        value = *end == ',' ? end + 1 : end;
+    }
+    return list;
+}
+
+bool ParseTestRunnerOptions(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        const char* value = nullptr;
+        if (ParseOption(argv[i], "--resource_report", &value)) {
+            g_options.resourceReport = value;
+        } else if (ParseOption(argv[i], "--budget_wall_ms", &value)) {
+            g_options.budgetWallMs = atof(value);
+        } else if (ParseOption(argv[i], "--budget_cpu_ms", &value)) {
+            g_options.budgetCpuMs = atof(value);
+        } else if (ParseOption(argv[i], "--budget_peak_rss_kb", &value)) {
+            g_options.budgetPeakRssKb = atoll(value);
+        } else if (ParseOption(argv[i], "--budget_allocations", &value)) {
+            g_options.budgetAllocations = atoll(value);
+        } else if (strcmp(argv[i], "--bench") == 0) {
+            g_options.bench = true;
+        } else if (ParseOption(argv[i], "--bench_report", &value)) {
+            g_options.benchReport = value;
+        } else if (ParseOption(argv[i], "--bench_scale", &value)) {
+            g_options.benchScale = atof(value);
+        } else if (ParseOption(argv[i], "--bench_threads", &value)) {
+            g_options.benchThreads = atoi(value);
+        } else if (ParseOption(argv[i], "--bench_trials", &value)) {
+            g_options.benchTrials = atoi(value);
+        } else if (ParseOption(argv[i], "--perf_hitm_event", &value)) {
+            g_options.perfHitmEvent = strtoull(value, nullptr, 0);
+        } else if (ParseOption(argv[i], "--churn_rates", &value)) {
+            g_options.churnRates = ParseIntList(value);
+        } else if (ParseOption(argv[i], "--soak_seconds", &value)) {
+            g_options.soakSeconds = atoi(value);
+        } else if (ParseOption(argv[i], "--soak_report", &value)) {
+            g_options.soakReport = value;
+        } else if (ParseOption(argv[i], "--replay_trace", &value)) {
+            g_options.replayTrace = value;
+        } else {
+            std::cerr << "Unknown option: " << argv[i] << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct TestRunnerOptions {
+    std::string resourceReport;
+    double budgetWallMs = 2000.0;
+    double budgetCpuMs = 2000.0;
+    long long budgetPeakRssKb = 64 * 1024;
+    long long budgetAllocations = 1000000;
+    bool bench = false;
+    std::string benchReport;
+    double benchScale = 1.0;
+    int benchThreads = 0;
+    int benchTrials = 15;
+    std::uint64_t perfHitmEvent = 0;
+    std::vector<int> churnRates = {0, 100, 1000, 10000};
+    int soakSeconds = 0;
+    std::string soakReport;
+    std::string replayTrace;
+};
+
+extern TestRunnerOptions g_options;
+
+bool ParseTestRunnerOptions(int argc, char** argv);
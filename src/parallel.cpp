@@ -0,0 +1,187 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <khook.hpp>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.hpp"
+#include "main.hpp"
+#include "targets.hpp"
+
+class ParallelInstallBenchmark: public ::testing::TestWithParam<HookKind> {
+  protected:
+    struct WorkerResult {
+        LatencyHistogram install;
+        LatencyHistogram remove;
+        std::uint64_t failedInstalls = 0;
+        std::uint64_t wrongResults = 0;
+    };
+
+    int Install(GeneratedInstance* instance, std::size_t target) {
+        if (GetParam() == HookKind::Static) {
+            return KHook::SetupHook(
+                (void*)GetGeneratedFunction(target),
+                nullptr,
+                (void*)&GeneratedStaticHook::OnRemoved,
+                (void*)&GeneratedStaticHook::PrePostNoop,
+                (void*)&GeneratedStaticHook::PrePostNoop,
+                (void*)&GeneratedStaticHook::MakeReturn,
+                (void*)&GeneratedStaticHook::CallOriginal,
+                false
+            );
+        }
+        return KHook::SetupVirtualHook(
+            instance->Vtable(),
+            (int)target,
+            nullptr,
+            KHook::ExtractMFP(&GeneratedMemberHook::OnRemoved),
+            KHook::ExtractMFP(&GeneratedMemberHook::PrePostNoop),
+            KHook::ExtractMFP(&GeneratedMemberHook::PrePostNoop),
+            KHook::ExtractMFP(&GeneratedMemberHook::MakeReturn),
+            KHook::ExtractMFP(&GeneratedMemberHook::CallOriginal),
+            false
+        );
+    }
+
+    int Call(GeneratedInstance* instance, std::size_t target, int value) {
+        GeneratedObject obj {};
+        int result = 0;
+        if (GetParam() == HookKind::Static) {
+            result = GetGeneratedFunction(target)(&obj, value);
+        } else {
+            result = instance->Call(target, &obj, value);
+        }
+        return obj.m_testValue == value ? result : -1;
+    }
+
+    ScopedCallbackLogging m_quiet {false};
+};
+
+TEST_P(ParallelInstallBenchmark, InstallThroughput) {
+    BENCHMARK_ONLY();
+
+    // Every thread needs at least one target of its own.
+    unsigned int maxThreads = (unsigned int)std::min<std::size_t>(
+        BenchThreads(),
+        kGeneratedTargetCount
+    );
+    std::size_t targetsPerThread =
+        std::min<std::size_t>(256, kGeneratedTargetCount / maxThreads);
+    std::size_t rounds = BenchIterations(20);
+
+    std::vector<unsigned int> threadCounts;
+    for (unsigned int threads = 1; threads < maxThreads; threads *= 2) {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(maxThreads);
+
+    ReportMetric("targets_per_thread", (double)targetsPerThread, "targets");
+
+    for (unsigned int threads : threadCounts) {
+        // Static targets are disjoint slices of the generated functions,
+        // virtual targets are slots of a vtable owned by a single thread.
+        std::vector<std::unique_ptr<GeneratedInstance>> instances;
+        for (unsigned int t = 0; t < threads; t++) {
+            instances.emplace_back(
+                new GeneratedInstance(targetsPerThread, t * targetsPerThread)
+            );
+        }
+
+        std::vector<WorkerResult> results(threads);
+        std::atomic<unsigned int> ready {0};
+        std::atomic<bool> start {false};
+        std::vector<std::thread> workers;
+
+        for (unsigned int t = 0; t < threads; t++) {
+            workers.emplace_back([&, t]() {
+                WorkerResult& result = results[t];
+                GeneratedInstance* instance = instances[t].get();
+                std::size_t first = t * targetsPerThread;
+                std::vector<int> hookIds(targetsPerThread);
+
+                ready++;
+                while (!start.load(std::memory_order_acquire)) {
+                    std::this_thread::yield();
+                }
+
+                for (std::size_t round = 0; round < rounds; round++) {
+                    for (std::size_t i = 0; i < targetsPerThread; i++) {
+                        std::size_t target =
+                            GetParam() == HookKind::Static ? first + i : i;
+                        std::int64_t begin = GetWallTimeNs();
+                        hookIds[i] = Install(instance, target);
+                        result.install.Record(GetWallTimeNs() - begin);
+                        if (hookIds[i] == KHook::INVALID_HOOK) {
+                            result.failedInstalls++;
+                        }
+                    }
+
+                    std::size_t probe =
+                        GetParam() == HookKind::Static ? first : 0;
+                    if (Call(instance, probe, (int)round + 1)
+                        != (int)round + 1) {
+                        result.wrongResults++;
+                    }
+
+                    for (std::size_t i = 0; i < targetsPerThread; i++) {
+                        if (hookIds[i] == KHook::INVALID_HOOK) {
+                            continue;
+                        }
+                        std::int64_t begin = GetWallTimeNs();
+                        KHook::RemoveHook(hookIds[i], false);
+                        result.remove.Record(GetWallTimeNs() - begin);
+                    }
+                }
+            });
+        }
+
+        while (ready.load() < threads) {
+            std::this_thread::yield();
+        }
+        std::int64_t begin = GetWallTimeNs();
+        start.store(true, std::memory_order_release);
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+        double seconds = (double)(GetWallTimeNs() - begin) / 1e9;
+
+        LatencyHistogram install;
+        LatencyHistogram remove;
+        std::uint64_t failedInstalls = 0;
+        std::uint64_t wrongResults = 0;
+        for (const WorkerResult& result : results) {
+            install.Merge(result.install);
+            remove.Merge(result.remove);
+            failedInstalls += result.failedInstalls;
+            wrongResults += result.wrongResults;
+        }
+
+        // The wall time covers removals and probe calls too, so this is the
+        // rate of whole cycles, the install latencies are reported below.
+        std::string name = "threads_" + std::to_string(threads);
+        ReportMetric(
+            (name + ".install_remove_cycles_per_sec").c_str(),
+            (double)install.Count() / seconds,
+            "cycles/s"
+        );
+        ReportLatencies((name + ".install").c_str(), install.Summarize());
+        ReportLatencies((name + ".remove").c_str(), remove.Summarize());
+
+        EXPECT_EQ(failedInstalls, 0u) << "Hook setup should succeed";
+        EXPECT_EQ(wrongResults, 0u)
+            << "Hooked targets should return the original value";
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Hooks,
+    ParallelInstallBenchmark,
+    ::testing::Values(HookKind::Static, HookKind::Virtual),
+    [](const ::testing::TestParamInfo<HookKind>& info) {
+        return std::string(HookKindName(info.param));
+    }
+);
@@ -0,0 +1,258 @@
+#include <gtest/gtest.h>
+
+#include <khook.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "hooks.hpp"
+#include "main.hpp"
+#include "resources.hpp"
+#include "targets.hpp"
+
+#if !defined(_WIN32)
+    #include <sys/wait.h>
+    #include <unistd.h>
+#endif
+
+// Mimics a server that installs its hooks in a master process and then forks
+// workers, which keep calling through the inherited hooks and also install
+// and remove hooks of their own.
+class PreforkHookTest: public ::testing::Test {
+  protected:
+    static constexpr std::size_t kMasterTargets = 16;
+    static constexpr std::size_t kWorkerTargets = 16;
+
+    struct WorkerResult {
+        std::uint64_t calls = 0;
+        std::uint64_t errors = 0;
+        std::uint64_t missedHooks = 0;
+        std::uint64_t failedInstalls = 0;
+        std::int64_t callDirtyKb = 0;
+        std::int64_t callExecDirtyKb = 0;
+        std::int64_t hookDirtyKb = 0;
+        std::int64_t hookExecDirtyKb = 0;
+    };
+
+    void SetUp() override {
+#if defined(_WIN32)
+        GTEST_SKIP() << "There is no fork() on Windows";
+#endif
+        instance.reset(new GeneratedInstance(kMasterTargets + kWorkerTargets));
+
+        for (std::size_t i = 0; i < kMasterTargets; i++) {
+            m_hooks.push_back(InstallStatic(i));
+            ASSERT_TRUE(m_hooks.back().Valid()) << "Hook setup should succeed";
+
+            m_hooks.push_back(InstallVirtual(i));
+            ASSERT_TRUE(m_hooks.back().Valid()) << "Hook setup should succeed";
+        }
+        GeneratedCountingHook::s_calls = 0;
+    }
+
+    void TearDown() override {
+        m_hooks.clear();
+        instance.reset();
+    }
+
+    static HookHandle InstallStatic(std::size_t index) {
+        return HookHandle::SetupHook(
+            (void*)GetGeneratedFunction(index),
+            nullptr,
+            (void*)&GeneratedStaticHook::OnRemoved,
+            (void*)&GeneratedCountingHook::Pre,
+            (void*)&GeneratedStaticHook::PrePostNoop,
+            (void*)&GeneratedStaticHook::MakeReturn,
+            (void*)&GeneratedStaticHook::CallOriginal,
+            false
+        );
+    }
+
+    HookHandle InstallVirtual(std::size_t index) {
+        return HookHandle::SetupVirtualHook(
+            instance->Vtable(),
+            (int)index,
+            nullptr,
+            KHook::ExtractMFP(&GeneratedMemberHook::OnRemoved),
+            KHook::ExtractMFP(&GeneratedCountingHook::PreMember),
+            KHook::ExtractMFP(&GeneratedMemberHook::PrePostNoop),
+            KHook::ExtractMFP(&GeneratedMemberHook::MakeReturn),
+            KHook::ExtractMFP(&GeneratedMemberHook::CallOriginal),
+            false
+        );
+    }
+
+    // Calls every target in [first, first + count) `rounds` times, each call
+    // is expected to go through exactly one counting hook.
+    void CallTargets(
+        WorkerResult& result,
+        std::size_t first,
+        std::size_t count,
+        std::size_t rounds
+    ) {
+        std::uint64_t before = GeneratedCountingHook::s_calls;
+        std::uint64_t calls = 0;
+        for (std::size_t r = 0; r < rounds; r++) {
+            for (std::size_t i = first; i < first + count; i++) {
+                GeneratedObject obj {};
+                int value = (int)((r + i) & 0xFFFF);
+                bool ok = GetGeneratedFunction(i)(&obj, value) == value
+                    && obj.m_lastTarget == (int)i;
+
+                GeneratedObject member {};
+                ok = ok && instance->Call(i, &member, value) == value
+                    && member.m_lastTarget == (int)instance->TargetOf(i);
+
+                result.errors += ok ? 0 : 1;
+                calls += 2;
+            }
+        }
+        result.calls += calls;
+        result.missedHooks += calls - (GeneratedCountingHook::s_calls - before);
+    }
+
+    // Body of a worker process.
+    WorkerResult RunWorker(std::size_t rounds) {
+        WorkerResult result;
+        PrivateDirtyStats start = ReadPrivateDirtyStats();
+
+        CallTargets(result, 0, kMasterTargets, rounds);
+        PrivateDirtyStats called = ReadPrivateDirtyStats();
+
+        std::vector<HookHandle> hooks;
+        for (std::size_t i = kMasterTargets; i < kMasterTargets + kWorkerTargets;
+             i++) {
+            hooks.push_back(InstallStatic(i));
+            hooks.push_back(InstallVirtual(i));
+        }
+        for (const HookHandle& hook : hooks) {
+            result.failedInstalls += hook.Valid() ? 0 : 1;
+        }
+        CallTargets(result, kMasterTargets, kWorkerTargets, rounds);
+        hooks.clear();
+        PrivateDirtyStats hooked = ReadPrivateDirtyStats();
+
+        // The inherited hooks have to survive the worker's own churn.
+        CallTargets(result, 0, kMasterTargets, 1);
+
+        result.callDirtyKb = called.totalKb - start.totalKb;
+        result.callExecDirtyKb = called.execKb - start.execKb;
+        result.hookDirtyKb = hooked.totalKb - called.totalKb;
+        result.hookExecDirtyKb = hooked.execKb - called.execKb;
+        return result;
+    }
+
+    // Forks `workers` children running RunWorker and collects their results
+    // through a pipe each. A child that crashed or didn't report is an error.
+    std::vector<WorkerResult> RunWorkers(std::size_t workers, std::size_t rounds) {
+        std::vector<WorkerResult> results(workers);
+#if !defined(_WIN32)
+        std::vector<pid_t> pids;
+        std::vector<int> pipes;
+        for (std::size_t w = 0; w < workers; w++) {
+            int fds[2];
+            if (pipe(fds) != 0) {
+                ADD_FAILURE() << "Could not create a pipe for worker " << w;
+                break;
+            }
+            fflush(nullptr);
+            pid_t pid = fork();
+            if (pid == 0) {
+                close(fds[0]);
+                WorkerResult result = RunWorker(rounds);
+                bool written =
+                    write(fds[1], &result, sizeof(result)) == sizeof(result);
+                _exit(written ? 0 : 1);
+            }
+            close(fds[1]);
+            if (pid < 0) {
+                close(fds[0]);
+                ADD_FAILURE() << "Could not fork worker " << w;
+                break;
+            }
+            pids.push_back(pid);
+            pipes.push_back(fds[0]);
+        }
+
+        for (std::size_t w = 0; w < pids.size(); w++) {
+            bool received = read(pipes[w], &results[w], sizeof(WorkerResult))
+                == sizeof(WorkerResult);
+            close(pipes[w]);
+            int status = 0;
+            waitpid(pids[w], &status, 0);
+            EXPECT_TRUE(received && WIFEXITED(status) && WEXITSTATUS(status) == 0)
+                << "Worker " << w << " should exit cleanly and report back";
+        }
+#endif
+        return results;
+    }
+
+    ScopedCallbackLogging m_quiet {false};
+    std::unique_ptr<GeneratedInstance> instance;
+    std::vector<HookHandle> m_hooks;
+};
+
+TEST_F(PreforkHookTest, WorkersInheritHooks) {
+    std::vector<WorkerResult> results = RunWorkers(4, 100);
+
+    for (std::size_t w = 0; w < results.size(); w++) {
+        EXPECT_GT(results[w].calls, 0u) << "Worker " << w << " should run";
+        EXPECT_EQ(results[w].errors, 0u)
+            << "Hooked calls in worker " << w << " should behave";
+        EXPECT_EQ(results[w].missedHooks, 0u)
+            << "Every call in worker " << w << " should run one pre callback";
+        EXPECT_EQ(results[w].failedInstalls, 0u)
+            << "Hook setup in worker " << w << " should succeed";
+    }
+
+    // Nothing the workers did may leak back into the master.
+    WorkerResult master;
+    CallTargets(master, 0, kMasterTargets + kWorkerTargets, 1);
+    EXPECT_EQ(master.errors, 0u) << "Calls in the master should behave";
+    EXPECT_EQ(master.missedHooks, 2 * kWorkerTargets)
+        << "Only the master's own hooks should run in the master";
+}
+
+TEST_F(PreforkHookTest, BenchmarkCopyOnWriteCost) {
+    BENCHMARK_ONLY();
+
+    std::size_t workers = BenchThreads();
+    std::vector<WorkerResult> results =
+        RunWorkers(workers, BenchIterations(100000));
+
+    WorkerResult total;
+    for (const WorkerResult& result : results) {
+        EXPECT_EQ(result.errors + result.missedHooks + result.failedInstalls, 0u)
+            << "Every worker should see working hooks";
+        total.calls += result.calls;
+        total.callDirtyKb += result.callDirtyKb;
+        total.callExecDirtyKb += result.callExecDirtyKb;
+        total.hookDirtyKb += result.hookDirtyKb;
+        total.hookExecDirtyKb += result.hookExecDirtyKb;
+    }
+
+    double count = (double)results.size();
+    ReportMetric("workers", count, "processes");
+    ReportMetric("calls", (double)total.calls, "calls");
+    ReportMetric(
+        "dirtied_by_calls_per_worker",
+        (double)total.callDirtyKb / count,
+        "KB"
+    );
+    ReportMetric(
+        "exec_dirtied_by_calls_per_worker",
+        (double)total.callExecDirtyKb / count,
+        "KB"
+    );
+    ReportMetric(
+        "dirtied_by_own_hooks_per_worker",
+        (double)total.hookDirtyKb / count,
+        "KB"
+    );
+    ReportMetric(
+        "exec_dirtied_by_own_hooks_per_worker",
+        (double)total.hookExecDirtyKb / count,
+        "KB"
+    );
+}
@@ -0,0 +1,477 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <initializer_list>
+#include <khook.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "codegen.hpp"
+#include "hooks.hpp"
+#include "main.hpp"
+#include "targets.hpp"
+
+// Hand-assembled targets whose first bytes are hard to relocate into a
+// trampoline. They all behave like SetObjectValue, except where noted.
+enum class PrologueShape {
+    // Frame pointer prologue, stores 100 in m_lastTarget.
+    Plain,
+    // Loads the 101 it stores in m_lastTarget PC-relatively, with a RIP
+    // relative mov on x86_64 and a call/pop thunk on x86.
+    PcRelative,
+    // Only returns the value and is no longer than a jump, another function
+    // follows right after it.
+    Short,
+    // Starts a conditional branch within the five bytes a hook overwrites,
+    // anything that isn't positive is stored and returned as zero. On x86
+    // loading the value alone fills those bytes, the early branch is taken
+    // on a flag set right before it and the sign check comes after.
+    Branch,
+    // Calls a helper storing 102 in m_lastTarget as its first instruction.
+    Call
+};
+
+static const char* PrologueShapeName(PrologueShape shape) {
+    switch (shape) {
+        case PrologueShape::Plain:
+            return "Plain";
+        case PrologueShape::PcRelative:
+            return "PcRelative";
+        case PrologueShape::Short:
+            return "Short";
+        case PrologueShape::Branch:
+            return "Branch";
+        default:
+            return "Call";
+    }
+}
+
+class PrologueAssembler {
+  public:
+    static constexpr int kPlainId = 100;
+    static constexpr int kPcRelativeId = 101;
+    static constexpr int kCallHelperId = 102;
+    static constexpr int kNeighborId = 103;
+
+    std::size_t Begin() {
+        while (m_code.size() % 16) {
+            m_code.push_back(0xCC);
+        }
+        return m_code.size();
+    }
+
+    void Emit(std::initializer_list<std::uint8_t> bytes) {
+        m_code.insert(m_code.end(), bytes);
+    }
+
+    void EmitImm32(std::int32_t value) {
+        std::uint8_t bytes[4];
+        memcpy(bytes, &value, sizeof(bytes));
+        m_code.insert(m_code.end(), bytes, bytes + sizeof(bytes));
+    }
+
+    void Patch32(std::size_t at, std::int32_t value) {
+        memcpy(&m_code[at], &value, sizeof(value));
+    }
+
+    std::size_t Offset() const {
+        return m_code.size();
+    }
+
+    const std::vector<std::uint8_t>& Code() const {
+        return m_code;
+    }
+
+    void EmitPlain(int id) {
+#if defined(__x86_64__) || defined(_M_X64)
+        Emit({0x55});             // push rbp
+        Emit({0x48, 0x89, 0xE5}); // mov rbp, rsp
+        EmitStoreValue();
+        EmitStoreTarget(id);
+        EmitReturnValue();
+        Emit({0x5D});             // pop rbp
+        Emit({0xC3});             // ret
+#else
+        Emit({0x55});             // push ebp
+        Emit({0x89, 0xE5});       // mov ebp, esp
+        Emit({0x8B, 0x45, 0x08}); // mov eax, [ebp+8]
+        Emit({0x8B, 0x4D, 0x0C}); // mov ecx, [ebp+12]
+        Emit({0x89, 0x08});       // mov [eax], ecx
+        Emit({0xC7, 0x40, 0x04}); // mov dword [eax+4], imm32
+        EmitImm32(id);
+        Emit({0x89, 0xC8});       // mov eax, ecx
+        Emit({0x5D});             // pop ebp
+        Emit({0xC3});             // ret
+#endif
+    }
+
+    // Returns where the displacement to the data has to be patched in, and
+    // the address it is relative to.
+    std::pair<std::size_t, std::size_t> EmitPcRelative() {
+#if defined(__x86_64__) || defined(_M_X64)
+        Emit({0x8B, 0x05}); // mov eax, [rip+disp32]
+        std::size_t patch = Offset();
+        EmitImm32(0);
+        std::size_t base = Offset();
+    #if defined(_WIN32)
+        Emit({0x89, 0x41, 0x04}); // mov [rcx+4], eax
+    #else
+        Emit({0x89, 0x47, 0x04}); // mov [rdi+4], eax
+    #endif
+        EmitStoreValue();
+        EmitReturnValue();
+        Emit({0xC3}); // ret
+#else
+        Emit({0xE8, 0x00, 0x00, 0x00, 0x00}); // call $+5
+        std::size_t base = Offset();
+        Emit({0x58});       // pop eax
+        Emit({0x8B, 0x80}); // mov eax, [eax+disp32]
+        std::size_t patch = Offset();
+        EmitImm32(0);
+        Emit({0x8B, 0x4C, 0x24, 0x04}); // mov ecx, [esp+4]
+        Emit({0x89, 0x41, 0x04});       // mov [ecx+4], eax
+        Emit({0x8B, 0x44, 0x24, 0x08}); // mov eax, [esp+8]
+        Emit({0x89, 0x01});             // mov [ecx], eax
+        Emit({0xC3});                   // ret
+#endif
+        return {patch, base};
+    }
+
+    void EmitShort() {
+#if defined(__x86_64__) || defined(_M_X64)
+        EmitReturnValue();
+        Emit({0xC3}); // ret
+#else
+        Emit({0x8B, 0x44, 0x24, 0x08}); // mov eax, [esp+8]
+        Emit({0xC3});                   // ret
+#endif
+    }
+
+    void EmitBranch() {
+#if defined(__x86_64__) || defined(_M_X64)
+    #if defined(_WIN32)
+        Emit({0x85, 0xD2}); // test edx, edx
+    #else
+        Emit({0x85, 0xF6}); // test esi, esi
+    #endif
+        Emit({0x7E, 0x05}); // jle negative
+        EmitStoreValue();
+        EmitReturnValue();
+        Emit({0xC3}); // ret
+        // negative:
+    #if defined(_WIN32)
+        Emit({0xC7, 0x01}); // mov dword [rcx], imm32
+    #else
+        Emit({0xC7, 0x07}); // mov dword [rdi], imm32
+    #endif
+        EmitImm32(0);
+        Emit({0x31, 0xC0}); // xor eax, eax
+        Emit({0xC3});       // ret
+#else
+        Emit({0x31, 0xC0});             // xor eax, eax
+        Emit({0x74, 0x08});             // jz load
+        // Lands past the jump back of a trampoline that copied the jz as is.
+        Emit({0x0F, 0x0B, 0x0F, 0x0B}); // ud2, ud2
+        Emit({0x0F, 0x0B, 0x0F, 0x0B}); // ud2, ud2
+        // load:
+        Emit({0x8B, 0x44, 0x24, 0x08}); // mov eax, [esp+8]
+        Emit({0x85, 0xC0});             // test eax, eax
+        Emit({0x7E, 0x07});             // jle negative
+        Emit({0x8B, 0x4C, 0x24, 0x04}); // mov ecx, [esp+4]
+        Emit({0x89, 0x01});             // mov [ecx], eax
+        Emit({0xC3});                   // ret
+        // negative:
+        Emit({0x8B, 0x4C, 0x24, 0x04}); // mov ecx, [esp+4]
+        Emit({0xC7, 0x01});             // mov dword [ecx], imm32
+        EmitImm32(0);
+        Emit({0x31, 0xC0}); // xor eax, eax
+        Emit({0xC3});       // ret
+#endif
+    }
+
+    // Returns where the call displacement has to be patched in.
+    std::size_t EmitCall() {
+        Emit({0xE8}); // call helper
+        std::size_t patch = Offset();
+        EmitImm32(0);
+#if defined(__x86_64__) || defined(_M_X64)
+        EmitStoreValue();
+        EmitReturnValue();
+        Emit({0xC3}); // ret
+#else
+        Emit({0x8B, 0x44, 0x24, 0x08}); // mov eax, [esp+8]
+        Emit({0x8B, 0x4C, 0x24, 0x04}); // mov ecx, [esp+4]
+        Emit({0x89, 0x01});             // mov [ecx], eax
+        Emit({0xC3});                   // ret
+#endif
+        return patch;
+    }
+
+    void EmitCallHelper() {
+#if defined(__x86_64__) || defined(_M_X64)
+        EmitStoreTarget(kCallHelperId);
+        Emit({0xC3}); // ret
+#else
+        Emit({0x8B, 0x44, 0x24, 0x08}); // mov eax, [esp+8]
+        Emit({0xC7, 0x40, 0x04});       // mov dword [eax+4], imm32
+        EmitImm32(kCallHelperId);
+        Emit({0xC3}); // ret
+#endif
+    }
+
+  private:
+#if defined(__x86_64__) || defined(_M_X64)
+    void EmitStoreValue() {
+    #if defined(_WIN32)
+        Emit({0x89, 0x11}); // mov [rcx], edx
+    #else
+        Emit({0x89, 0x37}); // mov [rdi], esi
+    #endif
+    }
+
+    void EmitStoreTarget(int id) {
+    #if defined(_WIN32)
+        Emit({0xC7, 0x41, 0x04}); // mov dword [rcx+4], imm32
+    #else
+        Emit({0xC7, 0x47, 0x04}); // mov dword [rdi+4], imm32
+    #endif
+        EmitImm32(id);
+    }
+
+    void EmitReturnValue() {
+    #if defined(_WIN32)
+        Emit({0x89, 0xD0}); // mov eax, edx
+    #else
+        Emit({0x89, 0xF0}); // mov eax, esi
+    #endif
+    }
+#endif
+
+    std::vector<std::uint8_t> m_code;
+};
+
+class PrologueHookTest: public ::testing::TestWithParam<PrologueShape> {
+  protected:
+    static constexpr int kUntouched = -1;
+
+    void SetUp() override {
+        PrologueAssembler assembler;
+
+        m_offsets[(int)PrologueShape::Plain] = assembler.Begin();
+        assembler.EmitPlain(PrologueAssembler::kPlainId);
+
+        m_offsets[(int)PrologueShape::PcRelative] = assembler.Begin();
+        auto pcRelative = assembler.EmitPcRelative();
+
+        m_offsets[(int)PrologueShape::Short] = assembler.Begin();
+        assembler.EmitShort();
+        m_neighborOffset = assembler.Offset();
+        assembler.EmitPlain(PrologueAssembler::kNeighborId);
+
+        m_offsets[(int)PrologueShape::Branch] = assembler.Begin();
+        assembler.EmitBranch();
+
+        m_offsets[(int)PrologueShape::Call] = assembler.Begin();
+        std::size_t callPatch = assembler.EmitCall();
+        std::size_t helper = assembler.Begin();
+        assembler.EmitCallHelper();
+        assembler.Patch32(callPatch, (std::int32_t)(helper - (callPatch + 4)));
+
+        std::size_t data = assembler.Begin();
+        assembler.EmitImm32(PrologueAssembler::kPcRelativeId);
+        assembler.Patch32(
+            pcRelative.first,
+            (std::int32_t)(data - pcRelative.second)
+        );
+
+        code.reset(new CodeBuffer(assembler.Code()));
+        ASSERT_TRUE(code->Valid()) << "Should map the hand-assembled code";
+        GeneratedCountingHook::s_calls = 0;
+    }
+
+    void TearDown() override {
+        m_hook.Remove();
+        code.reset();
+    }
+
+    GeneratedFunction Function(PrologueShape shape) const {
+        return (GeneratedFunction)code->At(m_offsets[(int)shape]);
+    }
+
+    GeneratedFunction Neighbor() const {
+        return (GeneratedFunction)code->At(m_neighborOffset);
+    }
+
+    int Install(PrologueShape shape, void* pre) {
+        m_hook = HookHandle::SetupHook(
+            (void*)Function(shape),
+            nullptr,
+            (void*)&GeneratedStaticHook::OnRemoved,
+            pre,
+            (void*)&GeneratedStaticHook::PrePostNoop,
+            (void*)&GeneratedStaticHook::MakeReturn,
+            (void*)&GeneratedStaticHook::CallOriginal,
+            false
+        );
+        return m_hook.Id();
+    }
+
+    void Remove() {
+        m_hook.Remove();
+    }
+
+    static ::testing::AssertionResult
+    Behaves(PrologueShape shape, GeneratedFunction function, int value) {
+        GeneratedObject obj {kUntouched, kUntouched};
+        int result = function(&obj, value);
+
+        int expectedResult = value;
+        int expectedValue = value;
+        int expectedTarget = kUntouched;
+        switch (shape) {
+            case PrologueShape::Plain:
+                expectedTarget = PrologueAssembler::kPlainId;
+                break;
+            case PrologueShape::PcRelative:
+                expectedTarget = PrologueAssembler::kPcRelativeId;
+                break;
+            case PrologueShape::Short:
+                expectedValue = kUntouched;
+                break;
+            case PrologueShape::Branch:
+                expectedResult = value > 0 ? value : 0;
+                expectedValue = expectedResult;
+                break;
+            case PrologueShape::Call:
+                expectedTarget = PrologueAssembler::kCallHelperId;
+                break;
+        }
+
+        if (result != expectedResult || obj.m_testValue != expectedValue
+            || obj.m_lastTarget != expectedTarget) {
+            return ::testing::AssertionFailure()
+                << PrologueShapeName(shape) << "(" << value << ") returned "
+                << result << " with m_testValue " << obj.m_testValue
+                << " and m_lastTarget " << obj.m_lastTarget << ", expected "
+                << expectedResult << ", " << expectedValue << " and "
+                << expectedTarget;
+        }
+        return ::testing::AssertionSuccess();
+    }
+
+    static ::testing::AssertionResult NeighborBehaves(GeneratedFunction neighbor) {
+        GeneratedObject obj {kUntouched, kUntouched};
+        int result = neighbor(&obj, 77);
+        if (result != 77 || obj.m_testValue != 77
+            || obj.m_lastTarget != PrologueAssembler::kNeighborId) {
+            return ::testing::AssertionFailure()
+                << "Function following the short one was damaged";
+        }
+        return ::testing::AssertionSuccess();
+    }
+
+    ScopedCallbackLogging m_quiet {false};
+    std::unique_ptr<CodeBuffer> code;
+    std::size_t m_offsets[5] = {};
+    std::size_t m_neighborOffset = 0;
+    HookHandle m_hook;
+};
+
+TEST_P(PrologueHookTest, HookedBehavesLikeOriginal) {
+    PrologueShape shape = GetParam();
+    GeneratedFunction function = Function(shape);
+    const int values[] = {5, -3, 0, 0x7FFF};
+
+    for (int value : values) {
+        ASSERT_TRUE(Behaves(shape, function, value))
+            << "Hand-assembled target should work before hooking";
+    }
+
+    int hookId = Install(shape, (void*)&GeneratedCountingHook::Pre);
+    if (shape == PrologueShape::Short && hookId == KHook::INVALID_HOOK) {
+        // Refusing a function that can't hold the jump is fine, as long as
+        // nothing around it was touched.
+        EXPECT_TRUE(Behaves(shape, function, 5));
+        EXPECT_TRUE(NeighborBehaves(Neighbor()));
+        return;
+    }
+    ASSERT_NE(hookId, KHook::INVALID_HOOK) << "Hook setup should succeed";
+
+    for (int value : values) {
+        EXPECT_TRUE(Behaves(shape, function, value))
+            << "Relocated prologue should behave like the original";
+    }
+    EXPECT_EQ(GeneratedCountingHook::s_calls, std::size(values))
+        << "Pre callback should run once per call";
+    if (shape == PrologueShape::Short) {
+        EXPECT_TRUE(NeighborBehaves(Neighbor()));
+    }
+
+    Remove();
+    GeneratedCountingHook::s_calls = 0;
+
+    for (int value : values) {
+        EXPECT_TRUE(Behaves(shape, function, value))
+            << "Original bytes should be restored after hook removal";
+    }
+    EXPECT_EQ(GeneratedCountingHook::s_calls, 0u)
+        << "Pre callback should not run after hook removal";
+}
+
+TEST_P(PrologueHookTest, BenchmarkCallCost) {
+    BENCHMARK_ONLY();
+
+    std::size_t calls = BenchIterations(2000000);
+    auto measure = [&](GeneratedFunction function) {
+        return MeasureNsPerOp(calls, [&](std::size_t i) {
+            GeneratedObject obj {};
+            DoNotOptimize(function(&obj, (int)(i & 0xFFFF) + 1));
+        });
+    };
+
+    double plainUnhooked = measure(Function(PrologueShape::Plain));
+    ASSERT_NE(
+        Install(PrologueShape::Plain, (void*)&GeneratedStaticHook::PrePostNoop),
+        KHook::INVALID_HOOK
+    ) << "Hook setup should succeed";
+    double plainHooked = measure(Function(PrologueShape::Plain));
+    Remove();
+
+    PrologueShape shape = GetParam();
+    double unhooked = measure(Function(shape));
+    if (Install(shape, (void*)&GeneratedStaticHook::PrePostNoop)
+        == KHook::INVALID_HOOK) {
+        ReportMetric("hookable", 0.0, "bool");
+        return;
+    }
+    double hooked = measure(Function(shape));
+    Remove();
+
+    double overhead = hooked - unhooked;
+    ReportMetric("hookable", 1.0, "bool");
+    ReportMetric("unhooked_call", unhooked, "ns");
+    ReportMetric("hooked_call", hooked, "ns");
+    ReportMetric("hook_overhead", overhead, "ns");
+    ReportMetric(
+        "overhead_vs_plain",
+        overhead - (plainHooked - plainUnhooked),
+        "ns"
+    );
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Shapes,
+    PrologueHookTest,
+    ::testing::Values(
+        PrologueShape::Plain,
+        PrologueShape::PcRelative,
+        PrologueShape::Short,
+        PrologueShape::Branch,
+        PrologueShape::Call
+    ),
+    [](const ::testing::TestParamInfo<PrologueShape>& info) {
+        return std::string(PrologueShapeName(info.param));
+    }
+);
@@ -0,0 +1,156 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <khook.hpp>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "bench.hpp"
+#include "hooks.hpp"
+#include "main.hpp"
+#include "targets.hpp"
+
+class HookRegistryTest: public ::testing::Test {
+  protected:
+    void SetUp() override {
+        instance.reset(new GeneratedInstance(1));
+        ASSERT_EQ(g_hookRegistry.LiveCount(), 0u)
+            << "No hooks should be left over from earlier tests";
+    }
+
+    void TearDown() override {
+        instance.reset();
+    }
+
+    static HookHandle InstallStatic(std::size_t index) {
+        return HookHandle::SetupHook(
+            (void*)GetGeneratedFunction(index),
+            nullptr,
+            (void*)&GeneratedStaticHook::OnRemoved,
+            (void*)&GeneratedStaticHook::PrePostNoop,
+            (void*)&GeneratedStaticHook::PrePostNoop,
+            (void*)&GeneratedStaticHook::MakeReturn,
+            (void*)&GeneratedStaticHook::CallOriginal,
+            false
+        );
+    }
+
+    HookHandle InstallVirtual() {
+        return HookHandle::SetupVirtualHook(
+            instance->Vtable(),
+            0,
+            nullptr,
+            KHook::ExtractMFP(&GeneratedMemberHook::OnRemoved),
+            KHook::ExtractMFP(&GeneratedMemberHook::PrePostNoop),
+            KHook::ExtractMFP(&GeneratedMemberHook::PrePostNoop),
+            KHook::ExtractMFP(&GeneratedMemberHook::MakeReturn),
+            KHook::ExtractMFP(&GeneratedMemberHook::CallOriginal),
+            false
+        );
+    }
+
+    ScopedCallbackLogging m_quiet {false};
+    std::unique_ptr<GeneratedInstance> instance;
+};
+
+TEST_F(HookRegistryTest, TracksChainAndRemoval) {
+    const void* target = (const void*)GetGeneratedFunction(0);
+    HookRegistryStats before = g_hookRegistry.Stats();
+
+    HookHandle first = InstallStatic(0);
+    HookHandle second = InstallStatic(0);
+    ASSERT_TRUE(first.Valid()) << "Hook setup should succeed";
+    ASSERT_TRUE(second.Valid()) << "Hook setup should succeed";
+
+    HookRecord record;
+    ASSERT_TRUE(g_hookRegistry.Find(second.Id(), &record))
+        << "Installed hook should be registered";
+    EXPECT_EQ(record.target, target) << "Hook should be recorded on its target";
+    EXPECT_EQ(record.chainPosition, 1u)
+        << "Second hook on a target should be second in the chain";
+    EXPECT_EQ(g_hookRegistry.LiveCount(target), 2u);
+
+    int firstId = first.Id();
+    first.Remove();
+    EXPECT_FALSE(first.Valid()) << "Removed handle should be empty";
+    EXPECT_FALSE(g_hookRegistry.IsLive(firstId));
+    EXPECT_EQ(g_hookRegistry.LiveCount(target), 1u);
+    EXPECT_FALSE(g_hookRegistry.Find(firstId, &record))
+        << "OnRemoved should have been delivered for a sync removal";
+
+    second.Remove();
+    HookRegistryStats after = g_hookRegistry.Stats();
+    EXPECT_EQ(after.installs - before.installs, 2u);
+    EXPECT_EQ(after.removals - before.removals, 2u);
+    EXPECT_EQ(after.removedCalls - before.removedCalls, 2u)
+        << "OnRemoved should run once per removed hook";
+    EXPECT_EQ(g_hookRegistry.PendingRemovals(), 0u);
+}
+
+TEST_F(HookRegistryTest, HandleRemovesOnDestruction) {
+    const void* slot = &instance->Vtable()[0];
+    int hookId;
+    {
+        HookHandle hook = InstallVirtual();
+        ASSERT_TRUE(hook.Valid()) << "Hook setup should succeed";
+        hookId = hook.Id();
+
+        HookHandle moved = std::move(hook);
+        EXPECT_FALSE(hook.Valid()) << "Moved-from handle should be empty";
+        EXPECT_EQ(moved.Id(), hookId) << "Handle should keep the hook on move";
+        EXPECT_EQ(g_hookRegistry.LiveCount(slot), 1u);
+    }
+
+    EXPECT_FALSE(g_hookRegistry.IsLive(hookId))
+        << "Hook should be removed with its handle";
+    EXPECT_EQ(g_hookRegistry.LiveCount(slot), 0u);
+
+    GeneratedObject obj {};
+    EXPECT_EQ(instance->Call(0, &obj, 3), 3)
+        << "Virtual call should behave after the handle is gone";
+}
+
+TEST_F(HookRegistryTest, BenchmarkInstallCostByChainPosition) {
+    BENCHMARK_ONLY();
+
+    std::size_t depth = BenchIterations(256);
+    std::size_t rounds = 16;
+    std::vector<LatencyHistogram> costs(depth);
+
+    for (std::size_t r = 0; r < rounds; r++) {
+        std::vector<HookHandle> hooks;
+        for (std::size_t i = 0; i < depth; i++) {
+            hooks.push_back(InstallStatic(0));
+            ASSERT_TRUE(hooks.back().Valid()) << "Hook setup should succeed";
+        }
+
+        for (const HookRecord& record : g_hookRegistry.Snapshot()) {
+            if (!record.removeRequested && record.chainPosition < depth) {
+                costs[record.chainPosition].Record(record.installCostNs);
+            }
+        }
+
+        // Remove in reverse, as most stacks of hooks are torn down.
+        while (!hooks.empty()) {
+            hooks.pop_back();
+        }
+    }
+
+    for (std::size_t position = 1; position <= depth; position *= 4) {
+        ReportLatencies(
+            ("install_at_" + std::to_string(position - 1)).c_str(),
+            costs[position - 1].Summarize()
+        );
+    }
+
+    HookRegistryStats stats = g_hookRegistry.Stats();
+    ReportMetric(
+        "mean_install_overall",
+        stats.installs ? (double)stats.totalInstallNs / (double)stats.installs
+                       : 0.0,
+        "ns"
+    );
+    ReportMetric("max_install_overall", (double)stats.maxInstallNs, "ns");
+}
@@ -0,0 +1,439 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <khook.hpp>
+#include <memory>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "bench.hpp"
+#include "hooks.hpp"
+#include "main.hpp"
+#include "targets.hpp"
+
+#pragma region ChainRemoval
+
+// Shared by the two hooks of a chain. One of them, the remover, removes the
+// victim hook the first time its pre or post callback runs once armed.
+struct ChainRemovalState {
+    int hookIds[2] = {KHook::INVALID_HOOK, KHook::INVALID_HOOK};
+    std::atomic<int> preCalls[2] = {};
+    std::atomic<int> postCalls[2] = {};
+    // Slot whose pre and post callbacks ran first, -1 until one did.
+    std::atomic<int> firstPre {-1};
+    std::atomic<int> firstPost {-1};
+    std::atomic<int> removed[2] = {};
+    std::atomic<int> unexpectedRemovals {0};
+    std::atomic<bool> armed {false};
+    std::atomic<bool> fired {false};
+    int remover = -1;
+    int victim = -1;
+    bool fromPost = false;
+    bool async = false;
+};
+
+static ChainRemovalState s_chain;
+
+template<int Slot>
+class ChainRemovalHook {
+  public:
+    NOINLINE static int Pre(GeneratedObject* obj, int value) {
+        s_chain.preCalls[Slot]++;
+        int none = -1;
+        s_chain.firstPre.compare_exchange_strong(none, Slot);
+        Trigger(false);
+        return 0;
+    }
+
+    NOINLINE static int Post(GeneratedObject* obj, int value) {
+        s_chain.postCalls[Slot]++;
+        int none = -1;
+        s_chain.firstPost.compare_exchange_strong(none, Slot);
+        Trigger(true);
+        return 0;
+    }
+
+    NOINLINE static void OnRemoved(int hookId) {
+        if (hookId == s_chain.hookIds[Slot]) {
+            s_chain.removed[Slot]++;
+        } else {
+            s_chain.unexpectedRemovals++;
+        }
+        g_hookRegistry.NotifyRemoved(hookId);
+    }
+
+    NOINLINE int PreMember(GeneratedObject* obj, int value) {
+        return Pre(obj, value);
+    }
+
+    NOINLINE int PostMember(GeneratedObject* obj, int value) {
+        return Post(obj, value);
+    }
+
+    NOINLINE void OnRemovedMember(int hookId) {
+        OnRemoved(hookId);
+    }
+
+  private:
+    static void Trigger(bool post) {
+        if (Slot == s_chain.remover && post == s_chain.fromPost
+            && s_chain.armed.exchange(false)) {
+            s_chain.fired = true;
+            HookHandle::RemoveById(
+                s_chain.hookIds[s_chain.victim],
+                s_chain.async
+            );
+        }
+        KHook::SaveReturnValue(
+            KHook::Action::Ignore,
+            nullptr,
+            0,
+            nullptr,
+            nullptr,
+            false
+        );
+    }
+};
+
+#pragma endregion
+
+// Kind of target, whether the removal happens in the post callback, whether
+// the remover removes its sibling instead of itself, and async removal.
+using CallbackRemovalParam = std::tuple<HookKind, bool, bool, bool>;
+
+class CallbackRemovalTest: public ::testing::TestWithParam<CallbackRemovalParam> {
+  protected:
+    static constexpr std::size_t kTarget = 0;
+
+    void SetUp() override {
+        instance.reset(new GeneratedInstance(1));
+
+        s_chain.hookIds[0] = s_chain.hookIds[1] = KHook::INVALID_HOOK;
+        for (int slot = 0; slot < 2; slot++) {
+            s_chain.preCalls[slot] = 0;
+            s_chain.postCalls[slot] = 0;
+            s_chain.removed[slot] = 0;
+        }
+        s_chain.firstPre = -1;
+        s_chain.firstPost = -1;
+        s_chain.unexpectedRemovals = 0;
+        s_chain.armed = false;
+        s_chain.fired = false;
+        s_chain.fromPost = std::get<1>(GetParam());
+        s_chain.remover = -1;
+        s_chain.victim = -1;
+        s_chain.async = std::get<3>(GetParam());
+
+        m_hooks[0] = Install<0>();
+        s_chain.hookIds[0] = m_hooks[0].Id();
+        ASSERT_TRUE(m_hooks[0].Valid()) << "Hook setup should succeed";
+        m_hooks[1] = Install<1>();
+        s_chain.hookIds[1] = m_hooks[1].Id();
+        ASSERT_TRUE(m_hooks[1].Valid()) << "Hook setup should succeed";
+    }
+
+    void TearDown() override {
+        s_chain.armed = false;
+        // The victim's handle knows it was removed from its callback.
+        m_hooks[0].Remove();
+        m_hooks[1].Remove();
+        instance.reset();
+    }
+
+    template<int Slot>
+    HookHandle Install() {
+        using Hook = ChainRemovalHook<Slot>;
+        if (std::get<0>(GetParam()) == HookKind::Static) {
+            return HookHandle::SetupHook(
+                (void*)GetGeneratedFunction(kTarget),
+                nullptr,
+                (void*)&Hook::OnRemoved,
+                (void*)&Hook::Pre,
+                (void*)&Hook::Post,
+                (void*)&GeneratedStaticHook::MakeReturn,
+                (void*)&GeneratedStaticHook::CallOriginal,
+                false
+            );
+        }
+        return HookHandle::SetupVirtualHook(
+            instance->Vtable(),
+            (int)kTarget,
+            nullptr,
+            KHook::ExtractMFP(&Hook::OnRemovedMember),
+            KHook::ExtractMFP(&Hook::PreMember),
+            KHook::ExtractMFP(&Hook::PostMember),
+            KHook::ExtractMFP(&GeneratedMemberHook::MakeReturn),
+            KHook::ExtractMFP(&GeneratedMemberHook::CallOriginal),
+            false
+        );
+    }
+
+    ::testing::AssertionResult Call(int value) {
+        GeneratedObject obj {};
+        int result;
+        if (std::get<0>(GetParam()) == HookKind::Static) {
+            result = GetGeneratedFunction(kTarget)(&obj, value);
+        } else {
+            result = instance->Call(kTarget, &obj, value);
+        }
+        if (result != value || obj.m_testValue != value) {
+            return ::testing::AssertionFailure()
+                << "Call returned " << result << " instead of " << value;
+        }
+        return ::testing::AssertionSuccess();
+    }
+
+    // Async removals may complete later, keep calling through the chain
+    // until OnRemoved shows up.
+    bool WaitForRemoval(int slot) {
+        for (int i = 0; i < 1000 && s_chain.removed[slot] == 0; i++) {
+            Call(i);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return s_chain.removed[slot] > 0;
+    }
+
+    ScopedCallbackLogging m_quiet {false};
+    std::unique_ptr<GeneratedInstance> instance;
+    HookHandle m_hooks[2];
+};
+
+TEST_P(CallbackRemovalTest, RemoveFromCallback) {
+    EXPECT_TRUE(Call(1)) << "Chained hooks should keep the original value";
+    EXPECT_EQ(s_chain.preCalls[0], 1) << "Both hooks should run";
+    EXPECT_EQ(s_chain.preCalls[1], 1) << "Both hooks should run";
+
+    // The remover is whichever hook KHook ran first on the callback side
+    // under test, so removing the sibling always removes a hook that is
+    // still to run in this call, never one that already ran.
+    int first = s_chain.fromPost ? s_chain.firstPost : s_chain.firstPre;
+    ASSERT_NE(first, -1) << "Callbacks should have run on the first call";
+    int victim = std::get<2>(GetParam()) ? 1 - first : first;
+    int survivor = 1 - victim;
+    s_chain.remover = first;
+    s_chain.victim = victim;
+
+    s_chain.armed = true;
+    EXPECT_TRUE(Call(2)) << "Removing a hook from a callback should not "
+                            "affect the result of the call";
+    EXPECT_TRUE(s_chain.fired) << "Remover callback should have run";
+    if (!std::get<3>(GetParam())) {
+        EXPECT_EQ(s_chain.removed[victim], 1)
+            << "Sync removal should report OnRemoved before the call returns";
+    }
+    ASSERT_TRUE(WaitForRemoval(victim)) << "OnRemoved should be delivered";
+
+    int victimPre = s_chain.preCalls[victim];
+    int victimPost = s_chain.postCalls[victim];
+    int survivorPre = s_chain.preCalls[survivor];
+    for (int i = 0; i < 10; i++) {
+        EXPECT_TRUE(Call(i)) << "Remaining chain should keep the original value";
+    }
+    EXPECT_EQ(s_chain.preCalls[victim], victimPre)
+        << "Removed hook should not run anymore";
+    EXPECT_EQ(s_chain.postCalls[victim], victimPost)
+        << "Removed hook should not run anymore";
+    EXPECT_EQ(s_chain.preCalls[survivor], survivorPre + 10)
+        << "Remaining hook should still run";
+
+    EXPECT_EQ(s_chain.removed[victim], 1) << "OnRemoved should run exactly once";
+    EXPECT_EQ(s_chain.removed[survivor], 0)
+        << "Remaining hook should not be reported as removed";
+    EXPECT_EQ(s_chain.unexpectedRemovals, 0)
+        << "OnRemoved should only be called with the removed hook's id";
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Hooks,
+    CallbackRemovalTest,
+    ::testing::Combine(
+        ::testing::Values(HookKind::Static, HookKind::Virtual),
+        ::testing::Bool(),
+        ::testing::Bool(),
+        ::testing::Bool()
+    ),
+    [](const ::testing::TestParamInfo<CallbackRemovalParam>& info) {
+        std::string name(HookKindName(std::get<0>(info.param)));
+        name += std::get<1>(info.param) ? "_Post" : "_Pre";
+        name += std::get<2>(info.param) ? "_Sibling" : "_Self";
+        name += std::get<3>(info.param) ? "_Async" : "_Sync";
+        return name;
+    }
+);
+
+#pragma region OneShot
+
+// One-shot hooks of the benchmark, every thread has its own target and slot.
+// The pre callback removes its own hook on the first trigger.
+struct OneShotSlot {
+    std::atomic<int> hookId {KHook::INVALID_HOOK};
+    std::atomic<int> triggers {0};
+    std::atomic<int> removed {0};
+};
+
+static constexpr std::size_t kOneShotSlots = 256;
+static OneShotSlot s_oneShotSlots[kOneShotSlots];
+static std::atomic<std::uint64_t> s_oneShotUnexpected {0};
+static std::atomic<bool> s_oneShotAsync {false};
+static thread_local OneShotSlot* t_oneShotSlot = nullptr;
+
+class OneShotHook {
+  public:
+    NOINLINE static int Pre(GeneratedObject* obj, int value) {
+        OneShotSlot* slot = t_oneShotSlot;
+        if (slot->triggers++ == 0) {
+            KHook::RemoveHook(slot->hookId, s_oneShotAsync);
+        }
+        KHook::SaveReturnValue(
+            KHook::Action::Ignore,
+            nullptr,
+            0,
+            nullptr,
+            nullptr,
+            false
+        );
+        return 0;
+    }
+
+    // May run on another thread for async removals, so look the slot up.
+    NOINLINE static void OnRemoved(int hookId) {
+        for (OneShotSlot& slot : s_oneShotSlots) {
+            if (slot.hookId == hookId) {
+                slot.removed++;
+                return;
+            }
+        }
+        s_oneShotUnexpected++;
+    }
+};
+
+#pragma endregion
+
+class OneShotRemovalBenchmark: public ::testing::Test {
+  protected:
+    struct WorkerResult {
+        LatencyHistogram install;
+        LatencyHistogram trigger;
+        LatencyHistogram cycle;
+        std::uint64_t failedInstalls = 0;
+        std::uint64_t badCalls = 0;
+        std::uint64_t lostRemovals = 0;
+        std::uint64_t repeatedTriggers = 0;
+    };
+
+    static void
+    RunCycles(std::size_t worker, std::size_t cycles, WorkerResult& result) {
+        OneShotSlot& slot = s_oneShotSlots[worker];
+        t_oneShotSlot = &slot;
+        GeneratedFunction function = GetGeneratedFunction(worker);
+
+        for (std::size_t c = 0; c < cycles; c++) {
+            slot.triggers = 0;
+            slot.removed = 0;
+
+            // Straight to KHook, a HookHandle would add the registry's lock to
+            // the measured install latency.
+            std::int64_t start = GetWallTimeNs();
+            int hookId = KHook::SetupHook(
+                (void*)function,
+                nullptr,
+                (void*)&OneShotHook::OnRemoved,
+                (void*)&OneShotHook::Pre,
+                (void*)&GeneratedStaticHook::PrePostNoop,
+                (void*)&GeneratedStaticHook::MakeReturn,
+                (void*)&GeneratedStaticHook::CallOriginal,
+                false
+            );
+            std::int64_t installed = GetWallTimeNs();
+            if (hookId == KHook::INVALID_HOOK) {
+                result.failedInstalls++;
+                continue;
+            }
+            slot.hookId = hookId;
+
+            GeneratedObject obj {};
+            int value = (int)(c & 0xFFFF);
+            bool ok = function(&obj, value) == value;
+            std::int64_t triggered = GetWallTimeNs();
+
+            std::int64_t deadline = triggered + 1000000000;
+            while (slot.removed == 0 && GetWallTimeNs() < deadline) {
+                std::this_thread::yield();
+            }
+            std::int64_t end = GetWallTimeNs();
+
+            ok = ok && function(&obj, value + 1) == value + 1;
+            result.badCalls += ok ? 0 : 1;
+            result.lostRemovals += slot.removed == 1 ? 0 : 1;
+            result.repeatedTriggers += slot.triggers == 1 ? 0 : 1;
+            slot.hookId = KHook::INVALID_HOOK;
+
+            result.install.Record(installed - start);
+            result.trigger.Record(triggered - installed);
+            result.cycle.Record(end - start);
+
+            if (slot.removed == 0) {
+                // Don't wait out the deadline on every remaining cycle.
+                break;
+            }
+        }
+        t_oneShotSlot = nullptr;
+    }
+
+    ScopedCallbackLogging m_quiet {false};
+};
+
+TEST_F(OneShotRemovalBenchmark, InstallTriggerSelfRemove) {
+    BENCHMARK_ONLY();
+
+    std::size_t threads = std::min<std::size_t>(BenchThreads(), kOneShotSlots);
+    std::size_t cycles = BenchIterations(20000);
+    ReportMetric("threads", (double)threads, "threads");
+
+    for (bool async : {false, true}) {
+        s_oneShotAsync = async;
+        s_oneShotUnexpected = 0;
+
+        std::vector<WorkerResult> results(threads);
+        std::vector<std::thread> workers;
+        for (std::size_t t = 0; t < threads; t++) {
+            workers.emplace_back([&, t]() { RunCycles(t, cycles, results[t]); });
+        }
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+
+        WorkerResult total;
+        for (const WorkerResult& result : results) {
+            total.install.Merge(result.install);
+            total.trigger.Merge(result.trigger);
+            total.cycle.Merge(result.cycle);
+            total.failedInstalls += result.failedInstalls;
+            total.badCalls += result.badCalls;
+            total.lostRemovals += result.lostRemovals;
+            total.repeatedTriggers += result.repeatedTriggers;
+        }
+
+        std::string name = async ? "async" : "sync";
+        ReportLatencies((name + ".install").c_str(), total.install.Summarize());
+        ReportLatencies(
+            (name + ".trigger_and_remove").c_str(),
+            total.trigger.Summarize()
+        );
+        ReportLatencies((name + ".cycle").c_str(), total.cycle.Summarize());
+
+        EXPECT_EQ(total.failedInstalls, 0u) << "Hook setup should succeed";
+        EXPECT_EQ(total.badCalls, 0u)
+            << "Calls should keep the original value across self-removal";
+        EXPECT_EQ(total.lostRemovals, 0u)
+            << "OnRemoved should run exactly once per cycle";
+        EXPECT_EQ(total.repeatedTriggers, 0u)
+            << "A self-removed hook should not trigger again";
+        EXPECT_EQ(s_oneShotUnexpected.load(), 0u)
+            << "OnRemoved should only be called for live one-shot hooks";
+    }
+}
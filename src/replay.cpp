@@ -0,0 +1,451 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <khook.hpp>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.hpp"
+#include "hooks.hpp"
+#include "main.hpp"
+#include "options.hpp"
+
+#pragma region CallTrace
+
+// Every call of the trace goes to one of the HookedClass shapes, as a static
+// function or through a vtable.
+enum class TraceTarget : std::uint16_t {
+    StaticIsAllowed,
+    StaticSetObjectValue,
+    StaticMyVoid,
+    VirtualIsAllowed,
+    VirtualSetObjectValue,
+    VirtualMyVoid,
+    Count
+};
+
+static const char* TraceTargetName(TraceTarget target) {
+    switch (target) {
+        case TraceTarget::StaticIsAllowed:
+            return "Static.IsAllowed";
+        case TraceTarget::StaticSetObjectValue:
+            return "Static.SetObjectValue";
+        case TraceTarget::StaticMyVoid:
+            return "Static.MyVoid";
+        case TraceTarget::VirtualIsAllowed:
+            return "Virtual.IsAllowed";
+        case TraceTarget::VirtualSetObjectValue:
+            return "Virtual.SetObjectValue";
+        default:
+            return "Virtual.MyVoid";
+    }
+}
+
+// Records are stored as they are in memory, traces are only exchanged between
+// little endian machines.
+struct TraceRecord {
+    // Time since the previous call of the same thread.
+    std::uint32_t interArrivalNs;
+    std::int32_t argument;
+    std::uint16_t target;
+    std::uint16_t thread;
+};
+
+static_assert(sizeof(TraceRecord) == 12, "Trace records must stay packed");
+
+struct TraceHeader {
+    char magic[4];
+    std::uint32_t version;
+    std::uint64_t records;
+};
+
+static constexpr char kTraceMagic[4] = {'K', 'H', 'T', 'R'};
+static constexpr std::uint32_t kTraceVersion = 1;
+
+static bool WriteCallTrace(FILE* file, const std::vector<TraceRecord>& records) {
+    TraceHeader header {};
+    memcpy(header.magic, kTraceMagic, sizeof(header.magic));
+    header.version = kTraceVersion;
+    header.records = records.size();
+    if (fwrite(&header, sizeof(header), 1, file) != 1) {
+        return false;
+    }
+    return records.empty()
+        || fwrite(records.data(), sizeof(TraceRecord), records.size(), file)
+        == records.size();
+}
+
+static bool ReadCallTrace(FILE* file, std::vector<TraceRecord>* records) {
+    records->clear();
+    TraceHeader header {};
+    if (fread(&header, sizeof(header), 1, file) != 1
+        || memcmp(header.magic, kTraceMagic, sizeof(header.magic)) != 0
+        || header.version != kTraceVersion) {
+        return false;
+    }
+
+    // The count comes from the file, it has to fit into what is left of the
+    // file before anything is allocated for it.
+    long position = ftell(file);
+    if (position < 0 || fseek(file, 0, SEEK_END) != 0) {
+        return false;
+    }
+    long end = ftell(file);
+    if (end < position || fseek(file, position, SEEK_SET) != 0
+        || header.records
+            > (std::uint64_t)(end - position) / sizeof(TraceRecord)) {
+        return false;
+    }
+
+    records->resize((std::size_t)header.records);
+    if (header.records > 0
+        && fread(records->data(), sizeof(TraceRecord), records->size(), file)
+            != records->size()) {
+        records->clear();
+        return false;
+    }
+    for (const TraceRecord& record : *records) {
+        if (record.target >= (std::uint16_t)TraceTarget::Count) {
+            records->clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+// Stand-in for a captured trace: a few hot targets, most calls to SetObjectValue
+// and bursts of back to back calls between idle gaps.
+static std::vector<TraceRecord>
+MakeSyntheticTrace(std::size_t threads, std::size_t callsPerThread) {
+    std::vector<TraceRecord> records;
+    records.reserve(threads * callsPerThread);
+
+    std::mt19937 random(42);
+    std::discrete_distribution<int> targets({4, 30, 2, 6, 50, 8});
+    std::exponential_distribution<double> gap(1.0 / 2000.0);
+    std::bernoulli_distribution burst(0.8);
+
+    // Threads are interleaved the way a capture of a live process would be.
+    for (std::size_t i = 0; i < callsPerThread; i++) {
+        for (std::size_t t = 0; t < threads; t++) {
+            TraceRecord record {};
+            record.interArrivalNs =
+                burst(random) ? 0 : (std::uint32_t)gap(random);
+            record.argument = (int)(random() & 0xFFFF) + 1;
+            record.target = (std::uint16_t)targets(random);
+            record.thread = (std::uint16_t)t;
+            records.push_back(record);
+        }
+    }
+    return records;
+}
+
+#pragma endregion
+
+TEST(CallTraceTest, RoundTripsRecords) {
+    std::vector<TraceRecord> records = MakeSyntheticTrace(3, 100);
+    FILE* file = tmpfile();
+    ASSERT_NE(file, nullptr) << "Should create a temporary trace file";
+
+    ASSERT_TRUE(WriteCallTrace(file, records));
+    rewind(file);
+    std::vector<TraceRecord> read;
+    ASSERT_TRUE(ReadCallTrace(file, &read)) << "Should read back its own trace";
+    ASSERT_EQ(read.size(), records.size());
+    EXPECT_EQ(
+        memcmp(read.data(), records.data(), read.size() * sizeof(TraceRecord)),
+        0
+    ) << "Records should survive the round trip unchanged";
+
+    // A truncated trace is rejected instead of being replayed in part.
+    rewind(file);
+    TraceHeader header {};
+    ASSERT_EQ(fread(&header, sizeof(header), 1, file), 1u);
+    header.records++;
+    rewind(file);
+    ASSERT_EQ(fwrite(&header, sizeof(header), 1, file), 1u);
+    rewind(file);
+    EXPECT_FALSE(ReadCallTrace(file, &read)) << "Truncated trace should fail";
+    EXPECT_TRUE(read.empty());
+
+    // So is a count no file could hold, before anything is allocated for it.
+    header.records = UINT64_MAX;
+    rewind(file);
+    ASSERT_EQ(fwrite(&header, sizeof(header), 1, file), 1u);
+    rewind(file);
+    EXPECT_FALSE(ReadCallTrace(file, &read)) << "Oversized count should fail";
+    EXPECT_TRUE(read.empty());
+    fclose(file);
+}
+
+class TraceReplayBenchmark: public ::testing::Test {
+  protected:
+    class TestObject {
+      public:
+        int m_testValue;
+    };
+
+    // Every target leaves a mark in the object, an empty one would have its
+    // call dropped at the call site despite NOINLINE, and Call() would time
+    // nothing without noticing.
+    static constexpr int kIsAllowedMark = -1;
+    static constexpr int kMyVoidMark = -2;
+
+    class HookedClass {
+      public:
+        NOINLINE static bool IsAllowed(TestObject* obj) {
+            obj->m_testValue = kIsAllowedMark;
+            return true;
+        }
+
+        NOINLINE static int SetObjectValue(TestObject* obj, int value) {
+            obj->m_testValue = value;
+            return value;
+        }
+
+        NOINLINE static void MyVoid(TestObject* obj) {
+            obj->m_testValue = kMyVoidMark;
+        }
+    };
+
+    class VirtualHookedClass {
+      public:
+        virtual bool IsAllowed(TestObject* obj) {
+            obj->m_testValue = kIsAllowedMark;
+            return true;
+        }
+
+        virtual int SetObjectValue(TestObject* obj, int value) {
+            obj->m_testValue = value;
+            return value;
+        }
+
+        virtual void MyVoid(TestObject* obj) {
+            obj->m_testValue = kMyVoidMark;
+        }
+    };
+
+    using IsAllowedNoopHook = NoopStaticHookTemplate<bool, TestObject*>;
+    using SetObjectValueNoopHook = NoopStaticHookTemplate<int, TestObject*, int>;
+    using MyVoidNoopHook = NoopStaticHookTemplate<void, TestObject*>;
+    using VirtualIsAllowedNoopHook = NoopMemberHookTemplate<bool, TestObject*>;
+    using VirtualSetObjectValueNoopHook =
+        NoopMemberHookTemplate<int, TestObject*, int>;
+    using VirtualMyVoidNoopHook = NoopMemberHookTemplate<void, TestObject*>;
+
+    static constexpr std::size_t kTargets = (std::size_t)TraceTarget::Count;
+
+    struct ReplayResult {
+        std::array<LatencyHistogram, kTargets> latencies;
+        LatencyHistogram lag;
+        std::uint64_t calls = 0;
+        std::uint64_t badCalls = 0;
+    };
+
+    void SetUp() override {
+        target = new VirtualHookedClass();
+    }
+
+    void TearDown() override {
+        m_hooks.clear();
+        if (target) {
+            delete target;
+            target = nullptr;
+        }
+    }
+
+    template<typename Hook>
+    HookHandle InstallStatic(void* function) {
+        return HookHandle::SetupHook(
+            function,
+            nullptr,
+            (void*)&Hook::OnRemoved,
+            (void*)&Hook::PrePostNoop,
+            (void*)&Hook::PrePostNoop,
+            (void*)&Hook::MakeReturn,
+            (void*)&Hook::CallOriginal,
+            false
+        );
+    }
+
+    template<typename Hook>
+    HookHandle InstallVirtual(int index) {
+        return HookHandle::SetupVirtualHook(
+            *(void***)(target),
+            index,
+            nullptr,
+            KHook::ExtractMFP(&Hook::OnRemoved),
+            KHook::ExtractMFP(&Hook::PrePostNoop),
+            KHook::ExtractMFP(&Hook::PrePostNoop),
+            KHook::ExtractMFP(&Hook::MakeReturn),
+            KHook::ExtractMFP(&Hook::CallOriginal),
+            false
+        );
+    }
+
+    void InstallAll() {
+        m_hooks.push_back(
+            InstallStatic<IsAllowedNoopHook>((void*)&HookedClass::IsAllowed)
+        );
+        m_hooks.push_back(InstallStatic<SetObjectValueNoopHook>(
+            (void*)&HookedClass::SetObjectValue
+        ));
+        m_hooks.push_back(
+            InstallStatic<MyVoidNoopHook>((void*)&HookedClass::MyVoid)
+        );
+        m_hooks.push_back(InstallVirtual<VirtualIsAllowedNoopHook>(
+            KHook::GetVtableIndex(&VirtualHookedClass::IsAllowed)
+        ));
+        m_hooks.push_back(InstallVirtual<VirtualSetObjectValueNoopHook>(
+            KHook::GetVtableIndex(&VirtualHookedClass::SetObjectValue)
+        ));
+        m_hooks.push_back(InstallVirtual<VirtualMyVoidNoopHook>(
+            KHook::GetVtableIndex(&VirtualHookedClass::MyVoid)
+        ));
+    }
+
+    bool Call(const TraceRecord& record) {
+        TestObject obj {};
+        switch ((TraceTarget)record.target) {
+            case TraceTarget::StaticIsAllowed:
+                return HookedClass::IsAllowed(&obj)
+                    && obj.m_testValue == kIsAllowedMark;
+            case TraceTarget::StaticSetObjectValue:
+                return HookedClass::SetObjectValue(&obj, record.argument)
+                    == record.argument
+                    && obj.m_testValue == record.argument;
+            case TraceTarget::StaticMyVoid:
+                HookedClass::MyVoid(&obj);
+                return obj.m_testValue == kMyVoidMark;
+            case TraceTarget::VirtualIsAllowed:
+                return target->IsAllowed(&obj)
+                    && obj.m_testValue == kIsAllowedMark;
+            case TraceTarget::VirtualSetObjectValue:
+                return target->SetObjectValue(&obj, record.argument)
+                    == record.argument
+                    && obj.m_testValue == record.argument;
+            default:
+                target->MyVoid(&obj);
+                return obj.m_testValue == kMyVoidMark;
+        }
+    }
+
+    // Issues the calls of one trace thread at their recorded times, counted
+    // from a start shared by all threads. A call that is due already goes out
+    // right away, the lag says how far behind the schedule the replay fell.
+    void Replay(
+        const std::vector<TraceRecord>& records,
+        std::int64_t due,
+        ReplayResult& result
+    ) {
+        for (const TraceRecord& record : records) {
+            due += record.interArrivalNs;
+            std::int64_t now = GetWallTimeNs();
+            while (now < due) {
+                now = GetWallTimeNs();
+            }
+            result.lag.Record(now - due);
+
+            std::uint64_t start = BenchTicksBegin();
+            bool ok = Call(record);
+            result.latencies[record.target].Record(BenchElapsedNs(start));
+            result.calls++;
+            result.badCalls += ok ? 0 : 1;
+        }
+    }
+
+    ScopedCallbackLogging m_quiet {false};
+    VirtualHookedClass* target = nullptr;
+    std::vector<HookHandle> m_hooks;
+};
+
+TEST_F(TraceReplayBenchmark, ReplayCallMix) {
+    BENCHMARK_ONLY();
+
+    std::vector<TraceRecord> records;
+    if (g_options.replayTrace.empty()) {
+        records = MakeSyntheticTrace(BenchThreads(), BenchIterations(50000));
+    } else {
+        FILE* file = fopen(g_options.replayTrace.c_str(), "rb");
+        ASSERT_NE(file, nullptr) << "Should open " << g_options.replayTrace;
+        bool read = ReadCallTrace(file, &records);
+        fclose(file);
+        ASSERT_TRUE(read) << g_options.replayTrace << " is not a valid trace";
+    }
+
+    // One replay thread per thread of the trace, in order of first appearance.
+    std::map<std::uint16_t, std::size_t> threadIndex;
+    std::vector<std::vector<TraceRecord>> perThread;
+    for (const TraceRecord& record : records) {
+        auto it = threadIndex.find(record.thread);
+        if (it == threadIndex.end()) {
+            it = threadIndex.emplace(record.thread, perThread.size()).first;
+            perThread.emplace_back();
+        }
+        perThread[it->second].push_back(record);
+    }
+    ReportMetric("trace_calls", (double)records.size(), "calls");
+    ReportMetric("trace_threads", (double)perThread.size(), "threads");
+
+    InstallAll();
+    for (const HookHandle& hook : m_hooks) {
+        ASSERT_TRUE(hook.Valid()) << "Hook setup should succeed";
+    }
+
+    std::vector<ReplayResult> results(perThread.size());
+    std::vector<std::thread> threads;
+    unsigned int cpus = std::max(1u, std::thread::hardware_concurrency());
+    BenchNsPerTick();
+    // Gives every thread the time to start before the first call is due.
+    std::int64_t start = GetWallTimeNs() + 10000000;
+    for (std::size_t t = 0; t < perThread.size(); t++) {
+        threads.emplace_back([&, t]() {
+            ScopedCpuPin pin((int)(t % cpus));
+            Replay(perThread[t], start, results[t]);
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    std::int64_t elapsed = GetWallTimeNs() - start;
+
+    ReplayResult total;
+    for (const ReplayResult& result : results) {
+        for (std::size_t i = 0; i < kTargets; i++) {
+            total.latencies[i].Merge(result.latencies[i]);
+        }
+        total.lag.Merge(result.lag);
+        total.calls += result.calls;
+        total.badCalls += result.badCalls;
+    }
+
+    LatencyHistogram all;
+    for (std::size_t i = 0; i < kTargets; i++) {
+        all.Merge(total.latencies[i]);
+        if (total.latencies[i].Count() > 0) {
+            ReportLatencies(
+                TraceTargetName((TraceTarget)i),
+                total.latencies[i].Summarize()
+            );
+        }
+    }
+    ReportLatencies("call", all.Summarize());
+    ReportLatencies("schedule_lag", total.lag.Summarize());
+    ReportMetric(
+        "throughput",
+        (double)total.calls * 1e9 / (double)(elapsed > 0 ? elapsed : 1),
+        "calls/s"
+    );
+
+    EXPECT_EQ(total.calls, (std::uint64_t)records.size())
+        << "Every call of the trace should be replayed";
+    EXPECT_EQ(total.badCalls, 0u)
+        << "Hooked calls should keep the original value";
+}
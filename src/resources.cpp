@@ -0,0 +1,469 @@
+#include "resources.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+
+#if defined(_WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+
+    #include <psapi.h>
+#else
+    #include <sys/resource.h>
+    #include <time.h>
+    #include <unistd.h>
+#endif
+
+#if defined(__linux__)
+    #include <linux/perf_event.h>
+    #include <sys/ioctl.h>
+    #include <sys/syscall.h>
+#endif
+
+static std::atomic<std::uint64_t> s_allocations {0};
+static ResourceBudget s_testBudget;
+static std::size_t s_testThreads = 1;
+
+#pragma region Allocation counting
+
+void* operator new(std::size_t size) {
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+    std::free(ptr);
+}
+
+#pragma endregion
+
+std::int64_t GetWallTimeNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()
+    )
+        .count();
+}
+
+std::int64_t GetProcessCpuTimeNs() {
+#if defined(_WIN32)
+    FILETIME creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) {
+        return 0;
+    }
+    ULARGE_INTEGER k, u;
+    k.LowPart = kernel.dwLowDateTime;
+    k.HighPart = kernel.dwHighDateTime;
+    u.LowPart = user.dwLowDateTime;
+    u.HighPart = user.dwHighDateTime;
+    // FILETIME is expressed in 100ns intervals.
+    return (std::int64_t)(k.QuadPart + u.QuadPart) * 100;
+#else
+    timespec ts;
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) != 0) {
+        return 0;
+    }
+    return (std::int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+std::int64_t GetPeakRssKb() {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return 0;
+    }
+    return (std::int64_t)(counters.PeakWorkingSetSize / 1024);
+#else
+    #if defined(__linux__)
+    // Unlike ru_maxrss, VmHWM starts over after ResetPeakRss().
+    if (FILE* status = fopen("/proc/self/status", "r")) {
+        char line[256];
+        long long kb = -1;
+        while (kb < 0 && fgets(line, sizeof(line), status)) {
+            if (sscanf(line, "VmHWM: %lld kB", &kb) != 1) {
+                kb = -1;
+            }
+        }
+        fclose(status);
+        if (kb >= 0) {
+            return kb;
+        }
+    }
+    #endif
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+    #if defined(__APPLE__)
+    return usage.ru_maxrss / 1024;
+    #else
+    return usage.ru_maxrss;
+    #endif
+#endif
+}
+
+std::int64_t GetCurrentRssKb() {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return 0;
+    }
+    return (std::int64_t)(counters.WorkingSetSize / 1024);
+#elif defined(__linux__)
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (!statm) {
+        return 0;
+    }
+    long long size = 0, resident = 0;
+    if (fscanf(statm, "%lld %lld", &size, &resident) != 2) {
+        resident = 0;
+    }
+    fclose(statm);
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+#else
+    return GetPeakRssKb();
+#endif
+}
+
+bool ResetPeakRss() {
+#if defined(__linux__)
+    FILE* clearRefs = fopen("/proc/self/clear_refs", "w");
+    if (!clearRefs) {
+        return false;
+    }
+    bool written = fputs("5", clearRefs) >= 0;
+    return fclose(clearRefs) == 0 && written;
+#else
+    return false;
+#endif
+}
+
+std::uint64_t GetAllocationCount() {
+    return s_allocations.load(std::memory_order_relaxed);
+}
+
+ResourceSnapshot TakeResourceSnapshot() {
+    ResourceSnapshot snapshot;
+    snapshot.wallNs = GetWallTimeNs();
+    snapshot.cpuNs = GetProcessCpuTimeNs();
+    snapshot.peakRssKb = GetPeakRssKb();
+    snapshot.currentRssKb = GetCurrentRssKb();
+    snapshot.allocations = GetAllocationCount();
+    return snapshot;
+}
+
+std::size_t GetPageSize() {
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#else
+    return (std::size_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+MappingStats ReadMappingStats() {
+    MappingStats stats;
+#if defined(_WIN32)
+    const DWORD execProtect = PAGE_EXECUTE | PAGE_EXECUTE_READ
+        | PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY;
+    MEMORY_BASIC_INFORMATION info;
+    char* address = nullptr;
+    while (VirtualQuery(address, &info, sizeof(info)) == sizeof(info)) {
+        if (info.State == MEM_COMMIT) {
+            std::int64_t size = (std::int64_t)info.RegionSize;
+            bool exec = (info.Protect & execProtect) != 0;
+            bool anon = info.Type == MEM_PRIVATE;
+            stats.mappings++;
+            stats.execBytes += exec ? size : 0;
+            stats.anonBytes += anon ? size : 0;
+            stats.anonExecBytes += exec && anon ? size : 0;
+        }
+        char* next = (char*)info.BaseAddress + info.RegionSize;
+        if (next <= address) {
+            break;
+        }
+        address = next;
+    }
+#elif defined(__linux__)
+    FILE* maps = fopen("/proc/self/maps", "r");
+    if (!maps) {
+        return stats;
+    }
+    char line[4096];
+    while (fgets(line, sizeof(line), maps)) {
+        unsigned long long start, end, offset, inode;
+        char perms[8];
+        int consumed = 0;
+        if (sscanf(
+                line,
+                "%llx-%llx %7s %llx %*s %llu%n",
+                &start,
+                &end,
+                perms,
+                &offset,
+                &inode,
+                &consumed
+            )
+            < 5) {
+            continue;
+        }
+        const char* path = line + consumed;
+        while (*path == ' ' || *path == '\t') {
+            path++;
+        }
+        std::int64_t size = (std::int64_t)(end - start);
+        bool exec = perms[2] == 'x';
+        bool anon = inode == 0
+            && (*path == '\n' || *path == '\0' || strncmp(path, "[anon", 5) == 0);
+        stats.mappings++;
+        stats.execBytes += exec ? size : 0;
+        stats.anonBytes += anon ? size : 0;
+        stats.anonExecBytes += exec && anon ? size : 0;
+    }
+    fclose(maps);
+#endif
+    return stats;
+}
+
+PrivateDirtyStats ReadPrivateDirtyStats() {
+    PrivateDirtyStats stats;
+#if defined(__linux__)
+    FILE* smaps = fopen("/proc/self/smaps", "r");
+    if (!smaps) {
+        return stats;
+    }
+    char line[4096];
+    bool exec = false;
+    while (fgets(line, sizeof(line), smaps)) {
+        unsigned long long start, end;
+        char perms[8];
+        long long kb = 0;
+        if (sscanf(line, "%llx-%llx %7s", &start, &end, perms) == 3) {
+            exec = perms[2] == 'x';
+        } else if (sscanf(line, "Private_Dirty: %lld kB", &kb) == 1) {
+            stats.totalKb += kb;
+            stats.execKb += exec ? kb : 0;
+        }
+    }
+    fclose(smaps);
+#endif
+    return stats;
+}
+
+#pragma region PerfCounter
+
+PerfCounter::PerfCounter(Event event) {
+#if defined(__linux__)
+    std::uint64_t cache = PERF_COUNT_HW_CACHE_L1D;
+    if (event == Event::InstructionCacheMisses) {
+        cache = PERF_COUNT_HW_CACHE_L1I;
+    } else if (event == Event::InstructionTlbMisses) {
+        cache = PERF_COUNT_HW_CACHE_ITLB;
+    }
+    Open(
+        PERF_TYPE_HW_CACHE,
+        cache | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+            | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+    );
+#endif
+}
+
+PerfCounter::PerfCounter(std::uint64_t rawEvent) {
+#if defined(__linux__)
+    if (rawEvent != 0) {
+        Open(PERF_TYPE_RAW, rawEvent);
+    }
+#endif
+}
+
+void PerfCounter::Open(std::uint32_t type, std::uint64_t config) {
+#if defined(__linux__)
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    m_fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+}
+
+PerfCounter::~PerfCounter() {
+#if defined(__linux__)
+    if (m_fd >= 0) {
+        close(m_fd);
+    }
+#endif
+}
+
+void PerfCounter::Start() {
+#if defined(__linux__)
+    if (m_fd >= 0) {
+        ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+}
+
+std::uint64_t PerfCounter::Stop() {
+    std::uint64_t count = 0;
+#if defined(__linux__)
+    if (m_fd >= 0) {
+        ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(m_fd, &count, sizeof(count)) != sizeof(count)) {
+            count = 0;
+        }
+    }
+#endif
+    return count;
+}
+
+#pragma endregion
+
+void SetTestResourceBudget(const ResourceBudget& budget) {
+    s_testBudget = budget;
+}
+
+void SetTestThreadCount(std::size_t threads) {
+    s_testThreads = threads > 0 ? threads : 1;
+}
+
+ResourceListener::ResourceListener(
+    const ResourceBudget& defaultBudget,
+    const char* report
+) :
+    m_defaultBudget(defaultBudget) {
+    if (report && report[0]) {
+        m_report = fopen(report, "w");
+        if (m_report) {
+            fprintf(
+                m_report,
+                "test,wall_ms,cpu_ms,peak_rss_delta_kb,allocations,status\n"
+            );
+        } else {
+            fprintf(stderr, "Failed to open resource report \"%s\"\n", report);
+        }
+    }
+}
+
+ResourceListener::~ResourceListener() {
+    if (m_report) {
+        fclose(m_report);
+    }
+}
+
+void ResourceListener::OnTestStart(const ::testing::TestInfo& info) {
+    s_testBudget = m_defaultBudget;
+    s_testThreads = 1;
+    m_peakReset = ResetPeakRss();
+    m_start = TakeResourceSnapshot();
+}
+
+void ResourceListener::OnTestEnd(const ::testing::TestInfo& info) {
+    ResourceSnapshot end = TakeResourceSnapshot();
+
+    double wallMs = (end.wallNs - m_start.wallNs) / 1e6;
+    double cpuMs = (end.cpuNs - m_start.cpuNs) / 1e6;
+    // Without a reset the peak may still be the one of an earlier test.
+    long long rssKb = m_peakReset
+        ? (long long)(end.peakRssKb - m_start.currentRssKb)
+        : (long long)(end.currentRssKb - m_start.currentRssKb);
+    long long allocations = (long long)(end.allocations - m_start.allocations);
+
+    const ::testing::TestResult* result = info.result();
+    bool skipped = result->Skipped();
+
+    // Failures raised here are still attributed to the test that just ran,
+    // as long as this listener comes after the default result printer.
+    if (!skipped) {
+        const ResourceBudget& budget = s_testBudget;
+        if (budget.wallMs > 0 && wallMs > budget.wallMs) {
+            ADD_FAILURE() << "Wall time budget exceeded: " << wallMs
+                          << "ms > " << budget.wallMs << "ms";
+        }
+        double cpuBudgetMs = budget.cpuMs * (double)s_testThreads;
+        if (budget.cpuMs > 0 && cpuMs > cpuBudgetMs) {
+            ADD_FAILURE() << "CPU time budget exceeded: " << cpuMs << "ms > "
+                          << cpuBudgetMs << "ms (" << s_testThreads
+                          << " threads)";
+        }
+        if (budget.peakRssKb > 0 && rssKb > budget.peakRssKb) {
+            ADD_FAILURE() << "Peak RSS budget exceeded: +" << rssKb
+                          << "KB > " << budget.peakRssKb << "KB";
+        }
+        if (budget.allocations > 0 && allocations > budget.allocations) {
+            ADD_FAILURE() << "Allocation budget exceeded: " << allocations
+                          << " > " << budget.allocations;
+        }
+    }
+
+    if (m_report) {
+        const char* status = "passed";
+        if (skipped) {
+            status = "skipped";
+        } else if (result->Failed()) {
+            status = "failed";
+        }
+        fprintf(
+            m_report,
+            "%s.%s,%.3f,%.3f,%lld,%lld,%s\n",
+            info.test_suite_name(),
+            info.name(),
+            wallMs,
+            cpuMs,
+            rssKb,
+            allocations,
+            status
+        );
+        fflush(m_report);
+    }
+}
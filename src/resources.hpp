@@ -0,0 +1,117 @@
+#pragma once
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+struct ResourceSnapshot {
+    std::int64_t wallNs = 0;
+    std::int64_t cpuNs = 0;
+    std::int64_t peakRssKb = 0;
+    std::int64_t currentRssKb = 0;
+    std::uint64_t allocations = 0;
+};
+
+// A limit of zero or less disables that particular check. The CPU time limit
+// applies to each thread the test declared through SetTestThreadCount(). The
+// RSS limit is on the peak since the test started where the peak can be
+// reset (Linux), elsewhere only on the RSS growth from start to end, which
+// misses memory the test gave back before it ended.
+struct ResourceBudget {
+    double wallMs = 0.0;
+    double cpuMs = 0.0;
+    long long peakRssKb = 0;
+    long long allocations = 0;
+
+    static ResourceBudget Unlimited() {
+        return ResourceBudget();
+    }
+};
+
+// Committed mappings of the process, read from /proc/self/maps on Linux and
+// by walking the address space with VirtualQuery on Windows.
+struct MappingStats {
+    std::int64_t mappings = 0;
+    std::int64_t execBytes = 0;
+    std::int64_t anonBytes = 0;
+    std::int64_t anonExecBytes = 0;
+};
+
+// Pages only this process has written to, read from /proc/self/smaps. After
+// fork() this is what copy-on-write had to duplicate. Zero elsewhere.
+struct PrivateDirtyStats {
+    std::int64_t totalKb = 0;
+    std::int64_t execKb = 0;
+};
+
+std::int64_t GetWallTimeNs();
+std::int64_t GetProcessCpuTimeNs();
+std::int64_t GetPeakRssKb();
+std::int64_t GetCurrentRssKb();
+// Starts a new peak RSS from the current RSS, returns false where the peak
+// can't be reset and GetPeakRssKb() keeps the peak of the whole process.
+bool ResetPeakRss();
+std::uint64_t GetAllocationCount();
+ResourceSnapshot TakeResourceSnapshot();
+std::size_t GetPageSize();
+MappingStats ReadMappingStats();
+PrivateDirtyStats ReadPrivateDirtyStats();
+
+// A hardware event counted for the calling thread through perf_event_open,
+// user space only. Linux without a paranoid perf_event setting is required,
+// which rules out most containers and VMs, so check Valid() first.
+class PerfCounter {
+  public:
+    enum class Event {
+        InstructionCacheMisses,
+        InstructionTlbMisses,
+        DataCacheMisses,
+    };
+
+    explicit PerfCounter(Event event);
+    // A model specific event, as encoded in perf_event_attr.config for
+    // PERF_TYPE_RAW, e.g. the loads that hit a modified line of another core.
+    // Zero leaves the counter invalid.
+    explicit PerfCounter(std::uint64_t rawEvent);
+    ~PerfCounter();
+
+    PerfCounter(const PerfCounter&) = delete;
+    PerfCounter& operator=(const PerfCounter&) = delete;
+
+    bool Valid() const {
+        return m_fd >= 0;
+    }
+
+    void Start();
+    // Events since Start(), zero if the counter isn't valid.
+    std::uint64_t Stop();
+
+  private:
+    void Open(std::uint32_t type, std::uint64_t config);
+
+    int m_fd = -1;
+};
+
+// Overrides the budget of the currently running test, must be called from
+// inside the test body.
+void SetTestResourceBudget(const ResourceBudget& budget);
+// Tests that keep several threads busy declare how many, which scales their
+// CPU time budget. Must be called from inside the test body.
+void SetTestThreadCount(std::size_t threads);
+
+class ResourceListener: public ::testing::EmptyTestEventListener {
+  public:
+    ResourceListener(const ResourceBudget& defaultBudget, const char* report);
+    ~ResourceListener() override;
+
+    void OnTestStart(const ::testing::TestInfo& info) override;
+    void OnTestEnd(const ::testing::TestInfo& info) override;
+
+  private:
+    ResourceBudget m_defaultBudget;
+    ResourceSnapshot m_start;
+    bool m_peakReset = false;
+    FILE* m_report = nullptr;
+};
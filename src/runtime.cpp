@@ -0,0 +1,395 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <khook.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "hooks.hpp"
+#include "main.hpp"
+#include "targets.hpp"
+
+#pragma region ApiProbe
+
+enum class RuntimeApi {
+    GetOriginalFunction,
+    GetCurrentValuePtrTrue,
+    GetCurrentValuePtrFalse,
+    SaveReturnValueIgnore,
+    SaveReturnValueOverride,
+    DestroyReturnValue,
+    DoRecall,
+    Count
+};
+
+static const char* RuntimeApiName(RuntimeApi api) {
+    switch (api) {
+        case RuntimeApi::GetOriginalFunction:
+            return "GetOriginalFunction";
+        case RuntimeApi::GetCurrentValuePtrTrue:
+            return "GetCurrentValuePtr_true";
+        case RuntimeApi::GetCurrentValuePtrFalse:
+            return "GetCurrentValuePtr_false";
+        case RuntimeApi::SaveReturnValueIgnore:
+            return "SaveReturnValue_ignore";
+        case RuntimeApi::SaveReturnValueOverride:
+            return "SaveReturnValue_override";
+        case RuntimeApi::DestroyReturnValue:
+            return "DestroyReturnValue";
+        default:
+            return "DoRecall";
+    }
+}
+
+// What the probe hook should measure during the next hooked call. Calls that
+// can be repeated are timed in a loop from the post callback, where the
+// original already ran and a return value exists. DestroyReturnValue and
+// DoRecall can only happen once per call, every one of them is timed on its
+// own in MakeReturn and the pre callback, in time stamp counter ticks.
+struct ApiProbe {
+    bool armed = false;
+    bool inRecall = false;
+    RuntimeApi api = RuntimeApi::GetOriginalFunction;
+    std::size_t loops = 0;
+    std::uint64_t totalTicks = 0;
+    std::uint64_t samples = 0;
+    // Reserved up front, so recording doesn't allocate inside the callbacks.
+    std::vector<std::int64_t> onceTicks;
+};
+
+static thread_local ApiProbe t_probe;
+
+class ApiProbeHook {
+  public:
+    NOINLINE static int Pre(GeneratedObject* obj, int value) {
+        void* recall = nullptr;
+        if (BeginRecall(&recall)) {
+            reinterpret_cast<GeneratedFunction>(recall)(obj, value);
+            t_probe.inRecall = false;
+            return 0;
+        }
+        SaveIgnore();
+        return 0;
+    }
+
+    NOINLINE static int Post(GeneratedObject* obj, int value) {
+        if (t_probe.armed && t_probe.loops > 0) {
+            MeasureLoop();
+        }
+        SaveIgnore();
+        return 0;
+    }
+
+    NOINLINE static int MakeReturn(GeneratedObject* obj, int value) {
+        int result = *((int*)KHook::GetCurrentValuePtr(true));
+        if (t_probe.armed && t_probe.api == RuntimeApi::DestroyReturnValue) {
+            std::uint64_t start = BenchTicksBegin();
+            KHook::DestroyReturnValue();
+            t_probe.onceTicks.push_back(
+                (std::int64_t)(BenchTicksEnd() - start)
+            );
+        } else {
+            KHook::DestroyReturnValue();
+        }
+        return result;
+    }
+
+    NOINLINE int PreMember(GeneratedObject* obj, int value) {
+        void* recall = nullptr;
+        if (BeginRecall(&recall)) {
+            auto method =
+                KHook::BuildMFP<ApiProbeHook, int, GeneratedObject*, int>(recall);
+            (this->*method)(obj, value);
+            t_probe.inRecall = false;
+            return 0;
+        }
+        SaveIgnore();
+        return 0;
+    }
+
+    NOINLINE int PostMember(GeneratedObject* obj, int value) {
+        return Post(obj, value);
+    }
+
+    NOINLINE int MakeReturnMember(GeneratedObject* obj, int value) {
+        return MakeReturn(obj, value);
+    }
+
+  private:
+    static void SaveIgnore() {
+        KHook::SaveReturnValue(
+            KHook::Action::Ignore,
+            nullptr,
+            0,
+            nullptr,
+            nullptr,
+            false
+        );
+    }
+
+    // Recalls once per outer call, the recalled call runs the chain as usual.
+    static bool BeginRecall(void** recall) {
+        if (!t_probe.armed || t_probe.api != RuntimeApi::DoRecall
+            || t_probe.inRecall) {
+            return false;
+        }
+        t_probe.inRecall = true;
+        std::uint64_t start = BenchTicksBegin();
+        *recall = KHook::DoRecall(KHook::Action::Ignore, nullptr, 0, nullptr, nullptr);
+        t_probe.onceTicks.push_back((std::int64_t)(BenchTicksEnd() - start));
+        return true;
+    }
+
+    static void MeasureLoop() {
+        std::size_t loops = t_probe.loops;
+        int value = 0;
+        std::uint64_t start = BenchTicksBegin();
+        switch (t_probe.api) {
+            case RuntimeApi::GetOriginalFunction:
+                for (std::size_t i = 0; i < loops; i++) {
+                    DoNotOptimize(KHook::GetOriginalFunction());
+                }
+                break;
+            case RuntimeApi::GetCurrentValuePtrTrue:
+                for (std::size_t i = 0; i < loops; i++) {
+                    DoNotOptimize(KHook::GetCurrentValuePtr(true));
+                }
+                break;
+            case RuntimeApi::GetCurrentValuePtrFalse:
+                for (std::size_t i = 0; i < loops; i++) {
+                    DoNotOptimize(KHook::GetCurrentValuePtr(false));
+                }
+                break;
+            case RuntimeApi::SaveReturnValueIgnore:
+                for (std::size_t i = 0; i < loops; i++) {
+                    SaveIgnore();
+                }
+                break;
+            case RuntimeApi::SaveReturnValueOverride:
+                // Overrides with the value the original returned, so the
+                // result of the call stays the same.
+                value = *((int*)KHook::GetCurrentValuePtr(false));
+                for (std::size_t i = 0; i < loops; i++) {
+                    KHook::SaveReturnValue(
+                        KHook::Action::Override,
+                        &value,
+                        sizeof(int),
+                        (void*)KHook::init_operator<int>,
+                        (void*)KHook::deinit_operator<int>,
+                        false
+                    );
+                }
+                break;
+            default:
+                break;
+        }
+        t_probe.totalTicks += BenchTicksEnd() - start;
+        t_probe.samples += loops;
+    }
+};
+
+#pragma endregion
+
+class RuntimeApiBenchmark: public ::testing::TestWithParam<HookKind> {
+  protected:
+    void SetUp() override {
+        instance.reset(new GeneratedInstance(1));
+        t_probe = ApiProbe();
+    }
+
+    void TearDown() override {
+        m_hooks.clear();
+        instance.reset();
+        t_probe = ApiProbe();
+    }
+
+    HookHandle InstallProbe() {
+        if (GetParam() == HookKind::Static) {
+            return HookHandle::SetupHook(
+                (void*)GetGeneratedFunction(0),
+                nullptr,
+                (void*)&GeneratedStaticHook::OnRemoved,
+                (void*)&ApiProbeHook::Pre,
+                (void*)&ApiProbeHook::Post,
+                (void*)&ApiProbeHook::MakeReturn,
+                (void*)&GeneratedStaticHook::CallOriginal,
+                false
+            );
+        }
+        return HookHandle::SetupVirtualHook(
+            instance->Vtable(),
+            0,
+            nullptr,
+            KHook::ExtractMFP(&GeneratedMemberHook::OnRemoved),
+            KHook::ExtractMFP(&ApiProbeHook::PreMember),
+            KHook::ExtractMFP(&ApiProbeHook::PostMember),
+            KHook::ExtractMFP(&ApiProbeHook::MakeReturnMember),
+            KHook::ExtractMFP(&GeneratedMemberHook::CallOriginal),
+            false
+        );
+    }
+
+    HookHandle InstallNoop() {
+        if (GetParam() == HookKind::Static) {
+            return HookHandle::SetupHook(
+                (void*)GetGeneratedFunction(0),
+                nullptr,
+                (void*)&GeneratedStaticHook::OnRemoved,
+                (void*)&GeneratedStaticHook::PrePostNoop,
+                (void*)&GeneratedStaticHook::PrePostNoop,
+                (void*)&GeneratedStaticHook::MakeReturn,
+                (void*)&GeneratedStaticHook::CallOriginal,
+                false
+            );
+        }
+        return HookHandle::SetupVirtualHook(
+            instance->Vtable(),
+            0,
+            nullptr,
+            KHook::ExtractMFP(&GeneratedMemberHook::OnRemoved),
+            KHook::ExtractMFP(&GeneratedMemberHook::PrePostNoop),
+            KHook::ExtractMFP(&GeneratedMemberHook::PrePostNoop),
+            KHook::ExtractMFP(&GeneratedMemberHook::MakeReturn),
+            KHook::ExtractMFP(&GeneratedMemberHook::CallOriginal),
+            false
+        );
+    }
+
+    bool Call(int value) {
+        GeneratedObject obj {};
+        int result;
+        if (GetParam() == HookKind::Static) {
+            result = GetGeneratedFunction(0)(&obj, value);
+        } else {
+            result = instance->Call(0, &obj, value);
+        }
+        return result == value && obj.m_testValue == value;
+    }
+
+    // Distribution of a pair of counter reads with nothing between them, the
+    // floor under every call timed on its own.
+    static LatencySummary TimerOverhead() {
+        std::vector<std::int64_t> ticks(BenchIterations(100000));
+        for (std::int64_t& sample : ticks) {
+            std::uint64_t start = BenchTicksBegin();
+            sample = (std::int64_t)(BenchTicksEnd() - start);
+        }
+        return TicksToNs(SummarizeLatencies(ticks));
+    }
+
+    // Per call cost of the measuring loop in MeasureLoop() without the calls.
+    static double LoopOverheadNs(std::size_t loops) {
+        auto empty = [](std::size_t i) {
+            DoNotOptimize(i);
+        };
+        std::vector<double> samples(BenchIterations(10000));
+        for (double& sample : samples) {
+            sample = TimeTrialNs(0, loops, empty);
+        }
+        std::sort(samples.begin(), samples.end());
+        return samples[samples.size() / 2];
+    }
+
+    static LatencySummary TicksToNs(LatencySummary summary) {
+        double nsPerTick = BenchNsPerTick();
+        summary.mean *= nsPerTick;
+        summary.p50 *= nsPerTick;
+        summary.p99 *= nsPerTick;
+        summary.p999 *= nsPerTick;
+        summary.max *= nsPerTick;
+        return summary;
+    }
+
+    ScopedCallbackLogging m_quiet {false};
+    std::unique_ptr<GeneratedInstance> instance;
+    std::vector<HookHandle> m_hooks;
+};
+
+TEST_P(RuntimeApiBenchmark, CostInsideCallbacks) {
+    BENCHMARK_ONLY();
+
+    ScopedCpuPin pin;
+    std::size_t calls = BenchIterations(20000);
+    std::size_t loops = 64;
+    // The first share of the calls warms up, every other one is a trial.
+    std::size_t trials = BenchTrials(calls);
+    std::size_t callsPerShare = std::max<std::size_t>(calls / (trials + 1), 1);
+    double loopOverhead = LoopOverheadNs(loops);
+    // Not taken off the calls timed one by one, a single sample is too noisy
+    // for that, but it is what their medians can't get below.
+    ReportLatencies("timer_overhead", TimerOverhead());
+
+    // The probe goes in first, every extra Noop hook lands on top of it.
+    m_hooks.push_back(InstallProbe());
+    ASSERT_TRUE(m_hooks.back().Valid()) << "Hook setup should succeed";
+
+    std::size_t depth = 1;
+    for (std::size_t target : {1, 2, 4, 8, 16}) {
+        while (depth < target) {
+            m_hooks.push_back(InstallNoop());
+            ASSERT_TRUE(m_hooks.back().Valid()) << "Hook setup should succeed";
+            depth++;
+        }
+
+        for (int a = 0; a < (int)RuntimeApi::Count; a++) {
+            RuntimeApi api = (RuntimeApi)a;
+            bool once = api == RuntimeApi::DestroyReturnValue
+                || api == RuntimeApi::DoRecall;
+
+            t_probe = ApiProbe();
+            t_probe.api = api;
+            t_probe.loops = once ? 0 : loops;
+            t_probe.onceTicks.reserve(once ? trials * callsPerShare : 0);
+
+            std::uint64_t badCalls = 0;
+            auto run = [&]() {
+                for (std::size_t i = 0; i < callsPerShare; i++) {
+                    badCalls += Call((int)(i & 0xFFFF) + 1) ? 0 : 1;
+                }
+            };
+            run();
+
+            t_probe.armed = true;
+            std::vector<double> trialNs;
+            for (std::size_t trial = 0; trial < trials; trial++) {
+                t_probe.totalTicks = 0;
+                t_probe.samples = 0;
+                run();
+                if (t_probe.samples > 0) {
+                    trialNs.push_back(
+                        (double)t_probe.totalTicks * BenchNsPerTick()
+                        / (double)t_probe.samples
+                    );
+                }
+            }
+            t_probe.armed = false;
+
+            EXPECT_EQ(badCalls, 0u) << RuntimeApiName(api)
+                                    << " should not change the call's result";
+            std::string name = std::string(RuntimeApiName(api)) + ".depth_"
+                + std::to_string(depth);
+            if (once && !t_probe.onceTicks.empty()) {
+                ReportLatencies(
+                    name.c_str(),
+                    TicksToNs(SummarizeLatencies(t_probe.onceTicks))
+                );
+            } else if (!once && !trialNs.empty()) {
+                ReportPrecise(
+                    name.c_str(),
+                    SummarizeTrials(trialNs, loopOverhead)
+                );
+            }
+        }
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Hooks,
+    RuntimeApiBenchmark,
+    ::testing::Values(HookKind::Static, HookKind::Virtual),
+    [](const ::testing::TestParamInfo<HookKind>& info) {
+        return std::string(HookKindName(info.param));
+    }
+);
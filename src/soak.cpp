@@ -0,0 +1,362 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <khook.hpp>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.hpp"
+#include "hooks.hpp"
+#include "main.hpp"
+#include "options.hpp"
+#include "resources.hpp"
+#include "targets.hpp"
+
+// True if the floor of a series keeps rising: the series is split into
+// windows, the minimum of every window is above that of the one before, and
+// the floor grew by more than `tolerance` overall. Looking at the floor keeps
+// short spikes from hiding or faking a leak.
+static bool GrowsMonotonically(
+    const std::vector<std::int64_t>& series,
+    std::size_t windows,
+    std::int64_t tolerance
+) {
+    if (windows < 2 || series.size() < windows * 2) {
+        return false;
+    }
+
+    std::size_t length = series.size() / windows;
+    std::int64_t first = 0;
+    std::int64_t previous = 0;
+    for (std::size_t w = 0; w < windows; w++) {
+        auto begin = series.begin() + w * length;
+        auto end = w + 1 == windows ? series.end() : begin + length;
+        std::int64_t floor = *std::min_element(begin, end);
+        if (w == 0) {
+            first = floor;
+        } else if (floor <= previous) {
+            return false;
+        }
+        previous = floor;
+    }
+    return previous - first > tolerance;
+}
+
+TEST(SoakDriftTest, DetectsMonotonicGrowth) {
+    std::vector<std::int64_t> leak;
+    std::vector<std::int64_t> noisy;
+    std::vector<std::int64_t> step;
+    for (std::int64_t i = 0; i < 64; i++) {
+        leak.push_back(1000 + i * 10 + (i % 3) * 25);
+        noisy.push_back(1000 + (i % 7) * 40);
+        step.push_back(i < 8 ? 1000 : 1500);
+    }
+
+    EXPECT_TRUE(GrowsMonotonically(leak, 4, 100))
+        << "Steady growth under noise should be reported";
+    EXPECT_FALSE(GrowsMonotonically(leak, 4, 1000))
+        << "Growth within the tolerance should not be reported";
+    EXPECT_FALSE(GrowsMonotonically(noisy, 4, 0))
+        << "Noise around a stable level should not be reported";
+    EXPECT_FALSE(GrowsMonotonically(step, 4, 0))
+        << "A single step up that then holds should not be reported";
+    EXPECT_FALSE(GrowsMonotonically({1, 2, 3}, 4, 0))
+        << "Too few samples should never be reported";
+}
+
+class HookSoakTest: public ::testing::Test {
+  protected:
+    static constexpr std::size_t kTargets = 64;
+    static constexpr std::size_t kTransientThreads = 4;
+    static constexpr std::size_t kDriftWindows = 4;
+
+    struct Sample {
+        double elapsedS;
+        std::int64_t rssKb;
+        std::int64_t execBytes;
+        std::int64_t liveHooks;
+        std::uint64_t calls;
+        std::uint64_t cycles;
+    };
+
+    // Counts removals, so that hooks KHook never reports as removed show up
+    // in the live hook count.
+    class RemovalCounter {
+      public:
+        NOINLINE static void OnRemoved(int hookId) {
+            s_removed.fetch_add(1, std::memory_order_relaxed);
+            g_hookRegistry.NotifyRemoved(hookId);
+        }
+
+        NOINLINE void OnRemovedMember(int hookId) {
+            OnRemoved(hookId);
+        }
+
+        static inline std::atomic<std::uint64_t> s_removed {0};
+    };
+
+    void SetUp() override {
+        if (g_options.soakSeconds <= 0) {
+            GTEST_SKIP() << "Soak mode is disabled, run with --soak_seconds";
+        }
+        SetTestResourceBudget(ResourceBudget::Unlimited());
+
+        instance.reset(new GeneratedInstance(kTargets));
+        m_staticHooks.resize(kTargets);
+        m_virtualHooks.resize(kTargets);
+        RemovalCounter::s_removed = 0;
+    }
+
+    void TearDown() override {
+        RemoveAll(m_staticHooks);
+        RemoveAll(m_virtualHooks);
+        instance.reset();
+    }
+
+    HookHandle Install(HookKind kind, std::size_t index) {
+        HookHandle hook;
+        if (kind == HookKind::Static) {
+            hook = HookHandle::SetupHook(
+                (void*)GetGeneratedFunction(index),
+                nullptr,
+                (void*)&RemovalCounter::OnRemoved,
+                (void*)&GeneratedStaticHook::PrePostNoop,
+                (void*)&GeneratedStaticHook::PrePostNoop,
+                (void*)&GeneratedStaticHook::MakeReturn,
+                (void*)&GeneratedStaticHook::CallOriginal,
+                false
+            );
+        } else {
+            hook = HookHandle::SetupVirtualHook(
+                instance->Vtable(),
+                (int)index,
+                nullptr,
+                KHook::ExtractMFP(&RemovalCounter::OnRemovedMember),
+                KHook::ExtractMFP(&GeneratedMemberHook::PrePostNoop),
+                KHook::ExtractMFP(&GeneratedMemberHook::PrePostNoop),
+                KHook::ExtractMFP(&GeneratedMemberHook::MakeReturn),
+                KHook::ExtractMFP(&GeneratedMemberHook::CallOriginal),
+                false
+            );
+        }
+        if (hook.Valid()) {
+            m_installed.fetch_add(1, std::memory_order_relaxed);
+        }
+        return hook;
+    }
+
+    static void RemoveAll(std::vector<HookHandle>& hooks) {
+        for (HookHandle& hook : hooks) {
+            hook.Remove();
+        }
+    }
+
+    std::int64_t LiveHooks() const {
+        return (std::int64_t)(
+            m_installed.load(std::memory_order_relaxed)
+            - RemovalCounter::s_removed.load(std::memory_order_relaxed)
+        );
+    }
+
+    // Returns false if the call didn't behave like the original.
+    bool Call(std::size_t index, bool isVirtual, int value) {
+        GeneratedObject obj {};
+        int result;
+        std::size_t expected;
+        if (isVirtual) {
+            result = instance->Call(index, &obj, value);
+            expected = instance->TargetOf(index);
+        } else {
+            result = GetGeneratedFunction(index)(&obj, value);
+            expected = index;
+        }
+        return result == value && obj.m_testValue == value
+            && obj.m_lastTarget == (int)expected;
+    }
+
+    // Toggles random hooks owned by this thread, and every so often removes
+    // and reinstalls all of them at once like a plugin reload would.
+    void Churn(HookKind kind, std::vector<HookHandle>& hooks) {
+        std::minstd_rand random((unsigned int)kind + 1);
+        std::uint64_t toggles = 0;
+        while (m_running.load(std::memory_order_relaxed)) {
+            if (++toggles % 4096 == 0) {
+                RemoveAll(hooks);
+                for (std::size_t i = 0; i < hooks.size(); i++) {
+                    hooks[i] = Install(kind, i);
+                    if (!hooks[i].Valid()) {
+                        m_failedInstalls++;
+                    }
+                }
+                m_cycles++;
+                continue;
+            }
+
+            std::size_t index = random() % hooks.size();
+            HookHandle& hook = hooks[index];
+            if (!hook.Valid()) {
+                hook = Install(kind, index);
+                if (!hook.Valid()) {
+                    m_failedInstalls++;
+                }
+            } else {
+                hook.Remove();
+            }
+            m_cycles++;
+        }
+    }
+
+    void CallRandomTargets(unsigned int seed, std::size_t count) {
+        std::minstd_rand random(seed);
+        std::uint64_t errors = 0;
+        std::size_t i = 0;
+        while (count ? i < count : m_running.load(std::memory_order_relaxed)) {
+            unsigned int pick = (unsigned int)random();
+            if (!Call((pick >> 1) % kTargets, pick & 1, (int)(pick & 0xFFFF))) {
+                errors++;
+            }
+            if (++i % 1024 == 0) {
+                m_calls.fetch_add(1024, std::memory_order_relaxed);
+            }
+        }
+        m_calls += i % 1024;
+        m_errors += errors;
+    }
+
+    ScopedCallbackLogging m_quiet {false};
+    std::unique_ptr<GeneratedInstance> instance;
+    std::vector<HookHandle> m_staticHooks;
+    std::vector<HookHandle> m_virtualHooks;
+    std::atomic<bool> m_running {true};
+    std::atomic<std::uint64_t> m_installed {0};
+    std::atomic<std::uint64_t> m_calls {0};
+    std::atomic<std::uint64_t> m_errors {0};
+    std::atomic<std::uint64_t> m_cycles {0};
+    std::atomic<std::uint64_t> m_failedInstalls {0};
+};
+
+TEST_F(HookSoakTest, NoDriftUnderChurn) {
+    FILE* report = nullptr;
+    if (!g_options.soakReport.empty()) {
+        report = fopen(g_options.soakReport.c_str(), "w");
+        if (report) {
+            fprintf(report, "elapsed_s,rss_kb,exec_bytes,live_hooks,calls,cycles\n");
+        }
+    }
+
+    std::vector<std::thread> threads;
+    threads.emplace_back([&]() { Churn(HookKind::Static, m_staticHooks); });
+    threads.emplace_back([&]() { Churn(HookKind::Virtual, m_virtualHooks); });
+    for (unsigned int t = 0; t < BenchThreads(); t++) {
+        threads.emplace_back([&, t]() { CallRandomTargets(t + 1, 0); });
+    }
+
+    std::vector<Sample> samples;
+    std::int64_t start = GetWallTimeNs();
+    std::int64_t end = start + (std::int64_t)g_options.soakSeconds * 1000000000;
+    std::int64_t next = start;
+    unsigned int seed = 1000;
+    while (next < end) {
+        // Short-lived callers, for KHook state that is kept per thread.
+        std::vector<std::thread> transient;
+        for (std::size_t t = 0; t < kTransientThreads; t++) {
+            transient.emplace_back([&, s = seed++]() {
+                CallRandomTargets(s, 1000);
+            });
+        }
+        for (std::thread& thread : transient) {
+            thread.join();
+        }
+
+        next += 1000000000;
+        std::int64_t wait = next - GetWallTimeNs();
+        if (wait > 0) {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(wait));
+        }
+
+        Sample sample;
+        sample.elapsedS = (double)(GetWallTimeNs() - start) / 1e9;
+        sample.rssKb = GetCurrentRssKb();
+        sample.execBytes = ReadMappingStats().execBytes;
+        sample.liveHooks = LiveHooks();
+        sample.calls = m_calls.load();
+        sample.cycles = m_cycles.load();
+        samples.push_back(sample);
+
+        std::cout << "[ SOAK     ] " << (int)sample.elapsedS << "s rss "
+                  << sample.rssKb << " KB, exec " << sample.execBytes
+                  << " bytes, live hooks " << sample.liveHooks << std::endl;
+        if (report) {
+            fprintf(
+                report,
+                "%.1f,%lld,%lld,%lld,%llu,%llu\n",
+                sample.elapsedS,
+                (long long)sample.rssKb,
+                (long long)sample.execBytes,
+                (long long)sample.liveHooks,
+                (unsigned long long)sample.calls,
+                (unsigned long long)sample.cycles
+            );
+            fflush(report);
+        }
+    }
+
+    m_running = false;
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    RemoveAll(m_staticHooks);
+    RemoveAll(m_virtualHooks);
+    if (report) {
+        fclose(report);
+    }
+
+    // The first samples include KHook and the allocator warming up.
+    std::size_t warmup = std::max<std::size_t>(2, samples.size() / 10);
+    std::vector<std::int64_t> rss;
+    std::vector<std::int64_t> exec;
+    std::vector<std::int64_t> live;
+    for (std::size_t i = warmup; i < samples.size(); i++) {
+        rss.push_back(samples[i].rssKb);
+        exec.push_back(samples[i].execBytes);
+        live.push_back(samples[i].liveHooks);
+    }
+
+    ReportMetric("calls", (double)m_calls.load(), "calls");
+    ReportMetric("churn_cycles", (double)m_cycles.load(), "cycles");
+    if (!samples.empty()) {
+        ReportMetric(
+            "rss_drift",
+            (double)(samples.back().rssKb - samples.front().rssKb),
+            "KB"
+        );
+        ReportMetric(
+            "exec_drift",
+            (double)(samples.back().execBytes - samples.front().execBytes),
+            "bytes"
+        );
+    }
+
+    EXPECT_EQ(m_errors.load(), 0u)
+        << "Hooked calls should behave like the original during the soak";
+    EXPECT_EQ(m_failedInstalls.load(), 0u) << "Hook setup should succeed";
+    EXPECT_EQ(LiveHooks(), 0)
+        << "Every removed hook should have been reported through OnRemoved";
+    if (rss.size() < kDriftWindows * 2) {
+        std::cout << "Soak too short to look for drift" << std::endl;
+        return;
+    }
+    EXPECT_FALSE(GrowsMonotonically(rss, kDriftWindows, 1024))
+        << "RSS should not keep growing";
+    EXPECT_FALSE(
+        GrowsMonotonically(exec, kDriftWindows, 16 * (std::int64_t)GetPageSize())
+    ) << "Executable mappings should not keep growing";
+    EXPECT_FALSE(GrowsMonotonically(live, kDriftWindows, 2 * kTargets))
+        << "Hooks should not be leaked";
+}
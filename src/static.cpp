@@ -94,7 +94,7 @@ class StaticHookTest: public ::testing::Test {
         }
 
         NOINLINE static int HookInsideSetObjectValue(TestObject* obj, int value) {
-            m_hookId = KHook::SetupHook(
+            m_hook = HookHandle::SetupHook(
                 (void*)&HookedClass::IsAllowed,
                 nullptr,
                 (void*)&IsAllowedNoopHook::OnRemoved,
@@ -134,6 +134,7 @@ class StaticHookTest: public ::testing::Test {
     }
 
     void TearDown() override {
+        m_hook.Remove();
         if (obj) {
             delete obj;
             obj = nullptr;
@@ -141,13 +142,13 @@ class StaticHookTest: public ::testing::Test {
     }
 
     TestObject* obj = nullptr;
-    static int m_hookId;
+    static HookHandle m_hook;
 };
 
-int StaticHookTest::m_hookId = KHook::INVALID_HOOK;
+HookHandle StaticHookTest::m_hook;
 
 TEST_F(StaticHookTest, Noop) {
-    int hookId = KHook::SetupHook(
+    HookHandle hook = HookHandle::SetupHook(
         (void*)&HookedClass::IsAllowed,
         nullptr,
         (void*)&IsAllowedNoopHook::OnRemoved,
@@ -158,13 +159,14 @@ TEST_F(StaticHookTest, Noop) {
         false
     );
 
-    ASSERT_NE(hookId, KHook::INVALID_HOOK) << "Hook setup should succeed";
+    ASSERT_TRUE(hook.Valid()) << "Hook setup should succeed";
+    int hookId = hook.Id();
 
     testing::internal::CaptureStdout();
 
     bool overriddenResult = HookedClass::IsAllowed(obj);
 
-    KHook::RemoveHook(hookId, false);
+    hook.Remove();
 
     bool originalResult = HookedClass::IsAllowed(obj);
 
@@ -188,7 +190,7 @@ TEST_F(StaticHookTest, Noop) {
 }
 
 TEST_F(StaticHookTest, NoopVoid) {
-    int hookId = KHook::SetupHook(
+    HookHandle hook = HookHandle::SetupHook(
         (void*)&HookedClass::MyVoid,
         nullptr,
         (void*)&MyVoidNoopHook::OnRemoved,
@@ -199,13 +201,14 @@ TEST_F(StaticHookTest, NoopVoid) {
         false
     );
 
-    ASSERT_NE(hookId, KHook::INVALID_HOOK) << "Hook setup should succeed";
+    ASSERT_TRUE(hook.Valid()) << "Hook setup should succeed";
+    int hookId = hook.Id();
 
     testing::internal::CaptureStdout();
 
     HookedClass::MyVoid(obj);
 
-    KHook::RemoveHook(hookId, false);
+    hook.Remove();
 
     HookedClass::MyVoid(obj);
 
@@ -225,7 +228,7 @@ TEST_F(StaticHookTest, NoopVoid) {
 }
 
 TEST_F(StaticHookTest, OverrideReturnValuePre) {
-    int hookId = KHook::SetupHook(
+    HookHandle hook = HookHandle::SetupHook(
         (void*)&HookedClass::IsAllowed,
         nullptr,
         (void*)&IsAllowedNoopHook::OnRemoved,
@@ -236,19 +239,19 @@ TEST_F(StaticHookTest, OverrideReturnValuePre) {
         false
     );
 
-    ASSERT_NE(hookId, KHook::INVALID_HOOK) << "Hook setup should succeed";
+    ASSERT_TRUE(hook.Valid()) << "Hook setup should succeed";
 
     bool result = HookedClass::IsAllowed(obj);
     EXPECT_FALSE(result) << "Method should return false when hooked";
 
-    KHook::RemoveHook(hookId, false);
+    hook.Remove();
 
     result = HookedClass::IsAllowed(obj);
     EXPECT_TRUE(result) << "Method should return true after hook removal";
 }
 
 TEST_F(StaticHookTest, OverrideReturnValuePost) {
-    int hookId = KHook::SetupHook(
+    HookHandle hook = HookHandle::SetupHook(
         (void*)&HookedClass::IsAllowed,
         nullptr,
         (void*)&IsAllowedNoopHook::OnRemoved,
@@ -259,19 +262,19 @@ TEST_F(StaticHookTest, OverrideReturnValuePost) {
         false
     );
 
-    ASSERT_NE(hookId, KHook::INVALID_HOOK) << "Hook setup should succeed";
+    ASSERT_TRUE(hook.Valid()) << "Hook setup should succeed";
 
     bool result = HookedClass::IsAllowed(obj);
     EXPECT_FALSE(result) << "Method should return false when hooked";
 
-    KHook::RemoveHook(hookId, false);
+    hook.Remove();
 
     result = HookedClass::IsAllowed(obj);
     EXPECT_TRUE(result) << "Method should return true after hook removal";
 }
 
 TEST_F(StaticHookTest, SupersedeReturnValue) {
-    int hookId = KHook::SetupHook(
+    HookHandle hook = HookHandle::SetupHook(
         (void*)&HookedClass::IsAllowed,
         nullptr,
         (void*)&IsAllowedNoopHook::OnRemoved,
@@ -282,13 +285,13 @@ TEST_F(StaticHookTest, SupersedeReturnValue) {
         false
     );
 
-    ASSERT_NE(hookId, KHook::INVALID_HOOK) << "Hook setup should succeed";
+    ASSERT_TRUE(hook.Valid()) << "Hook setup should succeed";
 
     testing::internal::CaptureStdout();
 
     bool overriddenResult = HookedClass::IsAllowed(obj);
 
-    KHook::RemoveHook(hookId, false);
+    hook.Remove();
 
     bool originalResult = HookedClass::IsAllowed(obj);
 
@@ -302,7 +305,7 @@ TEST_F(StaticHookTest, SupersedeReturnValue) {
 }
 
 TEST_F(StaticHookTest, SupersedeVoidReturnValue) {
-    int hookId = KHook::SetupHook(
+    HookHandle hook = HookHandle::SetupHook(
         (void*)&HookedClass::MyVoid,
         nullptr,
         (void*)&MyVoidNoopHook::OnRemoved,
@@ -313,7 +316,7 @@ TEST_F(StaticHookTest, SupersedeVoidReturnValue) {
         false
     );
 
-    ASSERT_NE(hookId, KHook::INVALID_HOOK) << "Hook setup should succeed";
+    ASSERT_TRUE(hook.Valid()) << "Hook setup should succeed";
 
     testing::internal::CaptureStdout();
 
@@ -330,7 +333,7 @@ TEST_F(StaticHookTest, SupersedeVoidReturnValue) {
             << "Callbacks should be called in the correct order";
     }
 
-    KHook::RemoveHook(hookId, false);
+    hook.Remove();
 
     testing::internal::CaptureStdout();
 
@@ -347,7 +350,7 @@ TEST_F(StaticHookTest, SupersedeVoidReturnValue) {
 }
 
 TEST_F(StaticHookTest, OverrideParameterWithRecall) {
-    int hookId = KHook::SetupHook(
+    HookHandle hook = HookHandle::SetupHook(
         (void*)&HookedClass::SetObjectValue,
         nullptr,
         (void*)&SetObjectValueNoopHook::OnRemoved,
@@ -358,14 +361,14 @@ TEST_F(StaticHookTest, OverrideParameterWithRecall) {
         false
     );
 
-    ASSERT_NE(hookId, KHook::INVALID_HOOK) << "Hook setup should succeed";
+    ASSERT_TRUE(hook.Valid()) << "Hook setup should succeed";
 
     int result = HookedClass::SetObjectValue(obj, 0xDEADBEEF);
     EXPECT_EQ(obj->m_testValue, 1337)
         << "Method should set value to hooked value";
     EXPECT_EQ(result, 1337) << "Method should return hooked value";
 
-    KHook::RemoveHook(hookId, false);
+    hook.Remove();
 
     result = HookedClass::SetObjectValue(obj, 0xDEADBEEF);
     EXPECT_EQ(obj->m_testValue, 0xDEADBEEF)
@@ -375,7 +378,7 @@ TEST_F(StaticHookTest, OverrideParameterWithRecall) {
 }
 
 TEST_F(StaticHookTest, SupersedeThenNoopVoidHooksOnSameFunction) {
-    int firstHookId = KHook::SetupHook(
+    HookHandle firstHook = HookHandle::SetupHook(
         (void*)&HookedClass::MyVoid,
         nullptr,
         (void*)&MyVoidNoopHook::OnRemoved,
@@ -386,9 +389,9 @@ TEST_F(StaticHookTest, SupersedeThenNoopVoidHooksOnSameFunction) {
         false
     );
 
-    ASSERT_NE(firstHookId, KHook::INVALID_HOOK) << "Hook setup should succeed";
+    ASSERT_TRUE(firstHook.Valid()) << "Hook setup should succeed";
 
-    int secondHookId = KHook::SetupHook(
+    HookHandle secondHook = HookHandle::SetupHook(
         (void*)&HookedClass::MyVoid,
         nullptr,
         (void*)&MyVoidNoopHook::OnRemoved,
@@ -399,7 +402,7 @@ TEST_F(StaticHookTest, SupersedeThenNoopVoidHooksOnSameFunction) {
         false
     );
 
-    ASSERT_NE(secondHookId, KHook::INVALID_HOOK) << "Hook setup should succeed";
+    ASSERT_TRUE(secondHook.Valid()) << "Hook setup should succeed";
 
     testing::internal::CaptureStdout();
     HookedClass::MyVoid(obj);
@@ -417,7 +420,7 @@ TEST_F(StaticHookTest, SupersedeThenNoopVoidHooksOnSameFunction) {
             << "Callback functions should be called in the correct order";
     }
 
-    KHook::RemoveHook(firstHookId, false);
+    firstHook.Remove();
 
     testing::internal::CaptureStdout();
     HookedClass::MyVoid(obj);
@@ -437,7 +440,7 @@ TEST_F(StaticHookTest, SupersedeThenNoopVoidHooksOnSameFunction) {
 }
 
 TEST_F(StaticHookTest, MultipleNoopVoidHooksOnSameFunction) {
-    int firstHookId = KHook::SetupHook(
+    HookHandle firstHook = HookHandle::SetupHook(
         (void*)&HookedClass::MyVoid,
         nullptr,
         (void*)&MyVoidNoopHook::OnRemoved,
@@ -448,9 +451,9 @@ TEST_F(StaticHookTest, MultipleNoopVoidHooksOnSameFunction) {
         false
     );
 
-    ASSERT_NE(firstHookId, KHook::INVALID_HOOK) << "Hook setup should succeed";
+    ASSERT_TRUE(firstHook.Valid()) << "Hook setup should succeed";
 
-    int secondHookId = KHook::SetupHook(
+    HookHandle secondHook = HookHandle::SetupHook(
         (void*)&HookedClass::MyVoid,
         nullptr,
         (void*)&MyVoidNoopHook::OnRemoved,
@@ -461,7 +464,7 @@ TEST_F(StaticHookTest, MultipleNoopVoidHooksOnSameFunction) {
         false
     );
 
-    ASSERT_NE(secondHookId, KHook::INVALID_HOOK) << "Hook setup should succeed";
+    ASSERT_TRUE(secondHook.Valid()) << "Hook setup should succeed";
 
     testing::internal::CaptureStdout();
     HookedClass::MyVoid(obj);
@@ -481,7 +484,7 @@ TEST_F(StaticHookTest, MultipleNoopVoidHooksOnSameFunction) {
             << "Callback functions should be called in the correct order";
     }
 
-    KHook::RemoveHook(firstHookId, false);
+    firstHook.Remove();
 
     testing::internal::CaptureStdout();
     HookedClass::MyVoid(obj);
@@ -501,7 +504,7 @@ TEST_F(StaticHookTest, MultipleNoopVoidHooksOnSameFunction) {
 }
 
 TEST_F(StaticHookTest, SupersedeThenNoopHooksOnSameFunction) {
-    int firstHookId = KHook::SetupHook(
+    HookHandle firstHook = HookHandle::SetupHook(
         (void*)&HookedClass::SetObjectValue,
         nullptr,
         (void*)&SetObjectValueNoopHook::OnRemoved,
@@ -512,9 +515,9 @@ TEST_F(StaticHookTest, SupersedeThenNoopHooksOnSameFunction) {
         false
     );
 
-    ASSERT_NE(firstHookId, KHook::INVALID_HOOK) << "Hook setup should succeed";
+    ASSERT_TRUE(firstHook.Valid()) << "Hook setup should succeed";
 
-    int secondHookId = KHook::SetupHook(
+    HookHandle secondHook = HookHandle::SetupHook(
         (void*)&HookedClass::SetObjectValue,
         nullptr,
         (void*)&SetObjectValueNoopHook::OnRemoved,
@@ -525,7 +528,7 @@ TEST_F(StaticHookTest, SupersedeThenNoopHooksOnSameFunction) {
         false
     );
 
-    ASSERT_NE(secondHookId, KHook::INVALID_HOOK) << "Hook setup should succeed";
+    ASSERT_TRUE(secondHook.Valid()) << "Hook setup should succeed";
 
     obj->m_testValue = 0x9600;
 
@@ -545,7 +548,7 @@ TEST_F(StaticHookTest, SupersedeThenNoopHooksOnSameFunction) {
             << "Callback functions should be called in the correct order";
     }
 
-    KHook::RemoveHook(firstHookId, false);
+    firstHook.Remove();
 
     obj->m_testValue = 0x9600;
 
@@ -565,7 +568,7 @@ TEST_F(StaticHookTest, SupersedeThenNoopHooksOnSameFunction) {
             << "Callback functions should be called in the correct order";
     }
 
-    KHook::RemoveHook(secondHookId, false);
+    secondHook.Remove();
 
     obj->m_testValue = 0x9600;
 
@@ -583,9 +586,7 @@ TEST_F(StaticHookTest, SupersedeThenNoopHooksOnSameFunction) {
 }
 
 TEST_F(StaticHookTest, HookIsAllowedInsideSetObjectValue) {
-    m_hookId = KHook::INVALID_HOOK;
-
-    int hookId = KHook::SetupHook(
+    HookHandle hook = HookHandle::SetupHook(
         (void*)&HookedClass::SetObjectValue,
         nullptr,
         (void*)&SetObjectValueNoopHook::OnRemoved,
@@ -596,7 +597,7 @@ TEST_F(StaticHookTest, HookIsAllowedInsideSetObjectValue) {
         false
     );
 
-    ASSERT_NE(hookId, KHook::INVALID_HOOK) << "Hook setup should succeed";
+    ASSERT_TRUE(hook.Valid()) << "Hook setup should succeed";
 
     int firstResult = HookedClass::SetObjectValue(obj, 42);
 
@@ -604,7 +605,7 @@ TEST_F(StaticHookTest, HookIsAllowedInsideSetObjectValue) {
         << "SetObjectValue should set value to 42 (original behavior)";
     EXPECT_EQ(firstResult, 42)
         << "SetObjectValue should return 42 (original value)";
-    ASSERT_NE(m_hookId, KHook::INVALID_HOOK)
+    ASSERT_TRUE(m_hook.Valid())
         << "IsAllowed hook should have been set up inside SetObjectValue";
 
     bool result = HookedClass::IsAllowed(obj);
@@ -0,0 +1,393 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <khook.hpp>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "bench.hpp"
+#include "hooks.hpp"
+#include "main.hpp"
+#include "resources.hpp"
+
+#pragma region WorkStealingPool
+
+struct StealTask {
+    int value = 0;
+    // Levels of children still to spawn below this task.
+    std::uint32_t depth = 0;
+    // Worker that spawned the task, or ~0 for tasks submitted from outside.
+    std::uint32_t spawnedBy = ~0u;
+};
+
+struct StealStats {
+    std::uint64_t executed = 0;
+    std::uint64_t stolen = 0;
+    // Tasks that ran on another worker than the one that spawned them.
+    std::uint64_t migrated = 0;
+};
+
+// Every worker pops its newest task, idle workers steal the oldest task of
+// another worker. All roots start out on the first worker and tasks spawn
+// more tasks onto their own worker's queue while they run, Run returns once
+// no task is left anywhere.
+class WorkStealingPool {
+  public:
+    using Runner = void (*)(const StealTask& task);
+
+    explicit WorkStealingPool(std::size_t workers) : m_queues(workers) {}
+
+    StealStats Run(const std::vector<StealTask>& roots, Runner runner);
+
+    // Only valid from inside a running task.
+    static void Spawn(const StealTask& task);
+
+  private:
+    struct alignas(64) WorkerQueue {
+        std::mutex mutex;
+        std::deque<StealTask> tasks;
+    };
+
+    void Work(std::size_t worker, Runner runner, StealStats& stats);
+    bool Pop(std::size_t worker, StealTask* task);
+    bool Steal(std::size_t thief, std::size_t* victim, StealTask* task);
+
+    std::vector<WorkerQueue> m_queues;
+    std::atomic<std::uint64_t> m_pending {0};
+};
+
+struct StealContext {
+    WorkStealingPool* pool = nullptr;
+    std::uint32_t worker = 0;
+};
+
+static thread_local StealContext t_stealContext;
+
+StealStats
+WorkStealingPool::Run(const std::vector<StealTask>& roots, Runner runner) {
+    m_queues[0].tasks.assign(roots.begin(), roots.end());
+    m_pending = roots.size();
+
+    std::vector<StealStats> stats(m_queues.size());
+    std::vector<std::thread> workers;
+    for (std::size_t w = 0; w < m_queues.size(); w++) {
+        workers.emplace_back([&, w]() {
+            Work(w, runner, stats[w]);
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    StealStats total;
+    for (const StealStats& worker : stats) {
+        total.executed += worker.executed;
+        total.stolen += worker.stolen;
+        total.migrated += worker.migrated;
+    }
+    return total;
+}
+
+void WorkStealingPool::Spawn(const StealTask& task) {
+    StealContext& context = t_stealContext;
+    WorkerQueue& queue = context.pool->m_queues[context.worker];
+    StealTask spawned = task;
+    spawned.spawnedBy = context.worker;
+
+    context.pool->m_pending.fetch_add(1, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.tasks.push_back(spawned);
+}
+
+void WorkStealingPool::Work(
+    std::size_t worker,
+    Runner runner,
+    StealStats& stats
+) {
+    t_stealContext.pool = this;
+    t_stealContext.worker = (std::uint32_t)worker;
+
+    std::size_t victim = worker;
+    while (m_pending.load(std::memory_order_acquire) > 0) {
+        StealTask task;
+        if (Pop(worker, &task)) {
+        } else if (Steal(worker, &victim, &task)) {
+            stats.stolen++;
+        } else {
+            std::this_thread::yield();
+            continue;
+        }
+
+        runner(task);
+        stats.executed++;
+        if (task.spawnedBy != ~0u && task.spawnedBy != worker) {
+            stats.migrated++;
+        }
+        // Children are counted as they are spawned, so the count can't drop
+        // to zero while any of them is still queued.
+        m_pending.fetch_sub(1, std::memory_order_release);
+    }
+
+    t_stealContext = StealContext();
+}
+
+bool WorkStealingPool::Pop(std::size_t worker, StealTask* task) {
+    WorkerQueue& queue = m_queues[worker];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) {
+        return false;
+    }
+    *task = queue.tasks.back();
+    queue.tasks.pop_back();
+    return true;
+}
+
+bool WorkStealingPool::Steal(
+    std::size_t thief,
+    std::size_t* victim,
+    StealTask* task
+) {
+    // Starts with the worker it last stole from, busy workers stay busy.
+    for (std::size_t i = 0; i < m_queues.size(); i++) {
+        std::size_t candidate = (*victim + i) % m_queues.size();
+        if (candidate == thief) {
+            continue;
+        }
+        WorkerQueue& queue = m_queues[candidate];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            *task = queue.tasks.front();
+            queue.tasks.pop_front();
+            *victim = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+#pragma endregion
+
+class WorkStealingHookTest: public ::testing::Test {
+  protected:
+    class TestObject {
+      public:
+        int m_testValue;
+    };
+
+    class HookedClass {
+      public:
+        NOINLINE static int SetObjectValue(TestObject* obj, int value) {
+            obj->m_testValue = value;
+            return value;
+        }
+    };
+
+    class VirtualHookedClass {
+      public:
+        virtual int SetObjectValue(TestObject* obj, int value) {
+            obj->m_testValue = value;
+            return value;
+        }
+    };
+
+    using VirtualSetObjectValueNoopHook =
+        NoopMemberHookTemplate<int, TestObject*, int>;
+    using SetObjectValueNoopHook =
+        NoopStaticHookTemplate<int, TestObject*, int>;
+
+    // Pre callback of the static hook, spawns the children of the running
+    // task so that they can migrate while the hooked call is in progress.
+    class SpawningHook {
+      public:
+        NOINLINE static int Pre(TestObject* obj, int value) {
+            const StealTask* task = t_task;
+            if (task && task->value == value) {
+                SpawnChildren(*task);
+            } else {
+                s_lostTasks++;
+            }
+            KHook::SaveReturnValue(
+                KHook::Action::Ignore,
+                nullptr,
+                0,
+                nullptr,
+                nullptr,
+                false
+            );
+            return 0;
+        }
+    };
+
+    void SetUp() override {
+        s_target = new VirtualHookedClass();
+        s_badCalls = 0;
+        s_lostTasks = 0;
+        s_spawnFromHook = false;
+    }
+
+    void TearDown() override {
+        m_hooks.clear();
+        delete s_target;
+        s_target = nullptr;
+    }
+
+    void InstallHooks() {
+        m_hooks.push_back(HookHandle::SetupHook(
+            (void*)&HookedClass::SetObjectValue,
+            nullptr,
+            (void*)&SetObjectValueNoopHook::OnRemoved,
+            (void*)&SpawningHook::Pre,
+            (void*)&SetObjectValueNoopHook::PrePostNoop,
+            (void*)&SetObjectValueNoopHook::MakeReturn,
+            (void*)&SetObjectValueNoopHook::CallOriginal,
+            false
+        ));
+        m_hooks.push_back(HookHandle::SetupVirtualHook(
+            *(void***)(s_target),
+            KHook::GetVtableIndex(&VirtualHookedClass::SetObjectValue),
+            nullptr,
+            KHook::ExtractMFP(&VirtualSetObjectValueNoopHook::OnRemoved),
+            KHook::ExtractMFP(&VirtualSetObjectValueNoopHook::PrePostNoop),
+            KHook::ExtractMFP(&VirtualSetObjectValueNoopHook::PrePostNoop),
+            KHook::ExtractMFP(&VirtualSetObjectValueNoopHook::MakeReturn),
+            KHook::ExtractMFP(&VirtualSetObjectValueNoopHook::CallOriginal),
+            false
+        ));
+        s_spawnFromHook = true;
+    }
+
+    // Every task grows a binary tree below it, few roots with deep trees
+    // leave idle workers nothing but children to steal.
+    static void SpawnChildren(const StealTask& task) {
+        if (task.depth == 0) {
+            return;
+        }
+        for (int i = 1; i <= 2; i++) {
+            StealTask child;
+            child.value = (task.value * 2 + i) & 0xFFFF;
+            child.depth = task.depth - 1;
+            WorkStealingPool::Spawn(child);
+        }
+    }
+
+    static std::uint64_t ExpectedTasks(const std::vector<StealTask>& roots) {
+        std::uint64_t tasks = 0;
+        for (const StealTask& root : roots) {
+            tasks += (2ull << root.depth) - 1;
+        }
+        return tasks;
+    }
+
+    static std::vector<StealTask>
+    MakeRoots(std::size_t count, std::uint32_t depth) {
+        std::vector<StealTask> roots(count);
+        for (std::size_t i = 0; i < count; i++) {
+            roots[i].value = (int)(i & 0xFFFF);
+            roots[i].depth = depth;
+        }
+        return roots;
+    }
+
+    static void RunTask(const StealTask& task) {
+        t_task = &task;
+        TestObject obj {};
+        bool ok = HookedClass::SetObjectValue(&obj, task.value) == task.value
+            && obj.m_testValue == task.value;
+        int value = task.value + 1;
+        ok = ok && s_target->SetObjectValue(&obj, value) == value
+            && obj.m_testValue == value;
+        if (!s_spawnFromHook) {
+            SpawnChildren(task);
+        }
+        t_task = nullptr;
+
+        if (!ok) {
+            s_badCalls.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    static std::size_t Workers() {
+        return std::max(2u, BenchThreads());
+    }
+
+    static inline thread_local const StealTask* t_task = nullptr;
+    static inline VirtualHookedClass* s_target = nullptr;
+    static inline bool s_spawnFromHook = false;
+    static inline std::atomic<std::uint64_t> s_badCalls {0};
+    static inline std::atomic<std::uint64_t> s_lostTasks {0};
+
+    ScopedCallbackLogging m_quiet {false};
+    std::vector<HookHandle> m_hooks;
+};
+
+TEST_F(WorkStealingHookTest, TasksMigrateBetweenHookedCalls) {
+    // A single tree, every other worker has to steal its share of it.
+    std::vector<StealTask> roots = MakeRoots(1, 14);
+    InstallHooks();
+    for (const HookHandle& hook : m_hooks) {
+        ASSERT_TRUE(hook.Valid()) << "Hook setup should succeed";
+    }
+
+    // Idle workers spin while they look for something to steal.
+    SetTestThreadCount(Workers());
+    WorkStealingPool pool(Workers());
+    StealStats stats = pool.Run(roots, &RunTask);
+
+    EXPECT_EQ(stats.executed, ExpectedTasks(roots))
+        << "Every hooked call should have spawned the children of its task";
+    EXPECT_EQ(s_badCalls.load(), 0u)
+        << "Hooked calls should return the original value on every worker";
+    EXPECT_EQ(s_lostTasks.load(), 0u)
+        << "Callbacks should see the arguments of the task that made the call";
+}
+
+TEST_F(WorkStealingHookTest, BenchmarkThroughput) {
+    BENCHMARK_ONLY();
+
+    std::vector<StealTask> roots = MakeRoots(BenchIterations(64), 14);
+    std::size_t workers = Workers();
+    ReportMetric("workers", (double)workers, "threads");
+    ReportMetric("tasks", (double)ExpectedTasks(roots), "tasks");
+
+    auto run = [&](const char* name) {
+        WorkStealingPool pool(workers);
+        std::int64_t start = GetWallTimeNs();
+        StealStats stats = pool.Run(roots, &RunTask);
+        double seconds = (double)(GetWallTimeNs() - start) / 1e9;
+
+        std::string prefix(name);
+        ReportMetric(
+            (prefix + ".throughput").c_str(),
+            (double)stats.executed / seconds,
+            "tasks/s"
+        );
+        ReportMetric(
+            (prefix + ".stolen").c_str(),
+            (double)stats.stolen,
+            "tasks"
+        );
+        ReportMetric(
+            (prefix + ".migrated").c_str(),
+            (double)stats.migrated,
+            "tasks"
+        );
+        EXPECT_EQ(stats.executed, ExpectedTasks(roots)) << name;
+        return (double)stats.executed / seconds;
+    };
+
+    double unhooked = run("unhooked");
+    InstallHooks();
+    for (const HookHandle& hook : m_hooks) {
+        ASSERT_TRUE(hook.Valid()) << "Hook setup should succeed";
+    }
+    double hooked = run("hooked");
+    ReportMetric("hooked_relative", hooked / unhooked, "x");
+
+    EXPECT_EQ(s_badCalls.load(), 0u)
+        << "Hooked calls should return the original value on every worker";
+    EXPECT_EQ(s_lostTasks.load(), 0u)
+        << "Callbacks should see the arguments of the task that made the call";
+}
@@ -0,0 +1,71 @@
+#include "targets.hpp"
+
+#include <array>
+#include <khook.hpp>
+#include <mutex>
+#include <utility>
+
+template<std::size_t Index>
+class GeneratedTarget {
+  public:
+    NOINLINE static int SetObjectValue(GeneratedObject* obj, int value) {
+        obj->m_testValue = value;
+        obj->m_lastTarget = (int)Index;
+        return value;
+    }
+};
+
+template<std::size_t... Indices>
+static constexpr std::array<GeneratedFunction, sizeof...(Indices)>
+MakeFunctionTable(std::index_sequence<Indices...>) {
+    return {{&GeneratedTarget<Indices>::SetObjectValue...}};
+}
+
+template<std::size_t... Indices>
+static std::array<void*, sizeof...(Indices)>
+MakeMemberTable(std::index_sequence<Indices...>) {
+    return {{KHook::ExtractMFP(
+        &GeneratedInstance::SetObjectValue<Indices>
+    )...}};
+}
+
+// Constant initialized, so that hooks can be installed on generated targets
+// from global constructors in other translation units.
+static constexpr std::array<GeneratedFunction, kGeneratedTargetCount>
+    s_functions =
+        MakeFunctionTable(std::make_index_sequence<kGeneratedTargetCount>());
+
+// ExtractMFP can't run at compile time, the member table is built on first
+// use instead of relying on the order of dynamic initialization.
+static std::array<void*, kGeneratedTargetCount> s_members;
+static std::once_flag s_membersOnce;
+
+static const std::array<void*, kGeneratedTargetCount>& GetMemberTable() {
+    std::call_once(s_membersOnce, []() {
+        s_members =
+            MakeMemberTable(std::make_index_sequence<kGeneratedTargetCount>());
+    });
+    return s_members;
+}
+
+GeneratedFunction GetGeneratedFunction(std::size_t index) {
+    return s_functions[index % kGeneratedTargetCount];
+}
+
+GeneratedInstance::GeneratedInstance(std::size_t slots, std::size_t firstTarget) :
+    m_vtable(slots),
+    m_firstTarget(firstTarget) {
+    const std::array<void*, kGeneratedTargetCount>& members = GetMemberTable();
+    for (std::size_t i = 0; i < slots; i++) {
+        m_vtable[i] = members[TargetOf(i)];
+    }
+    m_vptr = m_vtable.data();
+}
+
+NOINLINE int
+GeneratedInstance::Call(std::size_t slot, GeneratedObject* obj, int value) {
+    auto method = KHook::BuildMFP<GeneratedInstance, int, GeneratedObject*, int>(
+        m_vptr[slot]
+    );
+    return (this->*method)(obj, value);
+}
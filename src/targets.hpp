@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "main.hpp"
+
+class GeneratedObject {
+  public:
+    int m_testValue;
+    int m_lastTarget;
+};
+
+using GeneratedFunction = int (*)(GeneratedObject*, int);
+
+using GeneratedStaticHook = NoopStaticHookTemplate<int, GeneratedObject*, int>;
+using GeneratedMemberHook = NoopMemberHookTemplate<int, GeneratedObject*, int>;
+
+// Pre callbacks for generated targets that only count how often they ran, to
+// tell whether a call actually went through the hook.
+class GeneratedCountingHook {
+  public:
+    NOINLINE static int Pre(GeneratedObject* obj, int value) {
+        s_calls.fetch_add(1, std::memory_order_relaxed);
+        KHook::SaveReturnValue(
+            KHook::Action::Ignore,
+            nullptr,
+            0,
+            nullptr,
+            nullptr,
+            false
+        );
+        return 0;
+    }
+
+    NOINLINE int PreMember(GeneratedObject* obj, int value) {
+        return Pre(obj, value);
+    }
+
+    static inline std::atomic<std::uint64_t> s_calls {0};
+};
+
+// Number of distinct compiled-in targets. Every one of them stores its own
+// index so identical code folding can't merge them into a single address.
+constexpr std::size_t kGeneratedTargetCount = 2048;
+
+GeneratedFunction GetGeneratedFunction(std::size_t index);
+
+// Object carrying a vtable of any length, every slot points to one of the
+// generated member functions. Calls read the slot just like a virtual call.
+class GeneratedInstance {
+  public:
+    explicit GeneratedInstance(std::size_t slots, std::size_t firstTarget = 0);
+
+    GeneratedInstance(const GeneratedInstance&) = delete;
+    GeneratedInstance& operator=(const GeneratedInstance&) = delete;
+
+    void** Vtable() {
+        return m_vptr;
+    }
+
+    std::size_t Slots() const {
+        return m_vtable.size();
+    }
+
+    // Index of the generated member function stored in a slot, as seen in
+    // GeneratedObject::m_lastTarget after a call.
+    std::size_t TargetOf(std::size_t slot) const {
+        return (m_firstTarget + slot) % kGeneratedTargetCount;
+    }
+
+    NOINLINE int Call(std::size_t slot, GeneratedObject* obj, int value);
+
+    template<std::size_t Index>
+    NOINLINE int SetObjectValue(GeneratedObject* obj, int value) {
+        obj->m_testValue = value;
+        obj->m_lastTarget = (int)Index;
+        return value;
+    }
+
+  private:
+    // Must stay the first member, it is where a real object keeps its vptr.
+    void** m_vptr;
+    std::vector<void*> m_vtable;
+    std::size_t m_firstTarget;
+};
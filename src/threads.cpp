@@ -0,0 +1,272 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <khook.hpp>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "main.hpp"
+
+#if defined(_WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <pthread.h>
+#endif
+
+// Keeps a number of threads alive in the background, either blocked on a
+// condition variable or spinning. Stacks are kept small so that a thousand of
+// them still fit in the address space of the x86 package.
+class BackgroundThreads {
+  public:
+    ~BackgroundThreads() {
+        Stop();
+    }
+
+    std::size_t Start(std::size_t count, bool busy) {
+        m_busy = busy;
+        m_stop = false;
+        for (std::size_t i = 0; i < count; i++) {
+#if defined(_WIN32)
+            HANDLE thread = CreateThread(
+                nullptr,
+                kStackSize,
+                &BackgroundThreads::Entry,
+                this,
+                STACK_SIZE_PARAM_IS_A_RESERVATION,
+                nullptr
+            );
+            if (!thread) {
+                break;
+            }
+#else
+            pthread_attr_t attr;
+            pthread_attr_init(&attr);
+            pthread_attr_setstacksize(&attr, kStackSize);
+            pthread_t thread;
+            int error =
+                pthread_create(&thread, &attr, &BackgroundThreads::Entry, this);
+            pthread_attr_destroy(&attr);
+            if (error != 0) {
+                break;
+            }
+#endif
+            m_threads.push_back(thread);
+        }
+        while (m_running.load() < m_threads.size()) {
+            YieldThread();
+        }
+        return m_threads.size();
+    }
+
+    void Stop() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        for (auto thread : m_threads) {
+#if defined(_WIN32)
+            WaitForSingleObject(thread, INFINITE);
+            CloseHandle(thread);
+#else
+            pthread_join(thread, nullptr);
+#endif
+        }
+        m_threads.clear();
+        m_running = 0;
+    }
+
+  private:
+    static constexpr std::size_t kStackSize = 64 * 1024;
+
+    static void YieldThread() {
+#if defined(_WIN32)
+        SwitchToThread();
+#else
+        sched_yield();
+#endif
+    }
+
+#if defined(_WIN32)
+    static DWORD WINAPI Entry(LPVOID param) {
+        static_cast<BackgroundThreads*>(param)->Run();
+        return 0;
+    }
+#else
+    static void* Entry(void* param) {
+        static_cast<BackgroundThreads*>(param)->Run();
+        return nullptr;
+    }
+#endif
+
+    void Run() {
+        m_running++;
+        if (m_busy) {
+            unsigned int state = 1;
+            while (!m_stop.load(std::memory_order_relaxed)) {
+                state = state * 1103515245 + 12345;
+                DoNotOptimize(state);
+            }
+        } else {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [this]() { return m_stop.load(); });
+        }
+    }
+
+#if defined(_WIN32)
+    std::vector<HANDLE> m_threads;
+#else
+    std::vector<pthread_t> m_threads;
+#endif
+    std::atomic<std::size_t> m_running {0};
+    std::atomic<bool> m_stop {false};
+    bool m_busy = false;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+};
+
+class ThreadCountInstallBenchmark: public ::testing::TestWithParam<bool> {
+  protected:
+    class TestObject {
+      public:
+        int m_testValue;
+    };
+
+    class HookedClass {
+      public:
+        NOINLINE static int SetObjectValue(TestObject* obj, int value) {
+            obj->m_testValue = value;
+            return value;
+        }
+
+        virtual int VirtualSetObjectValue(TestObject* obj, int value) {
+            obj->m_testValue = value;
+            return value;
+        }
+    };
+
+    using SetObjectValueNoopHook = NoopStaticHookTemplate<int, TestObject*, int>;
+    using VirtualSetObjectValueNoopHook =
+        NoopMemberHookTemplate<int, TestObject*, int>;
+
+  protected:
+    void SetUp() override {
+        target = new HookedClass();
+    }
+
+    void TearDown() override {
+        if (target) {
+            delete target;
+            target = nullptr;
+        }
+    }
+
+    int InstallStatic() {
+        return KHook::SetupHook(
+            (void*)&HookedClass::SetObjectValue,
+            nullptr,
+            (void*)&SetObjectValueNoopHook::OnRemoved,
+            (void*)&SetObjectValueNoopHook::PrePostNoop,
+            (void*)&SetObjectValueNoopHook::PrePostNoop,
+            (void*)&SetObjectValueNoopHook::MakeReturn,
+            (void*)&SetObjectValueNoopHook::CallOriginal,
+            false
+        );
+    }
+
+    int InstallVirtual() {
+        return KHook::SetupVirtualHook(
+            *(void***)(target),
+            KHook::GetVtableIndex(&HookedClass::VirtualSetObjectValue),
+            nullptr,
+            KHook::ExtractMFP(&VirtualSetObjectValueNoopHook::OnRemoved),
+            KHook::ExtractMFP(&VirtualSetObjectValueNoopHook::PrePostNoop),
+            KHook::ExtractMFP(&VirtualSetObjectValueNoopHook::PrePostNoop),
+            KHook::ExtractMFP(&VirtualSetObjectValueNoopHook::MakeReturn),
+            KHook::ExtractMFP(&VirtualSetObjectValueNoopHook::CallOriginal),
+            false
+        );
+    }
+
+    ScopedCallbackLogging m_quiet {false};
+    HookedClass* target = nullptr;
+};
+
+TEST_P(ThreadCountInstallBenchmark, InstallLatency) {
+    BENCHMARK_ONLY();
+
+    bool busy = GetParam();
+    std::size_t rounds = BenchIterations(200);
+
+    for (std::size_t count : {0, 16, 64, 256, 1024}) {
+        BackgroundThreads background;
+        std::size_t started = background.Start(count, busy);
+        EXPECT_EQ(started, count) << "Background threads should all start";
+
+        LatencyHistogram staticInstall;
+        LatencyHistogram staticRemove;
+        LatencyHistogram virtualInstall;
+        LatencyHistogram virtualRemove;
+        std::size_t failedInstalls = 0;
+
+        for (std::size_t round = 0; round < rounds; round++) {
+            std::int64_t begin = GetWallTimeNs();
+            int hookId = InstallStatic();
+            staticInstall.Record(GetWallTimeNs() - begin);
+            if (hookId != KHook::INVALID_HOOK) {
+                begin = GetWallTimeNs();
+                KHook::RemoveHook(hookId, false);
+                staticRemove.Record(GetWallTimeNs() - begin);
+            } else {
+                failedInstalls++;
+            }
+
+            begin = GetWallTimeNs();
+            hookId = InstallVirtual();
+            virtualInstall.Record(GetWallTimeNs() - begin);
+            if (hookId != KHook::INVALID_HOOK) {
+                begin = GetWallTimeNs();
+                KHook::RemoveHook(hookId, false);
+                virtualRemove.Record(GetWallTimeNs() - begin);
+            } else {
+                failedInstalls++;
+            }
+        }
+
+        background.Stop();
+
+        std::string name = "threads_" + std::to_string(started);
+        ReportLatencies(
+            (name + ".static_install").c_str(),
+            staticInstall.Summarize()
+        );
+        ReportLatencies(
+            (name + ".static_remove").c_str(),
+            staticRemove.Summarize()
+        );
+        ReportLatencies(
+            (name + ".virtual_install").c_str(),
+            virtualInstall.Summarize()
+        );
+        ReportLatencies(
+            (name + ".virtual_remove").c_str(),
+            virtualRemove.Summarize()
+        );
+
+        EXPECT_EQ(failedInstalls, 0u) << "Hook setup should succeed";
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Threads,
+    ThreadCountInstallBenchmark,
+    ::testing::Values(false, true),
+    [](const ::testing::TestParamInfo<bool>& info) {
+        return std::string(info.param ? "Busy" : "Idle");
+    }
+);
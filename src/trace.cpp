@@ -0,0 +1,337 @@
+#include "trace.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+#if defined(_WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <unistd.h>
+#endif
+
+TraceSink g_traceSink;
+
+// The file starts with this header, followed by one region per thread. Both
+// take a full cache line so that threads never write to the same one.
+struct TraceFileHeader {
+    char magic[4];
+    std::uint32_t version;
+    std::uint64_t regions;
+    std::uint64_t eventsPerRegion;
+    std::int64_t startNs;
+    std::uint8_t reserved[32];
+};
+
+struct TraceRegionHeader {
+    std::uint64_t count;
+    std::uint32_t thread;
+    std::uint32_t claimed;
+    std::uint8_t reserved[48];
+};
+
+static_assert(sizeof(TraceFileHeader) == 64, "Header must fill a cache line");
+static_assert(sizeof(TraceRegionHeader) == 64, "Header must fill a cache line");
+
+static constexpr char kTraceMagic[4] = {'K', 'H', 'E', 'V'};
+static constexpr std::uint32_t kTraceVersion = 1;
+
+// Same clock as GetWallTimeNs, without pulling the test resources into the
+// decoder.
+static std::int64_t TraceNowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()
+    )
+        .count();
+}
+
+const char* TracePhaseName(TracePhase phase) {
+    switch (phase) {
+        case TracePhase::Callback:
+            return "Callback";
+        case TracePhase::CallOriginal:
+            return "CallOriginal";
+        case TracePhase::MakeReturn:
+            return "MakeReturn";
+        case TracePhase::Removed:
+            return "Removed";
+        case TracePhase::Pre:
+            return "Pre";
+        default:
+            return "Post";
+    }
+}
+
+#pragma region TraceSink
+
+// Region of the calling thread. It's claimed again once the generation no
+// longer matches the one of the open sink.
+struct ThreadRegion {
+    std::uint32_t generation;
+    std::uint32_t thread;
+    std::uint64_t* count;
+    TraceEvent* events;
+    std::uint64_t capacity;
+    // Stands in for the count of threads that didn't get a region.
+    std::uint64_t overflow;
+};
+
+static thread_local ThreadRegion t_traceRegion {};
+
+bool TraceSink::Open(
+    const char* path,
+    std::size_t threads,
+    std::size_t eventsPerThread
+) {
+    Close();
+    if (threads == 0) {
+        return false;
+    }
+
+    // An even number of events keeps every region on a cache line boundary.
+    m_regions = threads;
+    m_eventsPerRegion = eventsPerThread + (eventsPerThread & 1);
+    m_regionBytes =
+        sizeof(TraceRegionHeader) + m_eventsPerRegion * sizeof(TraceEvent);
+    m_size = sizeof(TraceFileHeader) + m_regions * m_regionBytes;
+
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(
+        path,
+        GENERIC_READ | GENERIC_WRITE,
+        FILE_SHARE_READ,
+        nullptr,
+        CREATE_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL,
+        nullptr
+    );
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(
+        file,
+        nullptr,
+        PAGE_READWRITE,
+        (DWORD)((std::uint64_t)m_size >> 32),
+        (DWORD)m_size,
+        nullptr
+    );
+    void* base = mapping
+        ? MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, m_size)
+        : nullptr;
+    if (!base) {
+        if (mapping) {
+            CloseHandle(mapping);
+        }
+        CloseHandle(file);
+        return false;
+    }
+    m_file = file;
+    m_mapping = mapping;
+#else
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    if (ftruncate(fd, (off_t)m_size) != 0) {
+        close(fd);
+        return false;
+    }
+
+    int flags = MAP_SHARED;
+    #if defined(__linux__)
+    // Faults the pages in now rather than on the first event of every page.
+    flags |= MAP_POPULATE;
+    #endif
+    void* base = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, flags, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return false;
+    }
+#endif
+
+    m_base = static_cast<std::uint8_t*>(base);
+    TraceFileHeader* header = reinterpret_cast<TraceFileHeader*>(m_base);
+    memcpy(header->magic, kTraceMagic, sizeof(header->magic));
+    header->version = kTraceVersion;
+    header->regions = m_regions;
+    header->eventsPerRegion = m_eventsPerRegion;
+    header->startNs = TraceNowNs();
+
+    m_nextRegion.store(0, std::memory_order_relaxed);
+    m_dropped.store(0, std::memory_order_relaxed);
+    m_generation.fetch_add(1, std::memory_order_release);
+    m_open.store(true, std::memory_order_release);
+    return true;
+}
+
+void TraceSink::Close() {
+    if (!m_base) {
+        return;
+    }
+    m_open.store(false, std::memory_order_release);
+
+#if defined(_WIN32)
+    UnmapViewOfFile(m_base);
+    CloseHandle(m_mapping);
+    CloseHandle(m_file);
+    m_mapping = nullptr;
+    m_file = nullptr;
+#else
+    munmap(m_base, m_size);
+#endif
+    m_base = nullptr;
+    m_size = 0;
+}
+
+bool TraceSink::Claim() {
+    ThreadRegion& state = t_traceRegion;
+    state.generation = m_generation.load(std::memory_order_acquire);
+
+    std::size_t index = m_nextRegion.fetch_add(1, std::memory_order_relaxed);
+    if (index >= m_regions) {
+        state.count = &state.overflow;
+        state.capacity = 0;
+        return false;
+    }
+
+    TraceRegionHeader* header = reinterpret_cast<TraceRegionHeader*>(
+        m_base + sizeof(TraceFileHeader) + index * m_regionBytes
+    );
+    header->thread = (std::uint32_t)index;
+    header->claimed = 1;
+
+    state.thread = (std::uint32_t)index;
+    state.count = &header->count;
+    state.events = reinterpret_cast<TraceEvent*>(header + 1);
+    state.capacity = m_eventsPerRegion;
+    return true;
+}
+
+void TraceSink::Record(TracePhase phase, const void* function, int hookId) {
+    ThreadRegion& state = t_traceRegion;
+    if (state.generation != m_generation.load(std::memory_order_relaxed)
+        && !Claim()) {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    std::uint64_t count = *state.count;
+    if (count >= state.capacity) {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    TraceEvent& event = state.events[count];
+    event.timestampNs = TraceNowNs();
+    event.function = (std::uint64_t)(std::uintptr_t)function;
+    event.hookId = hookId;
+    event.thread = state.thread;
+    event.phase = phase;
+    *state.count = count + 1;
+}
+
+#pragma endregion
+
+#pragma region Decoder
+
+bool ReadTraceFile(const char* path, TraceFile* trace) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+
+    TraceFileHeader header {};
+    bool ok = fread(&header, sizeof(header), 1, file) == 1
+        && memcmp(header.magic, kTraceMagic, sizeof(header.magic)) == 0
+        && header.version == kTraceVersion;
+
+    trace->threads.clear();
+    trace->startNs = header.startNs;
+    for (std::uint64_t r = 0; ok && r < header.regions; r++) {
+        TraceRegionHeader region {};
+        if (fread(&region, sizeof(region), 1, file) != 1) {
+            ok = false;
+            break;
+        }
+
+        std::vector<TraceEvent> events(
+            region.claimed ? std::min(region.count, header.eventsPerRegion) : 0
+        );
+        if (!events.empty()
+            && fread(events.data(), sizeof(TraceEvent), events.size(), file)
+                != events.size()) {
+            ok = false;
+            break;
+        }
+        long rest = (long)((header.eventsPerRegion - events.size())
+                           * sizeof(TraceEvent));
+        if (fseek(file, rest, SEEK_CUR) != 0) {
+            ok = false;
+            break;
+        }
+
+        if (region.claimed) {
+            trace->threads.push_back(std::move(events));
+        }
+    }
+
+    fclose(file);
+    if (!ok) {
+        trace->threads.clear();
+    }
+    return ok;
+}
+
+std::vector<TraceCall> BuildCallTimelines(const TraceFile& trace) {
+    std::vector<TraceCall> calls;
+    for (const std::vector<TraceEvent>& events : trace.threads) {
+        // Calls of this thread that haven't returned yet, innermost last.
+        std::vector<std::size_t> open;
+        for (const TraceEvent& event : events) {
+            if (event.phase == TracePhase::Removed) {
+                continue;
+            }
+
+            if (open.empty() || calls[open.back()].function != event.function) {
+                TraceCall call;
+                call.thread = event.thread;
+                call.function = event.function;
+                call.startNs = event.timestampNs;
+                call.depth = open.size();
+                open.push_back(calls.size());
+                calls.push_back(std::move(call));
+            }
+
+            TraceCall& call = calls[open.back()];
+            TraceEvent step = event;
+            if (event.phase == TracePhase::Callback) {
+                bool calledOriginal = std::any_of(
+                    call.events.begin(),
+                    call.events.end(),
+                    [](const TraceEvent& previous) {
+                        return previous.phase == TracePhase::CallOriginal;
+                    }
+                );
+                step.phase =
+                    calledOriginal ? TracePhase::Post : TracePhase::Pre;
+            }
+            call.events.push_back(step);
+            call.endNs = event.timestampNs;
+
+            if (event.phase == TracePhase::MakeReturn) {
+                call.complete = true;
+                open.pop_back();
+            }
+        }
+    }
+    return calls;
+}
+
+#pragma endregion
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+enum class TracePhase : std::uint8_t {
+    // Pre or post callback, only the decoder can tell them apart.
+    Callback,
+    CallOriginal,
+    MakeReturn,
+    Removed,
+    // Set by the decoder for callbacks before and after CallOriginal.
+    Pre,
+    Post
+};
+
+const char* TracePhaseName(TracePhase phase);
+
+struct TraceEvent {
+    std::int64_t timestampNs;
+    // Original function of the running call. Callbacks aren't told which of
+    // the hooks on a function is running, so calls are keyed by function.
+    std::uint64_t function;
+    // Only set for Removed.
+    std::int32_t hookId;
+    std::uint32_t thread;
+    TracePhase phase;
+    std::uint8_t reserved[7];
+};
+
+static_assert(sizeof(TraceEvent) == 32, "Trace events must stay packed");
+
+// Writes callback events into a memory mapped file. Every thread claims a
+// region of its own on its first event, after that recording an event is a
+// handful of stores: no locks, no syscalls. Events that don't fit into the
+// region of their thread are counted as dropped.
+class TraceSink {
+  public:
+    // Truncates the file to room for `threads` regions of `eventsPerThread`
+    // events each. Not thread safe, and neither is Close: no hooked calls may
+    // run while the sink is opened or closed.
+    bool Open(
+        const char* path,
+        std::size_t threads,
+        std::size_t eventsPerThread
+    );
+    void Close();
+
+    bool IsOpen() const {
+        return m_open.load(std::memory_order_relaxed);
+    }
+
+    void Record(TracePhase phase, const void* function, int hookId);
+
+    std::uint64_t Dropped() const {
+        return m_dropped.load(std::memory_order_relaxed);
+    }
+
+  private:
+    bool Claim();
+
+    std::atomic<bool> m_open {false};
+    std::atomic<std::uint32_t> m_generation {0};
+    std::atomic<std::size_t> m_nextRegion {0};
+    std::atomic<std::uint64_t> m_dropped {0};
+    std::uint8_t* m_base = nullptr;
+    std::size_t m_size = 0;
+    std::size_t m_regions = 0;
+    std::size_t m_eventsPerRegion = 0;
+    std::size_t m_regionBytes = 0;
+#if defined(_WIN32)
+    void* m_file = nullptr;
+    void* m_mapping = nullptr;
+#endif
+};
+
+extern TraceSink g_traceSink;
+
+#pragma region Decoder
+
+struct TraceFile {
+    std::int64_t startNs = 0;
+    // Events of every region that was claimed, in the order they happened.
+    std::vector<std::vector<TraceEvent>> threads;
+};
+
+bool ReadTraceFile(const char* path, TraceFile* file);
+
+struct TraceCall {
+    std::uint32_t thread = 0;
+    std::uint64_t function = 0;
+    std::int64_t startNs = 0;
+    std::int64_t endNs = 0;
+    // Nesting depth, calls made from inside another hooked call are deeper.
+    std::size_t depth = 0;
+    // False if the trace ended before MakeReturn.
+    bool complete = false;
+    std::vector<TraceEvent> events;
+};
+
+// Groups the events of every thread into hooked calls. A call starts with the
+// first callback of a function and ends with its MakeReturn, events of other
+// functions in between belong to nested calls. Recursive calls of the same
+// function are merged into the outer one.
+std::vector<TraceCall> BuildCallTimelines(const TraceFile& file);
+
+#pragma endregion
@@ -0,0 +1,128 @@
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <map>
+
+#include "trace.hpp"
+
+// Offline decoder for the files written by TraceSink. Prints the timeline of
+// every hooked call, or with --summary only the call counts and durations per
+// hooked function.
+
+struct FunctionSummary {
+    std::uint64_t calls = 0;
+    std::uint64_t incomplete = 0;
+    std::int64_t totalNs = 0;
+    std::int64_t maxNs = 0;
+};
+
+static void
+PrintTimelines(const TraceFile& trace, const std::vector<TraceCall>& calls) {
+    for (const TraceCall& call : calls) {
+        printf(
+            "thread %" PRIu32 " %*scall 0x%" PRIx64 " +%" PRId64 " ns%s\n",
+            call.thread,
+            (int)(call.depth * 2),
+            "",
+            call.function,
+            call.startNs - trace.startNs,
+            call.complete ? "" : " (incomplete)"
+        );
+        for (const TraceEvent& event : call.events) {
+            printf(
+                "  %*s%+9" PRId64 " ns %s\n",
+                (int)(call.depth * 2),
+                "",
+                event.timestampNs - call.startNs,
+                TracePhaseName(event.phase)
+            );
+        }
+    }
+
+    for (const std::vector<TraceEvent>& events : trace.threads) {
+        for (const TraceEvent& event : events) {
+            if (event.phase == TracePhase::Removed) {
+                printf(
+                    "thread %" PRIu32 " removed hook %" PRId32 " +%" PRId64
+                    " ns\n",
+                    event.thread,
+                    event.hookId,
+                    event.timestampNs - trace.startNs
+                );
+            }
+        }
+    }
+}
+
+static void
+PrintSummary(const TraceFile& trace, const std::vector<TraceCall>& calls) {
+    std::uint64_t events = 0;
+    for (const std::vector<TraceEvent>& thread : trace.threads) {
+        events += thread.size();
+    }
+    printf("threads %zu\n", trace.threads.size());
+    printf("events %" PRIu64 "\n", events);
+    printf("calls %zu\n", calls.size());
+
+    std::map<std::uint64_t, FunctionSummary> functions;
+    for (const TraceCall& call : calls) {
+        FunctionSummary& summary = functions[call.function];
+        summary.calls++;
+        if (!call.complete) {
+            summary.incomplete++;
+            continue;
+        }
+        std::int64_t duration = call.endNs - call.startNs;
+        summary.totalNs += duration;
+        if (duration > summary.maxNs) {
+            summary.maxNs = duration;
+        }
+    }
+
+    for (const auto& entry : functions) {
+        const FunctionSummary& summary = entry.second;
+        std::uint64_t complete = summary.calls - summary.incomplete;
+        printf(
+            "function 0x%" PRIx64 " calls %" PRIu64 " incomplete %" PRIu64
+            " mean %.1f ns max %" PRId64 " ns\n",
+            entry.first,
+            summary.calls,
+            summary.incomplete,
+            complete ? (double)summary.totalNs / (double)complete : 0.0,
+            summary.maxNs
+        );
+    }
+}
+
+int main(int argc, char** argv) {
+    const char* path = nullptr;
+    bool summary = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--summary") == 0) {
+            summary = true;
+        } else if (!path) {
+            path = argv[i];
+        } else {
+            path = nullptr;
+            break;
+        }
+    }
+    if (!path) {
+        fprintf(stderr, "Usage: %s <trace file> [--summary]\n", argv[0]);
+        return 1;
+    }
+
+    TraceFile trace;
+    if (!ReadTraceFile(path, &trace)) {
+        fprintf(stderr, "%s is not a valid trace\n", path);
+        return 1;
+    }
+
+    std::vector<TraceCall> calls = BuildCallTimelines(trace);
+    if (summary) {
+        PrintSummary(trace, calls);
+    } else {
+        PrintTimelines(trace, calls);
+    }
+    return 0;
+}
@@ -0,0 +1,249 @@
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <khook.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.hpp"
+#include "hooks.hpp"
+#include "main.hpp"
+#include "targets.hpp"
+#include "trace.hpp"
+
+class TraceSinkTest: public ::testing::Test {
+  protected:
+    void SetUp() override {
+        const ::testing::TestInfo* info =
+            ::testing::UnitTest::GetInstance()->current_test_info();
+        m_path = ::testing::TempDir() + "khook_" + info->test_suite_name() + "_"
+            + info->name() + ".trace";
+    }
+
+    void TearDown() override {
+        g_traceSink.Close();
+        std::remove(m_path.c_str());
+    }
+
+    static void Record(TracePhase phase, const void* function) {
+        g_traceSink.Record(phase, function, KHook::INVALID_HOOK);
+    }
+
+    // What the Noop templates record for a hooked call with two hooks on it,
+    // with another hooked call made by the original function.
+    static void RecordNestedCall(const void* outer, const void* inner) {
+        Record(TracePhase::Callback, outer);
+        Record(TracePhase::Callback, outer);
+        Record(TracePhase::CallOriginal, outer);
+        Record(TracePhase::Callback, inner);
+        Record(TracePhase::CallOriginal, inner);
+        Record(TracePhase::Callback, inner);
+        Record(TracePhase::MakeReturn, inner);
+        Record(TracePhase::Callback, outer);
+        Record(TracePhase::Callback, outer);
+        Record(TracePhase::MakeReturn, outer);
+    }
+
+    static std::vector<TracePhase> Phases(const TraceCall& call) {
+        std::vector<TracePhase> phases;
+        for (const TraceEvent& event : call.events) {
+            phases.push_back(event.phase);
+        }
+        return phases;
+    }
+
+    ScopedCallbackLogging m_quiet {false};
+    std::string m_path;
+};
+
+TEST_F(TraceSinkTest, RebuildsTimelinesPerThread) {
+    const std::size_t threads = 4;
+    ASSERT_TRUE(g_traceSink.Open(m_path.c_str(), threads, 64))
+        << "Should map " << m_path;
+
+    static int outer;
+    static int inner;
+    std::vector<std::thread> running;
+    for (std::size_t t = 0; t < threads; t++) {
+        running.emplace_back([t]() {
+            RecordNestedCall(&outer, &inner);
+            g_traceSink.Record(TracePhase::Removed, nullptr, 100 + (int)t);
+        });
+    }
+    for (std::thread& thread : running) {
+        thread.join();
+    }
+    EXPECT_EQ(g_traceSink.Dropped(), 0u);
+    g_traceSink.Close();
+
+    TraceFile trace;
+    ASSERT_TRUE(ReadTraceFile(m_path.c_str(), &trace))
+        << "Should decode the trace";
+    ASSERT_EQ(trace.threads.size(), threads)
+        << "Every thread should get a region";
+    for (const std::vector<TraceEvent>& events : trace.threads) {
+        ASSERT_EQ(events.size(), 11u);
+        for (std::size_t i = 1; i < events.size(); i++) {
+            EXPECT_GE(events[i].timestampNs, events[i - 1].timestampNs)
+                << "Events of a thread should stay in order";
+            EXPECT_EQ(events[i].thread, events[0].thread);
+        }
+        EXPECT_EQ(events.back().phase, TracePhase::Removed);
+        EXPECT_GE(events.back().hookId, 100);
+    }
+
+    std::vector<TraceCall> calls = BuildCallTimelines(trace);
+    ASSERT_EQ(calls.size(), 2 * threads) << "Should find two calls per thread";
+    std::vector<TracePhase> outerPhases = {
+        TracePhase::Pre,
+        TracePhase::Pre,
+        TracePhase::CallOriginal,
+        TracePhase::Post,
+        TracePhase::Post,
+        TracePhase::MakeReturn
+    };
+    std::vector<TracePhase> innerPhases = {
+        TracePhase::Pre,
+        TracePhase::CallOriginal,
+        TracePhase::Post,
+        TracePhase::MakeReturn
+    };
+    for (const TraceCall& call : calls) {
+        EXPECT_TRUE(call.complete) << "Every call should have returned";
+        EXPECT_LE(call.startNs, call.endNs);
+        if (call.function == (std::uint64_t)(std::uintptr_t)&outer) {
+            EXPECT_EQ(call.depth, 0u);
+            EXPECT_EQ(Phases(call), outerPhases);
+        } else {
+            EXPECT_EQ(call.depth, 1u) << "Inner call should be nested";
+            EXPECT_EQ(Phases(call), innerPhases);
+        }
+    }
+}
+
+TEST_F(TraceSinkTest, DropsEventsThatDontFit) {
+    ASSERT_TRUE(g_traceSink.Open(m_path.c_str(), 1, 4))
+        << "Should map " << m_path;
+
+    static int function;
+    for (int i = 0; i < 6; i++) {
+        Record(TracePhase::Callback, &function);
+    }
+    EXPECT_EQ(g_traceSink.Dropped(), 2u) << "Full region should drop events";
+
+    // The only region is taken, a second thread has nowhere to write to.
+    std::thread other([]() {
+        Record(TracePhase::Callback, &function);
+        Record(TracePhase::Callback, &function);
+    });
+    other.join();
+    EXPECT_EQ(g_traceSink.Dropped(), 4u);
+    g_traceSink.Close();
+
+    TraceFile trace;
+    ASSERT_TRUE(ReadTraceFile(m_path.c_str(), &trace));
+    ASSERT_EQ(trace.threads.size(), 1u);
+    EXPECT_EQ(trace.threads[0].size(), 4u) << "Kept events should be readable";
+
+    std::vector<TraceCall> calls = BuildCallTimelines(trace);
+    ASSERT_EQ(calls.size(), 1u);
+    EXPECT_FALSE(calls[0].complete) << "Call without MakeReturn is incomplete";
+}
+
+TEST_F(TraceSinkTest, TracesHookedCalls) {
+    HookHandle first = HookHandle::SetupHook(
+        (void*)GetGeneratedFunction(0),
+        nullptr,
+        (void*)&GeneratedStaticHook::OnRemoved,
+        (void*)&GeneratedStaticHook::PrePostNoop,
+        (void*)&GeneratedStaticHook::PrePostNoop,
+        (void*)&GeneratedStaticHook::MakeReturn,
+        (void*)&GeneratedStaticHook::CallOriginal,
+        false
+    );
+    ASSERT_TRUE(first.Valid()) << "Hook setup should succeed";
+    int hookId = first.Id();
+
+    ASSERT_TRUE(g_traceSink.Open(m_path.c_str(), 1, 1024))
+        << "Should map " << m_path;
+    const int calls = 3;
+    for (int i = 0; i < calls; i++) {
+        GeneratedObject obj {};
+        EXPECT_EQ(GetGeneratedFunction(0)(&obj, i + 1), i + 1);
+    }
+    first.Remove();
+    g_traceSink.Close();
+
+    TraceFile trace;
+    ASSERT_TRUE(ReadTraceFile(m_path.c_str(), &trace));
+    std::vector<TraceCall> timelines = BuildCallTimelines(trace);
+    ASSERT_EQ(timelines.size(), (std::size_t)calls)
+        << "Every hooked call should show up in the trace";
+    for (const TraceCall& call : timelines) {
+        EXPECT_TRUE(call.complete);
+        EXPECT_EQ(call.function, timelines[0].function)
+            << "Calls of one function should share a key";
+        EXPECT_EQ(
+            Phases(call),
+            std::vector<TracePhase>(
+                {TracePhase::Pre,
+                 TracePhase::CallOriginal,
+                 TracePhase::Post,
+                 TracePhase::MakeReturn}
+            )
+        );
+    }
+
+    ASSERT_FALSE(trace.threads.empty());
+    const TraceEvent& removed = trace.threads[0].back();
+    EXPECT_EQ(removed.phase, TracePhase::Removed)
+        << "OnRemoved should be traced";
+    EXPECT_EQ(removed.hookId, hookId);
+}
+
+TEST_F(TraceSinkTest, BenchmarkCallCost) {
+    BENCHMARK_ONLY();
+
+    HookHandle hook = HookHandle::SetupHook(
+        (void*)GetGeneratedFunction(0),
+        nullptr,
+        (void*)&GeneratedStaticHook::OnRemoved,
+        (void*)&GeneratedStaticHook::PrePostNoop,
+        (void*)&GeneratedStaticHook::PrePostNoop,
+        (void*)&GeneratedStaticHook::MakeReturn,
+        (void*)&GeneratedStaticHook::CallOriginal,
+        false
+    );
+    ASSERT_TRUE(hook.Valid()) << "Hook setup should succeed";
+
+    std::size_t iterations = BenchIterations(200000);
+    GeneratedObject obj {};
+    auto call = [&](std::size_t i) {
+        DoNotOptimize(GetGeneratedFunction(0)(&obj, (int)(i & 0xFFFF)));
+    };
+
+    double untraced = MeasureNsPerOp(iterations, call);
+    ReportMetric("untraced", untraced, "ns");
+
+    // Four events per call: pre, original, post and return.
+    ASSERT_TRUE(g_traceSink.Open(m_path.c_str(), 1, iterations * 4))
+        << "Should map " << m_path;
+    double traced = MeasureNsPerOp(iterations, call);
+    std::uint64_t dropped = g_traceSink.Dropped();
+    g_traceSink.Close();
+    ReportMetric("binary_trace", traced, "ns");
+    ReportMetric("binary_trace.overhead", traced - untraced, "ns");
+
+    double logged;
+    {
+        ScopedCallbackLogging logging(true);
+        ::testing::internal::CaptureStdout();
+        logged = MeasureNsPerOp(iterations, call);
+        ::testing::internal::GetCapturedStdout();
+    }
+    ReportMetric("text_log", logged, "ns");
+    ReportMetric("text_log.overhead", logged - untraced, "ns");
+
+    EXPECT_EQ(dropped, 0u) << "Region should fit every event of the run";
+}
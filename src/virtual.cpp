@@ -94,7 +94,7 @@ class VirtualHookTest: public ::testing::Test {
         }
 
         NOINLINE int HookInsideSetObjectValue(TestObject* obj, int value) {
-            m_hookId = KHook::SetupVirtualHook(
+            m_hook = HookHandle::SetupVirtualHook(
                 *(void***)(this),
                 KHook::GetVtableIndex(&HookedClass::IsAllowed),
                 nullptr,
@@ -136,6 +136,7 @@ class VirtualHookTest: public ::testing::Test {
     }
 
     void TearDown() override {
+        m_hook.Remove();
         if (obj) {
             delete obj;
             obj = nullptr;
@@ -148,13 +149,13 @@ class VirtualHookTest: public ::testing::Test {
 
     HookedClass* target = nullptr;
     TestObject* obj = nullptr;
-    static int m_hookId;
+    static HookHandle m_hook;
 };
 
-int VirtualHookTest::m_hookId = KHook::INVALID_HOOK;
+HookHandle VirtualHookTest::m_hook;
 
 TEST_F(VirtualHookTest, Noop) {
-    int hookId = KHook::SetupVirtualHook(
+    HookHandle hook = HookHandle::SetupVirtualHook(
         *(void***)(target),
         KHook::GetVtableIndex(&HookedClass::IsAllowed),
         nullptr,
@@ -166,13 +167,14 @@ TEST_F(VirtualHookTest, Noop) {
         false
     );
 
-    ASSERT_NE(hookId, KHook::INVALID_HOOK) << "Hook setup should succeed";
+    ASSERT_TRUE(hook.Valid()) << "Hook setup should succeed";
+    int hookId = hook.Id();
 
     testing::internal::CaptureStdout();
 
     bool overriddenResult = target->IsAllowed(obj);
 
-    KHook::RemoveHook(hookId, false);
+    hook.Remove();
 
     bool originalResult = target->IsAllowed(obj);
 
@@ -196,7 +198,7 @@ TEST_F(VirtualHookTest, Noop) {
 }
 
 TEST_F(VirtualHookTest, NoopVoid) {
-    int hookId = KHook::SetupVirtualHook(
+    HookHandle hook = HookHandle::SetupVirtualHook(
         *(void***)(target),
         KHook::GetVtableIndex(&HookedClass::MyVoid),
         nullptr,
@@ -208,13 +210,14 @@ TEST_F(VirtualHookTest, NoopVoid) {
         false
     );
 
-    ASSERT_NE(hookId, KHook::INVALID_HOOK) << "Hook setup should succeed";
+    ASSERT_TRUE(hook.Valid()) << "Hook setup should succeed";
+    int hookId = hook.Id();
 
     testing::internal::CaptureStdout();
 
     target->MyVoid(obj);
 
-    KHook::RemoveHook(hookId, false);
+    hook.Remove();
 
     target->MyVoid(obj);
 
@@ -234,7 +237,7 @@ TEST_F(VirtualHookTest, NoopVoid) {
 }
 
 TEST_F(VirtualHookTest, OverrideReturnValuePre) {
-    int hookId = KHook::SetupVirtualHook(
+    HookHandle hook = HookHandle::SetupVirtualHook(
         *(void***)(target),
         KHook::GetVtableIndex(&HookedClass::IsAllowed),
         nullptr,
@@ -246,19 +249,19 @@ TEST_F(VirtualHookTest, OverrideReturnValuePre) {
         false
     );
 
-    ASSERT_NE(hookId, KHook::INVALID_HOOK) << "Hook setup should succeed";
+    ASSERT_TRUE(hook.Valid()) << "Hook setup should succeed";
 
     bool result = target->IsAllowed(obj);
     EXPECT_FALSE(result) << "Method should return false when hooked";
 
-    KHook::RemoveHook(hookId, false);
+    hook.Remove();
 
     result = target->IsAllowed(obj);
     EXPECT_TRUE(result) << "Method should return true after hook removal";
 }
 
 TEST_F(VirtualHookTest, OverrideReturnValuePost) {
-    int hookId = KHook::SetupVirtualHook(
+    HookHandle hook = HookHandle::SetupVirtualHook(
         *(void***)(target),
         KHook::GetVtableIndex(&HookedClass::IsAllowed),
         nullptr,
@@ -270,19 +273,19 @@ TEST_F(VirtualHookTest, OverrideReturnValuePost) {
         false
     );
 
-    ASSERT_NE(hookId, KHook::INVALID_HOOK) << "Hook setup should succeed";
+    ASSERT_TRUE(hook.Valid()) << "Hook setup should succeed";
 
     bool result = target->IsAllowed(obj);
     EXPECT_FALSE(result) << "Method should return false when hooked";
 
-    KHook::RemoveHook(hookId, false);
+    hook.Remove();
 
     result = target->IsAllowed(obj);
     EXPECT_TRUE(result) << "Method should return true after hook removal";
 }
 
 TEST_F(VirtualHookTest, SupersedeReturnValue) {
-    int hookId = KHook::SetupVirtualHook(
+    HookHandle hook = HookHandle::SetupVirtualHook(
         *(void***)(target),
         KHook::GetVtableIndex(&HookedClass::IsAllowed),
         nullptr,
@@ -294,13 +297,13 @@ TEST_F(VirtualHookTest, SupersedeReturnValue) {
         false
     );
 
-    ASSERT_NE(hookId, KHook::INVALID_HOOK) << "Hook setup should succeed";
+    ASSERT_TRUE(hook.Valid()) << "Hook setup should succeed";
 
     testing::internal::CaptureStdout();
 
     bool overriddenResult = target->IsAllowed(obj);
 
-    KHook::RemoveHook(hookId, false);
+    hook.Remove();
 
     bool originalResult = target->IsAllowed(obj);
 
@@ -314,7 +317,7 @@ TEST_F(VirtualHookTest, SupersedeReturnValue) {
 }
 
 TEST_F(VirtualHookTest, SupersedeVoidReturnValue) {
-    int hookId = KHook::SetupVirtualHook(
+    HookHandle hook = HookHandle::SetupVirtualHook(
         *(void***)(target),
         KHook::GetVtableIndex(&HookedClass::MyVoid),
         nullptr,
@@ -326,7 +329,7 @@ TEST_F(VirtualHookTest, SupersedeVoidReturnValue) {
         false
     );
 
-    ASSERT_NE(hookId, KHook::INVALID_HOOK) << "Hook setup should succeed";
+    ASSERT_TRUE(hook.Valid()) << "Hook setup should succeed";
 
     testing::internal::CaptureStdout();
 
@@ -343,7 +346,7 @@ TEST_F(VirtualHookTest, SupersedeVoidReturnValue) {
             << "Callbacks should be called in the correct order";
     }
 
-    KHook::RemoveHook(hookId, false);
+    hook.Remove();
 
     testing::internal::CaptureStdout();
 
@@ -360,7 +363,7 @@ TEST_F(VirtualHookTest, SupersedeVoidReturnValue) {
 }
 
 TEST_F(VirtualHookTest, OverrideParameterWithRecall) {
-    int hookId = KHook::SetupVirtualHook(
+    HookHandle hook = HookHandle::SetupVirtualHook(
         *(void***)(target),
         KHook::GetVtableIndex(&HookedClass::SetObjectValue),
         nullptr,
@@ -372,14 +375,14 @@ TEST_F(VirtualHookTest, OverrideParameterWithRecall) {
         false
     );
 
-    ASSERT_NE(hookId, KHook::INVALID_HOOK) << "Hook setup should succeed";
+    ASSERT_TRUE(hook.Valid()) << "Hook setup should succeed";
 
     int result = target->SetObjectValue(obj, 0xDEADBEEF);
     EXPECT_EQ(obj->m_testValue, 1337)
         << "Method should set value to hooked value";
     EXPECT_EQ(result, 1337) << "Method should return hooked value";
 
-    KHook::RemoveHook(hookId, false);
+    hook.Remove();
 
     result = target->SetObjectValue(obj, 0xDEADBEEF);
     EXPECT_EQ(obj->m_testValue, 0xDEADBEEF)
@@ -389,7 +392,7 @@ TEST_F(VirtualHookTest, OverrideParameterWithRecall) {
 }
 
 TEST_F(VirtualHookTest, SupersedeThenNoopVoidHooksOnSameIndex) {
-    int firstHookId = KHook::SetupVirtualHook(
+    HookHandle firstHook = HookHandle::SetupVirtualHook(
         *(void***)(target),
         KHook::GetVtableIndex(&HookedClass::MyVoid),
         nullptr,
@@ -401,9 +404,9 @@ TEST_F(VirtualHookTest, SupersedeThenNoopVoidHooksOnSameIndex) {
         false
     );
 
-    ASSERT_NE(firstHookId, KHook::INVALID_HOOK) << "Hook setup should succeed";
+    ASSERT_TRUE(firstHook.Valid()) << "Hook setup should succeed";
 
-    int secondHookId = KHook::SetupVirtualHook(
+    HookHandle secondHook = HookHandle::SetupVirtualHook(
         *(void***)(target),
         KHook::GetVtableIndex(&HookedClass::MyVoid),
         nullptr,
@@ -415,7 +418,7 @@ TEST_F(VirtualHookTest, SupersedeThenNoopVoidHooksOnSameIndex) {
         false
     );
 
-    ASSERT_NE(secondHookId, KHook::INVALID_HOOK) << "Hook setup should succeed";
+    ASSERT_TRUE(secondHook.Valid()) << "Hook setup should succeed";
 
     testing::internal::CaptureStdout();
     target->MyVoid(obj);
@@ -433,7 +436,7 @@ TEST_F(VirtualHookTest, SupersedeThenNoopVoidHooksOnSameIndex) {
             << "Callback functions should be called in the correct order";
     }
 
-    KHook::RemoveHook(firstHookId, false);
+    firstHook.Remove();
 
     testing::internal::CaptureStdout();
     target->MyVoid(obj);
@@ -453,7 +456,7 @@ TEST_F(VirtualHookTest, SupersedeThenNoopVoidHooksOnSameIndex) {
 }
 
 TEST_F(VirtualHookTest, MultipleNoopVoidHooksOnSameIndex) {
-    int firstHookId = KHook::SetupVirtualHook(
+    HookHandle firstHook = HookHandle::SetupVirtualHook(
         *(void***)(target),
         KHook::GetVtableIndex(&HookedClass::MyVoid),
         nullptr,
@@ -465,9 +468,9 @@ TEST_F(VirtualHookTest, MultipleNoopVoidHooksOnSameIndex) {
         false
     );
 
-    ASSERT_NE(firstHookId, KHook::INVALID_HOOK) << "Hook setup should succeed";
+    ASSERT_TRUE(firstHook.Valid()) << "Hook setup should succeed";
 
-    int secondHookId = KHook::SetupVirtualHook(
+    HookHandle secondHook = HookHandle::SetupVirtualHook(
         *(void***)(target),
         KHook::GetVtableIndex(&HookedClass::MyVoid),
         nullptr,
@@ -479,7 +482,7 @@ TEST_F(VirtualHookTest, MultipleNoopVoidHooksOnSameIndex) {
         false
     );
 
-    ASSERT_NE(secondHookId, KHook::INVALID_HOOK) << "Hook setup should succeed";
+    ASSERT_TRUE(secondHook.Valid()) << "Hook setup should succeed";
 
     testing::internal::CaptureStdout();
     target->MyVoid(obj);
@@ -499,7 +502,7 @@ TEST_F(VirtualHookTest, MultipleNoopVoidHooksOnSameIndex) {
             << "Callback functions should be called in the correct order";
     }
 
-    KHook::RemoveHook(firstHookId, false);
+    firstHook.Remove();
 
     testing::internal::CaptureStdout();
     target->MyVoid(obj);
@@ -519,7 +522,7 @@ TEST_F(VirtualHookTest, MultipleNoopVoidHooksOnSameIndex) {
 }
 
 TEST_F(VirtualHookTest, SupersedeThenNoopHooksOnSameIndex) {
-    int firstHookId = KHook::SetupVirtualHook(
+    HookHandle firstHook = HookHandle::SetupVirtualHook(
         *(void***)(target),
         KHook::GetVtableIndex(&HookedClass::SetObjectValue),
         nullptr,
@@ -531,9 +534,9 @@ TEST_F(VirtualHookTest, SupersedeThenNoopHooksOnSameIndex) {
         false
     );
 
-    ASSERT_NE(firstHookId, KHook::INVALID_HOOK) << "Hook setup should succeed";
+    ASSERT_TRUE(firstHook.Valid()) << "Hook setup should succeed";
 
-    int secondHookId = KHook::SetupVirtualHook(
+    HookHandle secondHook = HookHandle::SetupVirtualHook(
         *(void***)(target),
         KHook::GetVtableIndex(&HookedClass::SetObjectValue),
         nullptr,
@@ -545,7 +548,7 @@ TEST_F(VirtualHookTest, SupersedeThenNoopHooksOnSameIndex) {
         false
     );
 
-    ASSERT_NE(secondHookId, KHook::INVALID_HOOK) << "Hook setup should succeed";
+    ASSERT_TRUE(secondHook.Valid()) << "Hook setup should succeed";
 
     obj->m_testValue = 0x9600;
 
@@ -565,7 +568,7 @@ TEST_F(VirtualHookTest, SupersedeThenNoopHooksOnSameIndex) {
             << "Callback functions should be called in the correct order";
     }
     
-    KHook::RemoveHook(firstHookId, false);
+    firstHook.Remove();
 
     obj->m_testValue = 0x9600;
 
@@ -585,7 +588,7 @@ TEST_F(VirtualHookTest, SupersedeThenNoopHooksOnSameIndex) {
             << "Callback functions should be called in the correct order";
     }
 
-    KHook::RemoveHook(secondHookId, false);
+    secondHook.Remove();
 
     obj->m_testValue = 0x9600;
 
@@ -603,9 +606,7 @@ TEST_F(VirtualHookTest, SupersedeThenNoopHooksOnSameIndex) {
 }
 
 TEST_F(VirtualHookTest, HookIsAllowedInsideSetObjectValue) {
-    m_hookId = KHook::INVALID_HOOK;
-
-    int hookId = KHook::SetupVirtualHook(
+    HookHandle hook = HookHandle::SetupVirtualHook(
         *(void***)(target),
         KHook::GetVtableIndex(&HookedClass::SetObjectValue),
         nullptr,
@@ -617,7 +618,7 @@ TEST_F(VirtualHookTest, HookIsAllowedInsideSetObjectValue) {
         false
     );
 
-    ASSERT_NE(hookId, KHook::INVALID_HOOK) << "Hook setup should succeed";
+    ASSERT_TRUE(hook.Valid()) << "Hook setup should succeed";
 
     int firstResult = target->SetObjectValue(obj, 42);
 
@@ -625,7 +626,7 @@ TEST_F(VirtualHookTest, HookIsAllowedInsideSetObjectValue) {
         << "SetObjectValue should set value to 42 (original behavior)";
     EXPECT_EQ(firstResult, 42)
         << "SetObjectValue should return 42 (original value)";
-    ASSERT_NE(m_hookId, KHook::INVALID_HOOK)
+    ASSERT_TRUE(m_hook.Valid())
         << "IsAllowed hook should have been set up inside SetObjectValue";
 
     bool result = target->IsAllowed(obj);
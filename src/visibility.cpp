@@ -0,0 +1,214 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <khook.hpp>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.hpp"
+#include "hooks.hpp"
+#include "main.hpp"
+#include "targets.hpp"
+
+#pragma region VisibilityHook
+
+// Bumped right before every install. A worker still inside the previous
+// round's hook tags its store with that round, and it is ignored.
+static std::atomic<std::uint32_t> s_visibilityRound {0};
+
+// When the worker owning the slot first ran the pre callback in `round`.
+struct alignas(64) VisibilitySlot {
+    std::atomic<std::int64_t> seenNs {0};
+    std::atomic<std::uint32_t> round {0};
+};
+
+static thread_local VisibilitySlot* t_visibilitySlot = nullptr;
+
+class VisibilityHook {
+  public:
+    NOINLINE static int Pre(GeneratedObject* obj, int value) {
+        VisibilitySlot* slot = t_visibilitySlot;
+        std::uint32_t round = s_visibilityRound.load(std::memory_order_acquire);
+        if (slot && slot->round.load(std::memory_order_relaxed) != round) {
+            // Read after the round, so never older than the install.
+            slot->seenNs.store(GetWallTimeNs(), std::memory_order_relaxed);
+            slot->round.store(round, std::memory_order_release);
+        }
+        KHook::SaveReturnValue(
+            KHook::Action::Ignore,
+            nullptr,
+            0,
+            nullptr,
+            nullptr,
+            false
+        );
+        return 0;
+    }
+
+    NOINLINE int PreMember(GeneratedObject* obj, int value) {
+        return Pre(obj, value);
+    }
+};
+
+#pragma endregion
+
+class InstallVisibilityBenchmark: public ::testing::TestWithParam<HookKind> {
+  protected:
+    void SetUp() override {
+        instance.reset(new GeneratedInstance(1));
+    }
+
+    void TearDown() override {
+        instance.reset();
+    }
+
+    HookHandle Install() {
+        if (GetParam() == HookKind::Static) {
+            return HookHandle::SetupHook(
+                (void*)GetGeneratedFunction(0),
+                nullptr,
+                (void*)&GeneratedStaticHook::OnRemoved,
+                (void*)&VisibilityHook::Pre,
+                (void*)&GeneratedStaticHook::PrePostNoop,
+                (void*)&GeneratedStaticHook::MakeReturn,
+                (void*)&GeneratedStaticHook::CallOriginal,
+                false
+            );
+        }
+        return HookHandle::SetupVirtualHook(
+            instance->Vtable(),
+            0,
+            nullptr,
+            KHook::ExtractMFP(&GeneratedMemberHook::OnRemoved),
+            KHook::ExtractMFP(&VisibilityHook::PreMember),
+            KHook::ExtractMFP(&GeneratedMemberHook::PrePostNoop),
+            KHook::ExtractMFP(&GeneratedMemberHook::MakeReturn),
+            KHook::ExtractMFP(&GeneratedMemberHook::CallOriginal),
+            false
+        );
+    }
+
+    int Call(GeneratedObject* obj, int value) {
+        if (GetParam() == HookKind::Static) {
+            return GetGeneratedFunction(0)(obj, value);
+        }
+        return instance->Call(0, obj, value);
+    }
+
+    ScopedCallbackLogging m_quiet {false};
+    std::unique_ptr<GeneratedInstance> instance;
+};
+
+TEST_P(InstallVisibilityBenchmark, TimeUntilThreadsEnterNewHook) {
+    BENCHMARK_ONLY();
+
+    unsigned int threads = BenchThreads();
+    std::size_t rounds = BenchIterations(200);
+    ReportMetric("spinning_threads", threads, "threads");
+
+    std::vector<VisibilitySlot> slots(threads);
+    std::vector<std::uint64_t> badCalls(threads, 0);
+    std::atomic<bool> running {true};
+    std::atomic<unsigned int> started {0};
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]() {
+            t_visibilitySlot = &slots[t];
+            started++;
+            GeneratedObject obj {};
+            int value = 0;
+            while (running.load(std::memory_order_relaxed)) {
+                value = (value + 1) & 0xFFFF;
+                badCalls[t] += Call(&obj, value) == value ? 0 : 1;
+            }
+            t_visibilitySlot = nullptr;
+        });
+    }
+    while (started.load() < threads) {
+        std::this_thread::yield();
+    }
+
+    // Every thread's delay from SetupHook returning to its first pre
+    // callback, and per round the delay until the last thread got there.
+    LatencyHistogram perThread;
+    LatencyHistogram allThreads;
+    LatencyHistogram install;
+    std::uint64_t beforeReturn = 0;
+    std::uint64_t missedRounds = 0;
+    std::uint64_t failedInstalls = 0;
+
+    for (std::size_t r = 0; r < rounds; r++) {
+        std::uint32_t round = s_visibilityRound.fetch_add(1) + 1;
+
+        std::int64_t start = GetWallTimeNs();
+        HookHandle hook = Install();
+        std::int64_t returned = GetWallTimeNs();
+        install.Record(returned - start);
+        if (!hook.Valid()) {
+            failedInstalls++;
+            break;
+        }
+
+        std::int64_t deadline = returned + 1000000000;
+        std::size_t seen = 0;
+        while (seen < threads && GetWallTimeNs() < deadline) {
+            seen = 0;
+            for (const VisibilitySlot& slot : slots) {
+                seen +=
+                    slot.round.load(std::memory_order_acquire) == round ? 1 : 0;
+            }
+        }
+        hook.Remove();
+
+        if (seen < threads) {
+            missedRounds++;
+            break;
+        }
+
+        // A thread can enter the hook before SetupHook has returned, that
+        // counts as no delay at all.
+        std::int64_t last = 0;
+        for (const VisibilitySlot& slot : slots) {
+            std::int64_t delay =
+                slot.seenNs.load(std::memory_order_relaxed) - returned;
+            beforeReturn += delay < 0 ? 1 : 0;
+            delay = std::max<std::int64_t>(delay, 0);
+            perThread.Record(delay);
+            last = std::max(last, delay);
+        }
+        allThreads.Record(last);
+    }
+
+    running = false;
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    std::uint64_t totalBadCalls = 0;
+    for (std::uint64_t bad : badCalls) {
+        totalBadCalls += bad;
+    }
+
+    ReportLatencies("install", install.Summarize());
+    ReportLatencies("visible_per_thread", perThread.Summarize());
+    ReportLatencies("visible_all_threads", allThreads.Summarize());
+    ReportMetric("entered_before_return", (double)beforeReturn, "threads");
+
+    EXPECT_EQ(failedInstalls, 0u) << "Hook setup should succeed";
+    EXPECT_EQ(missedRounds, 0u)
+        << "Every spinning thread should enter a new hook within a second";
+    EXPECT_EQ(totalBadCalls, 0u)
+        << "Calls should keep the original value while hooks come and go";
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Hooks,
+    InstallVisibilityBenchmark,
+    ::testing::Values(HookKind::Static, HookKind::Virtual),
+    [](const ::testing::TestParamInfo<HookKind>& info) {
+        return std::string(HookKindName(info.param));
+    }
+);